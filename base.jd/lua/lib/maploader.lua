@@ -19,7 +19,9 @@
     # What is done? #
 
      1. loadMap() only: The tilemap is loaded with loadFromFile (see mapFile()
-        for details about the name --> filename mapping).
+        for details about the name --> filename mapping). loadMapAsync() loads
+        it in the background instead and does the remaining steps once it is
+        loaded.
      2. Using the returned information, especially the 'name' properties of the
         tiles in the tileset, the tile-ID <--> tile-name mapping is established
         (see above).
@@ -40,7 +42,8 @@
             substituteObjects = {sequence: jd.Entity}
             tileCollisionInfo = jd.TileCollideableInfo
             mapObjects = {groupname = {sequence: jd.Entity}}
-            objectColliders = {groupname or # = jd.RectCollideableGroup}
+            objectColliders = {groupname or # = jd.AabbTreeCollideableGroup}
+            objectShapeColliders = {groupname or # = jd.ShapeCollideableGroup}
             tileMapping = {byName = {name = id}, byId = {id = name}}
         }
 --]]
@@ -117,10 +120,17 @@ end
     Return a table {groupname or # = {sequence: jd.Entity}} for each
     object in each objectgroup in props.objectGroup and add objects which have
     a PositionComponent to the newly created table
-    mapdata.objectColliders[groupname or #].
+    mapdata.objectColliders[groupname or #]. The exact outlines of LINE and
+    POLY objects (whether or not an entity was created for them) are added
+    to mapdata.objectShapeColliders[groupname or #].
 --]]
+local OBJT_LINE = jd.mapInfo.Object.LINE
+local OBJT_POLY = jd.mapInfo.Object.POLY
+local OBJT_RECT = jd.mapInfo.Object.RECT
+
 local function setupObjects(props, mapdata)
     mapdata.objectColliders = { }
+    mapdata.objectShapeColliders = { }
     local objects = { }
     local groups = props.objectGroups
     for kv in groups:iter() do
@@ -130,17 +140,30 @@ local function setupObjects(props, mapdata)
         local hasName = groupInfo.name ~= ''
         local groupId = hasName and groupInfo.name or #objects + 1
         objects[groupId] = group
-        local collider = jd.RectCollideableGroup()
+        local collider = jd.AabbTreeCollideableGroup()
         mapdata.objectColliders[groupId] = collider
+        local shapeCollider = jd.ShapeCollideableGroup()
+        mapdata.objectShapeColliders[groupId] = shapeCollider
         for i = 1, groupInfo.objects.count do
             local objectInfo = groupInfo.objects:get(i)
             local obj = createObject(objectInfo, groupInfo, mapdata, props)
+            local objType = objectInfo.objectType
+            local isShape = objType == OBJT_LINE or objType == OBJT_POLY
+            if isShape then
+                if obj then
+                    shapeCollider:add(objectInfo, obj)
+                else
+                    shapeCollider:add(objectInfo)
+                end -- if obj
+            end -- if objectInfo is LINE or POLY
             if obj then
                 group[i] = obj
+                -- Shapes collide exactly through shapeCollider only, not
+                -- additionally with the rect of their PositionComponent.
                 local objPos = obj:component 'PositionComponent'
-                if objPos then
+                if objPos and not isShape then
                     collider:add(objPos)
-                end -- if objPos
+                end -- if objPos and not isShape
             end -- if obj
         end -- for each object in layer
     end -- for each layer
@@ -176,9 +199,6 @@ local function substituteObjects(props, mapdata)
     return objects
 end
 
-local OBJT_LINE = jd.mapInfo.Object.LINE
-local OBJT_RECT = jd.mapInfo.Object.RECT
-
 local function getRect(tposOrR, map)
     return tposOrR.wh and
         tposOrR or map:localTileRect(jd.Vec2(pos.x, pos.y))
@@ -227,8 +247,23 @@ function M.findTagObjects(tposOrR, map, tagobjects)
     return objects
 end
 
+-- Prefers the compiled map (see compileMap.py), if there is one which is
+-- not older than the .tmx (or there is no .tmx).
 function M.mapFile(name)
-    return "maps/" .. name .. ".tmx"
+    local compiled = "maps/" .. name .. ".jdmap"
+    local source = "maps/" .. name .. ".tmx"
+    if not jd.fileExists(compiled) then
+        return source
+    end
+    if not jd.fileExists(source) then
+        return compiled
+    end
+    local compiledTime = jd.fileModTime(compiled)
+    local sourceTime = jd.fileModTime(source)
+    if compiledTime and sourceTime and compiledTime >= sourceTime then
+        return compiled
+    end
+    return source
 end
 
 --[[
@@ -272,4 +307,24 @@ function M.loadMap(map, name, data)
     return M.initializeMap(result)
 end
 
+--[[
+    Like loadMap(), but the map file is loaded in the background by
+    jd.svc.jobQueue. Once done, onLoaded is called with the result of
+    initializeMap() or, if loading failed, with nil and the error message.
+    Returns the jd.TilemapLoad, which can be used to query the progress.
+--]]
+function M.loadMapAsync(map, name, onLoaded, data)
+    data = data or { }
+    data.name = name
+    data.map = map
+    return jd.loadTilemapAsync(jd.svc.jobQueue, M.mapFile(name), function(load)
+        if load.failed then
+            onLoaded(nil, load.error)
+            return
+        end
+        data.props = load:assignTo(map)
+        onLoaded(M.initializeMap(data))
+    end)
+end
+
 return M
@@ -0,0 +1,127 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef BOUNDED_QUEUE_HPP_INCLUDED
+#define BOUNDED_QUEUE_HPP_INCLUDED BOUNDED_QUEUE_HPP_INCLUDED
+
+#include <boost/noncopyable.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+
+// A fixed size FIFO queue which any number of threads may push to and pop
+// from concurrently without locking (Dmitry Vyukov's bounded MPMC queue).
+// Each cell carries a sequence number telling whether it is free for the
+// push or ready for the pop with a given position, so that only the
+// position counters are contended.
+template <typename T>
+class BoundedQueue: private boost::noncopyable {
+public:
+    // capacity must be a power of two.
+    explicit BoundedQueue(std::size_t capacity):
+        m_cells(new Cell[capacity]),
+        m_mask(capacity - 1)
+    {
+        if (capacity < 2 || (capacity & m_mask) != 0)
+            throw std::invalid_argument(
+                "BoundedQueue capacity must be a power of two");
+        for (std::size_t i = 0; i < capacity; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        m_enqueue.value.store(0, std::memory_order_relaxed);
+        m_dequeue.value.store(0, std::memory_order_relaxed);
+    }
+
+    // Returns false (leaving value untouched) if the queue is full.
+    bool tryPush(T&& value)
+    {
+        Cell* cell;
+        std::size_t pos = m_enqueue.value.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            std::size_t const seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t const diff =
+                static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_enqueue.value.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_enqueue.value.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Returns false if the queue is empty.
+    bool tryPop(T& value)
+    {
+        Cell* cell;
+        std::size_t pos = m_dequeue.value.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            std::size_t const seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t const diff =
+                static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (m_dequeue.value.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = m_dequeue.value.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // The number of pushes/pops so far (i.e. the position of the next one).
+    // Since other threads may push and pop at any time, these are only
+    // snapshots.
+    std::size_t pushedCount() const
+    {
+        return m_enqueue.value.load(std::memory_order_acquire);
+    }
+
+    std::size_t poppedCount() const
+    {
+        return m_dequeue.value.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    // Keeps the positions on separate cache lines, so that pushing threads
+    // do not slow down popping ones and vice versa.
+    struct Position {
+        std::atomic<std::size_t> value;
+        char padding[64 - sizeof(std::atomic<std::size_t>)];
+    };
+
+    std::unique_ptr<Cell[]> const m_cells;
+    std::size_t const m_mask;
+    Position m_enqueue;
+    Position m_dequeue;
+};
+
+#endif
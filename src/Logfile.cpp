@@ -4,32 +4,198 @@
 
 #include "Logfile.hpp"
 
+#include "BoundedQueue.hpp"
 #include "encoding.hpp"
+#include "logFormat.hpp"
 
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/format.hpp>
-#include <boost/iostreams/device/file.hpp>
-#include <boost/iostreams/filter/line.hpp>
+#include <boost/lexical_cast.hpp>
 #include <SFML/System/Err.hpp>
 
-#include <array>
-#include <iomanip>
-#include <sstream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <streambuf>
+#include <thread>
+#include <unordered_map>
 
 
-class Logfile::LineNotifier :public boost::iostreams::line_filter
+struct Logfile::Record {
+    Record(): level(loglevel::info), location(nullptr), microseconds(0) { }
+
+    loglevel level;
+    char const* location;        // Static; if nullptr, dynamicLocation is used.
+    std::string dynamicLocation;
+    boost::int64_t microseconds; // Since the Logfile was created.
+    std::string message;
+    boost::function<std::string()> formatMessage; // If set, replaces message.
+};
+
+class Logfile::AsyncWriter: private boost::noncopyable {
+public:
+    AsyncWriter(Logfile& log, std::size_t queueSize);
+    ~AsyncWriter(); // Writes all queued records.
+
+    void push(Record& record);
+    void flush();
+
+private:
+    void run();
+
+    Logfile& m_log;
+    BoundedQueue<Record> m_queue;
+    std::atomic<std::size_t> m_droppedCount;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_written;
+    std::size_t m_writtenCount; // Guarded by m_mutex, as is m_stopping.
+    bool m_stopping;
+
+    std::thread m_thread;
+};
+
+static std::size_t nextPowerOfTwo(std::size_t n)
+{
+    std::size_t result = 2;
+    while (result < n)
+        result *= 2;
+    return result;
+}
+
+Logfile::AsyncWriter::AsyncWriter(Logfile& log, std::size_t queueSize):
+    m_log(log),
+    m_queue(nextPowerOfTwo(queueSize)),
+    m_writtenCount(0),
+    m_stopping(false)
+{
+    m_droppedCount.store(0);
+    m_thread = std::thread(&AsyncWriter::run, this);
+}
+
+Logfile::AsyncWriter::~AsyncWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void Logfile::AsyncWriter::push(Record& record)
+{
+    while (!m_queue.tryPush(std::move(record))) {
+        if (record.level < loglevel::error) {
+            ++m_droppedCount;
+            return;
+        }
+        m_wake.notify_one();
+        std::this_thread::yield();
+    }
+    m_wake.notify_one();
+}
+
+void Logfile::AsyncWriter::flush()
+{
+    std::size_t const pushedCount = m_queue.pushedCount();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_wake.notify_one();
+    while (m_writtenCount < pushedCount)
+        m_written.wait(lock);
+}
+
+void Logfile::AsyncWriter::run()
+{
+    // Writing everything available at once saves a lot of flushes if there
+    // are many messages.
+    static std::size_t const maxBatchSize = 64 * 1024;
+
+    std::string lines;
+    Record record;
+    for (;;) {
+        while (m_queue.tryPop(record)) {
+            m_log.appendFormatted(lines, record);
+            if (lines.size() >= maxBatchSize) {
+                m_log.writeFormatted(lines);
+                lines.clear();
+            }
+        }
+
+        std::size_t const droppedCount = m_droppedCount.exchange(0);
+        if (droppedCount > 0) {
+            Record note;
+            note.level = loglevel::warning;
+            note.location = "<Logfile>";
+            note.microseconds = m_log.m_timer.getElapsedTime().asMicroseconds();
+            note.message = boost::lexical_cast<std::string>(droppedCount) +
+                " message(s) dropped because the log queue was full.";
+            m_log.appendFormatted(lines, note);
+        }
+
+        if (!lines.empty()) {
+            m_log.writeFormatted(lines);
+            lines.clear();
+        }
+
+        std::size_t const poppedCount = m_queue.poppedCount();
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_writtenCount = poppedCount;
+        m_written.notify_all();
+        if (m_queue.pushedCount() == poppedCount) {
+            if (m_stopping)
+                return;
+            // Pushing does not lock m_mutex, so a notification may get lost;
+            // the timeout bounds the delay this causes.
+            m_wake.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+}
+
+
+// SFML writes to sf::err() from whichever thread fails, e.g. from JobQueue
+// workers loading resources. This buffer is therefore unbuffered, so that
+// every write goes through m_mutex, and it collects lines per thread.
+class Logfile::LineNotifier: public std::streambuf, private boost::noncopyable
 {
 public:
-    LineNotifier(Logfile* parent): m_parent(parent) { }
+    explicit LineNotifier(Logfile& parent): m_parent(parent) { }
+
+protected:
+    virtual int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+            return traits_type::not_eof(c);
+        char const ch = traits_type::to_char_type(c);
+        xsputn(&ch, 1);
+        return c;
+    }
+
+    virtual std::streamsize xsputn(char const* s, std::streamsize n) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto const it = m_lines.insert(
+            std::make_pair(std::this_thread::get_id(), std::string())).first;
+        std::string& line = it->second;
+        for (std::streamsize i = 0; i < n; ++i) {
+            if (s[i] != '\n') {
+                line += s[i];
+                continue;
+            }
+            if (loglevel::error >= m_parent.minLevel())
+                m_parent.write(line, loglevel::error, "<unknown/SFML>");
+            line.clear();
+        }
+        if (line.empty())
+            m_lines.erase(it);
+        return n;
+    }
 
 private:
-     std::string do_filter(const std::string& line)
-     {
-         if (loglevel::error >= m_parent->minLevel())
-             m_parent->write(line, loglevel::error, "<unknown/SFML>");
-         return "";
-     }
-     Logfile* m_parent;
+    Logfile& m_parent;
+    std::mutex m_mutex;
+    std::unordered_map<std::thread::id, std::string> m_lines; // Unfinished.
 };
 
 static const std::string full_time()
@@ -45,38 +211,6 @@ static const std::string full_time()
 #endif
 }
 
-const std::string Logfile::printable_time() const
-{
-    std::stringstream str;
-    str << std::setprecision(6) << std::fixed << m_timer.getElapsedTime().asSeconds();
-    return str.str();
-}
-
-static const std::string filterHtml(std::string const& s)
-{
-    std::string result;
-    result.reserve(s.size() * 3 / 2);
-    for (char const c : s) switch (c)
-    {
-        case '<':
-            result += "&lt;";
-            break;
-        case '>':
-            result += "&gt;";
-            break;
-        case '&':
-            result += "&amp;";
-            break;
-        case '"':
-            result += "&quot;";
-            break;
-        default:
-            result += c;
-            break;
-    }
-    return result;
-}
-
 Logfile::Logfile(const std::string& filename, loglevel min_level_, logstyle style_):
     m_min_level(min_level_),
     m_style(style_)
@@ -96,51 +230,37 @@ Logfile::Logfile():
 Logfile::~Logfile()
 {
     LOG_I("End logging at " + full_time());
+    m_async.reset();
 
-    if (m_style == logstyle::html)
-        m_file << "\n</tbody></table> </body> </html>\n";
+    m_file << logformat::footer(m_style);
     sf::err().rdbuf(m_originalSfBuf);
 }
 
 void Logfile::init()
 {
-    m_sferr.push(LineNotifier(this), 0);
-    m_sferr.push(m_file, 0);
+    m_sferr.reset(new LineNotifier(*this));
     m_originalSfBuf = sf::err().rdbuf();
-    sf::err().rdbuf(m_sferr.rdbuf());
+    sf::err().rdbuf(m_sferr.get());
 }
 
 void Logfile::open(const std::string& filename, logstyle style)
 {
+    flush();
+    m_style = style == logstyle::like_extension ?
+        logformat::styleFromFilename(filename) : style;
+    m_binaryWriter.reset(m_style == logstyle::binary ?
+        new logformat::BinaryWriter : nullptr);
+
+    m_file.close();
     m_file.clear();
-    m_file.open(enc::utf8ToFstreamArg(filename));
-    m_file << "";
+    m_file.open(
+        enc::utf8ToFstreamArg(filename),
+        m_style == logstyle::binary ?
+            std::ios::out | std::ios::binary : std::ios::out);
+    m_file << logformat::header(m_style);
     if (!m_file)
         throw Error("Cannot open or write to file \"" + filename + "\"!");
 
-    if (style == logstyle::like_extension)
-    {
-        // Determine style (plain if file has any extension other than html or htm).
-        const std::string::size_type pos_dot = filename.rfind('.');
-        const std::string extension = pos_dot == std::string::npos ? "" : filename.substr(pos_dot);
-        if (extension == ".html" || extension == ".htm")
-            m_style = logstyle::html;
-        else
-            m_style = logstyle::plain;
-    }
-
-    if (m_style == logstyle::html)
-    {
-        m_file << "<html> <head> <title>Logfile</title>"
-                  "<link rel=\"stylesheet\" href=\"logstyle.css\" type=\"text/css\"/> </head>\n"
-                  "<body ><h1>Logfile</h1>\n<table> <thead><tr> "
-                  "<td>Level</td> <td>Time(s)</td> <td>Location</td> <td>Message</td> </tr></thead><tbody>\n";
-    } else {
-        m_file << "===< LOGFILE >===\n\n"
-                  "Level      Time(s)    Location                              Message\n"
-                  "---------- ---------- ------------------------------------- ----------" \
-                  "----------------------------------------\n";
-    }
     LOG_I("Start logging at " + full_time());
 }
 
@@ -149,70 +269,97 @@ void Logfile::write(const boost::format& msg, loglevel level, char const* locati
     write(msg.str(), level, location);
 }
 
-void Logfile::write(std::string const& msg, loglevel level_, char const* location)
+void Logfile::write(std::string const& msg, loglevel level, char const* location)
 {
-    if (level_ < m_min_level)
+    if (level < m_min_level)
         return;
 
-    auto level = static_cast<unsigned>(level_);
+    Record record;
+    record.level = level;
+    record.location = location;
+    record.microseconds = m_timer.getElapsedTime().asMicroseconds();
+    record.message = msg;
+    writeRecord(record);
+}
 
-    static auto const maxloglevel = static_cast<int>(loglevel::max);
-    static_assert(maxloglevel == 5, "Please correct levelnames below!");
-    static const std::array<const char* const, maxloglevel> levelnames =
-        { "debug", "info", "warning", "error", "fatal" };
-    static const std::array<const char* const, maxloglevel> levelpreambles =
-        { "    ", "   _", "  + ", " *  ", "!>>>" };
+void Logfile::write(
+    std::string const& msg, loglevel level, std::string const& location)
+{
+    if (level < m_min_level)
+        return;
 
-    std::string location_;
-    std::string fmt;
-    std::string real_msg;
-    real_msg.reserve(msg.size());
+    Record record;
+    record.level = level;
+    record.dynamicLocation = location;
+    record.microseconds = m_timer.getElapsedTime().asMicroseconds();
+    record.message = msg;
+    writeRecord(record);
+}
 
-    if (m_style == logstyle::html)
-    {
-        if (location) {
-            location_ = filterHtml(location);
-            location = location_.c_str();
-        }
-        real_msg = filterHtml(msg);
-        fmt = str(boost::format("<tr class=\"%1%\"><td>%1%</td>") % levelnames[level]) +
-            "<td>%1%</td><td>%2%</td><td><pre>%3%</pre></td></tr>";
+void Logfile::writeDeferred(
+    loglevel level, char const* location,
+    boost::function<std::string()> const& formatMessage)
+{
+    if (level < m_min_level)
+        return;
+
+    Record record;
+    record.level = level;
+    record.location = location;
+    record.microseconds = m_timer.getElapsedTime().asMicroseconds();
+    record.formatMessage = formatMessage;
+    writeRecord(record);
+}
+
+void Logfile::writeRecord(Record& record)
+{
+    if (m_async) {
+        bool const isFatal = record.level == loglevel::fatal;
+        m_async->push(record);
+        if (isFatal)
+            m_async->flush();
+    } else {
+        // The binary style's state requires formatting and writing in order.
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        std::string line;
+        appendFormatted(line, record);
+        m_file << line;
+        m_file.flush();
     }
-    else // if (m_style == logstyle::plain)
-    {
-        fmt = levelpreambles[level] + str(boost::format("%|-8|") % levelnames[level]) + "%|9| %|-37| %||";
-        std::string msg2 = msg;
-        if (msg.back() == '\n')
-            msg2.pop_back();
-
-        // Add indentation to linebreaks
-        for (const char c : msg2) switch (c)
-        {
-            case '\n':
-                real_msg += "\n" + std::string(60, ' ');
-                break;
-            default:
-                real_msg += c;
-                break;
+}
+
+void Logfile::writeFormatted(std::string const& lines)
+{
+    std::lock_guard<std::mutex> lock(m_fileMutex);
+    m_file << lines;
+    m_file.flush();
+}
+
+void Logfile::appendFormatted(std::string& out, Record const& record)
+{
+    std::string formatted;
+    if (record.formatMessage) {
+        // Must not throw on the background thread.
+        try {
+            formatted = record.formatMessage();
+        } catch (std::exception const& e) {
+            formatted = "<invalid log message: " + std::string(e.what()) + '>';
         }
     }
+    std::string const& msg = record.formatMessage ? formatted : record.message;
 
-    std::string filename(location ? location : "<unknown>");
-    if (location) {
-        std::string::size_type posSrc;
-#ifdef _WIN32
-        posSrc = filename.rfind("src\\");
-        if (posSrc == std::string::npos)
-#endif
-            posSrc = filename.rfind("src/");
-        if (posSrc != std::string::npos)
-            filename.erase(0, posSrc + 4);
+    if (m_binaryWriter) {
+        m_binaryWriter->append(
+            out, record.level, record.location,
+            record.dynamicLocation.empty() ? nullptr : &record.dynamicLocation,
+            record.microseconds, msg);
+    } else {
+        char const* const location = record.location ? record.location :
+            record.dynamicLocation.empty() ? nullptr :
+            record.dynamicLocation.c_str();
+        out += logformat::formatText(
+            m_style, record.level, location, record.microseconds, msg);
     }
-    m_file << boost::format(fmt)
-        % printable_time()
-        % (m_style == logstyle::html ? filename : filterHtml(filename))
-        % real_msg << '\n';
-    m_file.flush();
 }
 
 
@@ -226,6 +373,27 @@ void Logfile::setMinLevel(loglevel level)
     m_min_level = level;
 }
 
+void Logfile::setAsync(bool async, std::size_t queueSize)
+{
+    if (async == isAsync())
+        return;
+    if (async)
+        m_async.reset(new AsyncWriter(*this, queueSize));
+    else
+        m_async.reset();
+}
+
+bool Logfile::isAsync() const
+{
+    return m_async != nullptr;
+}
+
+void Logfile::flush()
+{
+    if (m_async)
+        m_async->flush();
+}
+
 void Logfile::logThrow(const std::exception& ex, loglevel level, char const* location)
 {
     logEx(ex, level, location);
@@ -4,16 +4,18 @@
 
 #pragma once
 
-#include <boost/format/format_fwd.hpp>
-#include <boost/iostreams/filtering_stream.hpp>
+#include "logFormat.hpp"
+
+#include <boost/format.hpp>
+#include <boost/function.hpp>
 #include <SFML/System/Clock.hpp>
 
-#include <string>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
 
 
-enum class loglevel { debug, info, warning, error, fatal,  max  };
-enum class logstyle { html, plain, like_extension,  max };
 
 class Logfile
 {
@@ -23,6 +25,10 @@ public:
                      logstyle style = logstyle::like_extension);
     Logfile();
     ~Logfile();
+
+    // location must be a string with static storage duration (like
+    // LOGFILE_LOCATION), because in asynchronous mode it is only written
+    // after write() returns. Use the std::string overload otherwise.
     void write(
         const std::string& msg,
         loglevel level = loglevel::info,
@@ -31,6 +37,52 @@ public:
         const boost::format& msg,
         loglevel level = loglevel::info,
         char const* location = nullptr);
+    void write(
+        const std::string& msg,
+        loglevel level,
+        const std::string& location);
+
+    // Like write(), but the message is made by boost::format'ing fmt (which,
+    // like location, must have static storage duration) with copies of the
+    // arguments. This is done only when the message is written, i.e. on the
+    // background thread in asynchronous mode.
+    template <typename A1>
+    void writef(loglevel level, char const* location,
+                char const* fmt, A1 const& a1)
+    {
+        writeDeferred(level, location,
+            [fmt, a1]() { return str(boost::format(fmt) % a1); });
+    }
+
+    template <typename A1, typename A2>
+    void writef(loglevel level, char const* location,
+                char const* fmt, A1 const& a1, A2 const& a2)
+    {
+        writeDeferred(level, location,
+            [fmt, a1, a2]() { return str(boost::format(fmt) % a1 % a2); });
+    }
+
+    template <typename A1, typename A2, typename A3>
+    void writef(loglevel level, char const* location,
+                char const* fmt, A1 const& a1, A2 const& a2, A3 const& a3)
+    {
+        writeDeferred(level, location, [fmt, a1, a2, a3]() {
+            return str(boost::format(fmt) % a1 % a2 % a3);
+        });
+    }
+
+    template <typename A1, typename A2, typename A3, typename A4>
+    void writef(loglevel level, char const* location,
+                char const* fmt, A1 const& a1, A2 const& a2, A3 const& a3,
+                A4 const& a4)
+    {
+        writeDeferred(level, location, [fmt, a1, a2, a3, a4]() {
+            return str(boost::format(fmt) % a1 % a2 % a3 % a4);
+        });
+    }
+
+    // Whether a message of the given level would be written.
+    bool isEnabled(loglevel level) const { return level >= m_min_level; }
 
     void open(const std::string& filename, logstyle style = logstyle::like_extension);
     loglevel minLevel() const;
@@ -44,20 +96,41 @@ public:
         loglevel level = loglevel::error,
         char const* location = nullptr);
 
+    // In asynchronous mode, write() only puts the message into a queue,
+    // from which a background thread formats and writes it. If the queue
+    // (of queueSize messages, rounded up to a power of two) is full,
+    // messages below loglevel::error are dropped; the number of dropped
+    // messages is logged later. Messages of level fatal are written before
+    // write() returns, as is everything queued when flush() is called.
+    // Must not be called while other threads might log.
+    void setAsync(bool async, std::size_t queueSize = 4096);
+    bool isAsync() const;
+    void flush();
+
     class Error;
 
 private:
     class LineNotifier;
+    struct Record;
+    class AsyncWriter;
 
     void init();
-    const std::string printable_time() const;
+    void writeDeferred(
+        loglevel level, char const* location,
+        boost::function<std::string()> const& formatMessage);
+    void writeRecord(Record& record);
+    void appendFormatted(std::string& out, Record const& record);
+    void writeFormatted(const std::string& lines);
 
     loglevel m_min_level;
     logstyle m_style;
     std::ofstream m_file;
-    boost::iostreams::filtering_ostream m_sferr;
+    std::mutex m_fileMutex; // write() may be called from any thread.
+    std::unique_ptr<LineNotifier> m_sferr; // Stream buffer for sf::err().
     sf::Clock m_timer;
     std::streambuf* m_originalSfBuf;
+    std::unique_ptr<logformat::BinaryWriter> m_binaryWriter;
+    std::unique_ptr<AsyncWriter> m_async;
 };
 
 class Logfile::Error :public std::runtime_error
@@ -71,15 +144,53 @@ inline Logfile& log() {
     return instance;
 }
 
+// Log messages below this level (0: debug, 1: info, 2: warning, 3: error,
+// 4: fatal) are removed at compile time by the LOG_* macros.
+#ifndef JD_LOG_MIN_LEVEL
+#   define JD_LOG_MIN_LEVEL 0
+#endif
+
 #ifndef LOGFILE_NO_SHORTCUTS
 #   define LOGFILE_LOCATION __FILE__ ":" BOOST_STRINGIZE(__LINE__)
-#   define LOGFILE_LOG(s, l) log().write((s), loglevel::l, LOGFILE_LOCATION)
 
-#   define LOG_D(s) LOGFILE_LOG((s), debug)
-#   define LOG_I(s) LOGFILE_LOG((s), info)
-#   define LOG_W(s) LOGFILE_LOG((s), warning)
-#   define LOG_E(s) LOGFILE_LOG((s), error)
+    // The message is not even evaluated if the level is disabled at runtime.
+#   define LOGFILE_LOG(s, l) (log().isEnabled(loglevel::l) ? \
+        log().write((s), loglevel::l, LOGFILE_LOCATION) : (void)0)
+#   define LOGFILE_LOGF(l, ...) (log().isEnabled(loglevel::l) ? \
+        log().writef(loglevel::l, LOGFILE_LOCATION, __VA_ARGS__) : (void)0)
+
+    // LOG_x(msg) logs msg, a std::string or boost::format. LOG_xF(fmt, ...)
+    // uses Logfile::writef() to format the message only when writing it.
+#   if JD_LOG_MIN_LEVEL <= 0
+#       define LOG_D(s) LOGFILE_LOG((s), debug)
+#       define LOG_DF(...) LOGFILE_LOGF(debug, __VA_ARGS__)
+#   else
+#       define LOG_D(s) ((void)0)
+#       define LOG_DF(...) ((void)0)
+#   endif
+#   if JD_LOG_MIN_LEVEL <= 1
+#       define LOG_I(s) LOGFILE_LOG((s), info)
+#       define LOG_IF(...) LOGFILE_LOGF(info, __VA_ARGS__)
+#   else
+#       define LOG_I(s) ((void)0)
+#       define LOG_IF(...) ((void)0)
+#   endif
+#   if JD_LOG_MIN_LEVEL <= 2
+#       define LOG_W(s) LOGFILE_LOG((s), warning)
+#       define LOG_WF(...) LOGFILE_LOGF(warning, __VA_ARGS__)
+#   else
+#       define LOG_W(s) ((void)0)
+#       define LOG_WF(...) ((void)0)
+#   endif
+#   if JD_LOG_MIN_LEVEL <= 3
+#       define LOG_E(s) LOGFILE_LOG((s), error)
+#       define LOG_EF(...) LOGFILE_LOGF(error, __VA_ARGS__)
+#   else
+#       define LOG_E(s) ((void)0)
+#       define LOG_EF(...) ((void)0)
+#   endif
 #   define LOG_F(s) LOGFILE_LOG((s), fatal)
+#   define LOG_FF(...) LOGFILE_LOGF(fatal, __VA_ARGS__)
 
 #   define LOG_EX(e) log().logEx(e, loglevel::error, LOGFILE_LOCATION)
 #   define LOG_THROW(e) log().logThrow((e), loglevel::error, LOGFILE_LOCATION)
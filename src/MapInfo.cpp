@@ -8,27 +8,28 @@
 #include "Logfile.hpp"
 #include "ressys/ResourceManager.hpp"
 #include "svc/FileSystem.hpp"
+#include "svc/JobQueue.hpp"
+#include "XmlReader.hpp"
 
 #include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string/trim.hpp>
+#include <boost/bind.hpp>
 #include <boost/format.hpp>
-#include <boost/iostreams/stream.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
-#include <boost/range/algorithm/count_if.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/range/iterator_range.hpp>
 #include <boost/range/algorithm/transform.hpp>
 #include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Texture.hpp>
 #include <zlib.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <sstream>
 
 
-namespace io = boost::iostreams;
-namespace pt = boost::property_tree;
-namespace rng = boost::range;
 using boost::format;
 using boost::lexical_cast;
 
@@ -70,97 +71,172 @@ static std::string correctPath(std::string p)
     return p;
 }
 
-static pt::ptree readXmlVFile(std::string const& vfilename)
-{
-     // avoid most vexing parse by an additional pair of parantheses
-    VFile f(vfilename);
-    io::stream<VFileDevice> in(f);
+namespace {
 
-    pt::ptree result;
-    pt::read_xml(in, result);
-    return result;
-}
+// The result of parsing a tileset. The image is not loaded yet.
+struct TilesetData {
+    sf::Vector2u tileSize;
+    std::string image; // Resource name (correctPath() is already applied).
+    std::string transColor; // May be empty.
+    std::vector<std::pair<unsigned, PropertyMap>> tileProperties;
+};
+
+// The result of parsing a map file; info.tileProperties is still empty.
+struct TilemapData {
+    jd::Vector3u size;
+    std::vector<unsigned> tiles;
+    TilesetData tileset;
+    MapInfo info;
+};
+
+// Parsing the map file accounts for this share of TilemapLoad::progress(),
+// loading the tileset image for most of the rest.
+float const parsedProgress = 0.8f;
+float const imageLoadedProgress = 0.95f;
+
+// Reports how much of a file has been read, if progress is not null.
+class ParseProgress {
+public:
+    ParseProgress(VFile& f, std::atomic<float>* progress):
+        m_f(f),
+        m_progress(progress),
+        m_size(progress ? f.getSize() : 0)
+    { }
+
+    void update()
+    {
+        if (m_progress && m_size > 0) {
+            *m_progress = parsedProgress *
+                static_cast<float>(m_f.tell()) / static_cast<float>(m_size);
+        }
+    }
+
+private:
+    VFile& m_f;
+    std::atomic<float>* const m_progress;
+    sf::Int64 const m_size;
+};
+
+} // anonymous namespace
 
-static ResourceTraits<sf::Texture>::Ptr loadTexture(pt::ptree const& dom, sf::Vector2u& imgsz)
+static ResourceTraits<sf::Texture>::Ptr requestTexture(
+    TilesetData const& ts, sf::Vector2u& imgsz)
 {
-    std::string const imgSource = correctPath(
-       dom.get<std::string>("<xmlattr>.source"));
-    auto img = resMng<sf::Image>().request(imgSource);
+    auto img = resMng<sf::Image>().request(ts.image);
     imgsz = img->getSize();
-    auto transColor = dom.get_optional<std::string>("<xmlattr>.trans");
-    if (transColor)
-        img->createMaskFromColor(colorFromHexString(*transColor));
-    return resMng<sf::Texture>().request(imgSource);
+    if (!ts.transColor.empty())
+        img->createMaskFromColor(colorFromHexString(ts.transColor));
+    return resMng<sf::Texture>().request(ts.image);
 }
 
-static PropertyMap loadProperties(pt::ptree const& dom)
+static std::vector<PropertyMap> tileProperties(
+    TilesetData& ts, sf::Vector2u imgsz)
 {
-    PropertyMap result;
-    for (auto const& propelem : dom) {
-        if (propelem.first != "property") {
-            LOG_W("unknown tag in properties: \"" + propelem.first + '\"');
+    std::vector<PropertyMap> result(
+        (imgsz.x / ts.tileSize.x) * (imgsz.y / ts.tileSize.y));
+    for (auto& tile : ts.tileProperties) {
+        if (tile.first >= result.size()) {
+            LOG_WF("tile id too high: %1%", tile.first);
             continue;
         }
-        result[propelem.second.get<std::string>("<xmlattr>.name")] =
-            propelem.second.get<std::string>("<xmlattr>.value");
+        result[tile.first] = std::move(tile.second);
     }
+    ts.tileProperties.clear();
     return result;
 }
 
-static PropertyMap loadPropertiesOptional(pt::ptree const& parentdom)
+static MapInfo finishTilemap(
+    jd::Tilemap& tm, TilemapData& data,
+    ResourceTraits<sf::Texture>::Ptr const& texture, sf::Vector2u imgsz)
 {
-    if (auto const props = parentdom.get_child_optional("properties"))
-        return loadProperties(*props);
-    return PropertyMap();
+    data.info.tileProperties = tileProperties(data.tileset, imgsz);
+    tm.setTileset(jd::Tileset(data.tileset.tileSize, texture));
+    tm.assign(data.size, std::move(data.tiles));
+    return std::move(data.info);
 }
 
-static std::vector<PropertyMap> loadTileset(
-    jd::Tileset& ts,
-    pt::ptree const& dom,
-    std::string const& setdir)
+// The read*() functions below expect xml to be at the startElement token of
+// the element they read and consume everything up to its endElement token.
+
+static void readRootElement(XmlReader& xml, std::string const& name)
 {
-    auto const src = dom.get_optional<std::string>("<xmlattr>.source");
-    if (src)
-        return loadTileset(ts, setdir + *src);
+    if (!xml.nextChild() || xml.name() != name)
+        xml.error("root element <" + name + "> expected");
+}
 
-    sf::Vector2u imgsz;
-    ts = jd::Tileset(
-        sf::Vector2u(
-            dom.get<unsigned>("<xmlattr>.tilewidth"),
-            dom.get<unsigned>("<xmlattr>.tileheight")),
-        loadTexture(dom.get_child("image"), imgsz));
+static PropertyMap readProperties(XmlReader& xml)
+{
+    PropertyMap result;
+    while (xml.nextChild()) {
+        if (xml.name() != "property")
+            LOG_W("unknown tag in properties: \"" + xml.name() + '\"');
+        else
+            result[xml.attribute("name")] = xml.attribute("value");
+        xml.skipElement();
+    }
+    return result;
+}
 
-    std::vector<PropertyMap> result(
-        (imgsz.x / ts.size().x) * (imgsz.y / ts.size().y));
+static TilesetData parseTileset(std::string const& vfilename);
 
-    for (auto const& tileelem : dom) {
-        if (tileelem.first != "tile")
-            continue;
+static TilesetData readTileset(XmlReader& xml, std::string const& setdir)
+{
+    if (std::string const* src = xml.findAttribute("source")) {
+        std::string const path = setdir + *src;
+        xml.skipElement();
+        return parseTileset(path);
+    }
 
-        unsigned const tileId = tileelem.second.get<unsigned>("<xmlattr>.id");
-        if (tileId >= result.size()) {
-            LOG_W(format("tile id too high: %1%") % tileId);
-            continue;
-        }
+    TilesetData result;
+    result.tileSize.x = xml.attribute<unsigned>("tilewidth");
+    result.tileSize.y = xml.attribute<unsigned>("tileheight");
+    if (result.tileSize.x == 0 || result.tileSize.y == 0)
+        throw jd::ResourceLoadError("tileset has zero tile size");
 
-        auto const& tileprops = tileelem.second.get_child_optional("properties");
-        if (!tileprops)
-            continue;
-        result[tileId] = loadProperties(*tileprops);
-        if (result[tileId].empty())
-            LOG_W(format("empty tile properties for tile#%1%") % tileId);
+    while (xml.nextChild()) {
+        if (xml.name() == "image") {
+            result.image = correctPath(xml.attribute("source"));
+            result.transColor = xml.attribute("trans", std::string());
+            xml.skipElement();
+        } else if (xml.name() == "tile") {
+            unsigned const tileId = xml.attribute<unsigned>("id");
+            while (xml.nextChild()) {
+                if (xml.name() != "properties") {
+                    xml.skipElement();
+                    continue;
+                }
+                result.tileProperties.emplace_back(tileId, readProperties(xml));
+                if (result.tileProperties.back().second.empty())
+                    LOG_WF("empty tile properties for tile#%1%", tileId);
+            }
+        } else {
+            xml.skipElement();
+        }
     }
+    if (result.image.empty())
+        throw jd::ResourceLoadError("tileset has no image");
     return result;
 }
 
+static TilesetData parseTileset(std::string const& vfilename)
+{
+    VFile f(vfilename);
+    XmlReader xml(f);
+    readRootElement(xml, "tileset");
+    return readTileset(xml, std::string());
+}
+
 std::vector<PropertyMap> loadTileset(jd::Tileset& ts, std::string const& vfilename)
 {
-    return loadTileset(ts, readXmlVFile(vfilename).get_child("tileset"), std::string());
+    TilesetData data = parseTileset(vfilename);
+    sf::Vector2u imgsz;
+    auto const texture = requestTexture(data, imgsz);
+    ts = jd::Tileset(data.tileSize, texture);
+    return tileProperties(data, imgsz);
 }
 
-static std::vector<sf::Vector2f> loadPointsOptional(pt::ptree const& parentdom)
+static std::vector<sf::Vector2f> parsePoints(std::string const* points)
 {
-    auto const points = parentdom.get_optional<std::string>("<xmlattr>.points");
     if (!points)
         return std::vector<sf::Vector2f>();
 
@@ -189,124 +265,601 @@ static std::vector<sf::Vector2f> loadPointsOptional(pt::ptree const& parentdom)
     return result;
 }
 
+static MapObject readObject(XmlReader& xml, sf::Vector2u tileSize)
+{
+    MapObject o;
+    o.name = xml.attribute("name", std::string());
+    o.type = xml.attribute("type", std::string());
+    o.position.x = xml.attribute<float>("x");
+    o.position.y = xml.attribute<float>("y");
+    o.size.x = xml.attribute("width", 0.f);
+    o.size.y = xml.attribute("height", 0.f);
+    o.tileId = xml.attribute("gid", 0u);
+    if (o.tileId) {
+        o.objectType = MapObject::T::tile;
+        o.position.y -= tileSize.y; // assuming map orientation is orthogonal.
+    } else {
+        o.objectType = MapObject::T::rect; // WARN could also be invalid
+    }
 
-MapInfo loadTilemap(jd::Tilemap& tm, std::string const& vfilename)
+    while (xml.nextChild()) {
+        if (xml.name() == "properties") {
+            o.properties = readProperties(xml);
+            continue;
+        }
+        if (!o.tileId && o.objectType == MapObject::T::rect) {
+            if (xml.name() == "polyline") {
+                o.objectType = MapObject::T::line;
+                o.relativePoints = parsePoints(xml.findAttribute("points"));
+            } else if (xml.name() == "polygon") {
+                o.objectType = MapObject::T::poly;
+                o.relativePoints = parsePoints(xml.findAttribute("points"));
+            }
+        }
+        xml.skipElement();
+    }
+    return o;
+}
+
+static void readObjectGroup(
+    XmlReader& xml, MapInfo& result, sf::Vector2u tileSize)
+{
+    std::string const groupName = xml.attribute("name");
+    MapObjectGroup& group = result.objectGroups[groupName];
+    group.name = groupName;
+    while (xml.nextChild()) {
+        if (xml.name() == "properties") {
+            group.properties = readProperties(xml);
+        } else if (xml.name() == "object") {
+            group.objects.push_back(readObject(xml, tileSize));
+        } else {
+            LOG_W("unknown tag in object group: \"" + xml.name() + "\"");
+            xml.skipElement();
+        }
+    }
+}
+
+namespace {
+
+// Decodes the base64 text of a layer, which may arrive in pieces and may be
+// zlib or gzip compressed, directly into the layer's tiles.
+class LayerDataDecoder: private boost::noncopyable {
+public:
+    LayerDataDecoder(
+        unsigned* tiles, std::size_t tileCount, bool compressed,
+        std::size_t layer
+    ):
+        m_out(reinterpret_cast<Bytef*>(tiles)),
+        m_outSize(tileCount * sizeof(unsigned)),
+        m_written(0),
+        m_compressed(compressed),
+        m_streamEnd(false),
+        m_layer(layer)
+    {
+        if (!m_compressed)
+            return;
+        m_zs.zalloc = Z_NULL;
+        m_zs.zfree = Z_NULL;
+        m_zs.opaque = Z_NULL;
+        m_zs.next_in = Z_NULL;
+        m_zs.avail_in = 0;
+        int const r = inflateInit2(&m_zs, 32 + MAX_WBITS); // zlib or gzip
+        if (r != Z_OK)
+            error(str(format("decompression failed: %1%") % zError(r)));
+    }
+
+    ~LayerDataDecoder()
+    {
+        if (m_compressed)
+            inflateEnd(&m_zs);
+    }
+
+    void decode(std::string const& text)
+    {
+        if (text.empty())
+            return;
+        m_buf.resize(base64::maxDecodedSize(text.size()));
+        std::size_t const n = m_base64.decode(text.data(), text.size(), &m_buf[0]);
+
+        if (!m_compressed) {
+            if (n > m_outSize - m_written)
+                error("too much data");
+            std::memcpy(m_out + m_written, &m_buf[0], n);
+            m_written += n;
+            return;
+        }
+
+        m_zs.next_in = reinterpret_cast<Bytef*>(&m_buf[0]);
+        m_zs.avail_in = static_cast<uInt>(n);
+        while (m_zs.avail_in > 0 && !m_streamEnd) { // Ignore trailing data.
+            m_zs.next_out = m_out + m_written;
+            m_zs.avail_out = static_cast<uInt>(m_outSize - m_written);
+            int const r = inflate(&m_zs, Z_NO_FLUSH);
+            m_written = m_outSize - m_zs.avail_out;
+            if (r == Z_STREAM_END)
+                m_streamEnd = true;
+            else if (r == Z_BUF_ERROR && m_written == m_outSize)
+                error("too much data");
+            else if (r != Z_OK)
+                error(str(format("decompression failed: %1%") % zError(r)));
+        }
+    }
+
+    void finish()
+    {
+        m_base64.finish();
+        if (m_written != m_outSize || (m_compressed && !m_streamEnd))
+            error("too less data");
+    }
+
+private:
+    void error(std::string const& msg)
+    {
+        throw jd::ResourceLoadError(
+            str(format("layer#%1%: %2%") % m_layer % msg));
+    }
+
+    base64::Decoder m_base64;
+    std::vector<base64::byte> m_buf;
+    z_stream m_zs;
+    Bytef* const m_out;
+    std::size_t const m_outSize; // in bytes
+    std::size_t m_written;
+    bool const m_compressed;
+    bool m_streamEnd;
+    std::size_t const m_layer;
+};
+
+} // anonymous namespace
+
+static void readLayerData(
+    XmlReader& xml, unsigned* tiles, std::size_t tileCount, std::size_t z,
+    ParseProgress& progress)
 {
-    auto const map = readXmlVFile(vfilename).get_child("map");
-
-    tm.setSize(jd::Vector3u(
-        map.get<unsigned>("<xmlattr>.width"),
-        map.get<unsigned>("<xmlattr>.height"),
-        static_cast<unsigned>(
-            rng::count_if(map, [](pt::ptree::value_type const& e) {
-                return e.first == "layer"; }))));
-    if (tm.size().x * tm.size().y * tm.size().z == 0)
+    std::string const encoding = xml.attribute("encoding");
+    if (encoding != "base64")
+        throw jd::ResourceLoadError(str(format(
+            "layer#%1%: encoding \"%2%\" not supported") %
+                z % encoding));
+    std::string const compression =
+        xml.attribute("compression", std::string());
+    if (!compression.empty() && compression != "zlib" && compression != "gzip")
+        throw jd::ResourceLoadError(str(format(
+            "layer#%1%: compression \"%2%\" not supported") %
+                z % compression));
+
+    LayerDataDecoder decoder(tiles, tileCount, !compression.empty(), z);
+    while (xml.next() == XmlReader::Token::text) {
+        decoder.decode(xml.text());
+        progress.update();
+    }
+    if (xml.token() != XmlReader::Token::endElement)
+        xml.error("unexpected element in layer data");
+    decoder.finish();
+}
+
+static TilemapData parseTmxTilemap(
+    std::string const& vfilename, std::atomic<float>* progress_)
+{
+    VFile f(vfilename);
+    ParseProgress progress(f, progress_);
+    XmlReader xml(f);
+    readRootElement(xml, "map");
+
+    TilemapData result;
+    result.size.x = xml.attribute<unsigned>("width");
+    result.size.y = xml.attribute<unsigned>("height");
+    std::size_t const layerTileCount = result.size.x * result.size.y;
+    if (layerTileCount == 0)
         throw jd::ResourceLoadError("map is empty");
 
     std::size_t const posSep = vfilename.find_first_of("/\\");
-    jd::Tileset ts;
-    MapInfo result;
-    result.tileProperties = loadTileset(
-        ts,
-        map.get_child("tileset"),
-        posSep == std::string::npos ?
-            std::string() : vfilename.substr(0, posSep + 1));
-    tm.setTileset(ts);
-
-    result.layerProperties.resize(tm.size().z);
-
-    unsigned z = 0;
-    for (auto const& layer : map) {
-        if (layer.first == "objectgroup") {
-            std::string const groupName =
-                layer.second.get<std::string>("<xmlattr>.name");
-            MapObjectGroup& group = result.objectGroups[groupName];
-            group.name = groupName;
-            for (auto const& obj : layer.second) {
-                if (obj.first == "properties") {
-                    group.properties = loadProperties(obj.second);
-                } else if (obj.first == "object") {
-                    MapObject o;
-                    o.name = obj.second.get("<xmlattr>.name", std::string());
-                    o.type = obj.second.get("<xmlattr>.type", std::string());
-                    o.position = sf::Vector2f(
-                        obj.second.get<float>("<xmlattr>.x"),
-                        obj.second.get<float>("<xmlattr>.y"));
-                    o.size.x = obj.second.get("<xmlattr>.width", 0.f);
-                    o.size.y = obj.second.get("<xmlattr>.height", 0.f);
-                    o.properties = loadPropertiesOptional(obj.second);
-                    o.tileId = obj.second.get("<xmlattr>.gid", 0u);
-                    if (o.tileId) {
-                        o.objectType = MapObject::T::tile;
-                        o.position.y -= ts.size().y; // assuming map orientation is orthogonal.
-                    } else if (auto const line = obj.second.get_child_optional("polyline")) {
-                        o.objectType = MapObject::T::line;
-                        o.relativePoints = loadPointsOptional(*line);
-                    } else if (auto const line = obj.second.get_child_optional("polygon")) {
-                        o.objectType = MapObject::T::poly;
-                        o.relativePoints = loadPointsOptional(*line);
-                    } else {
-                        o.objectType = MapObject::T::rect; // WARN could also be invalid
-                    }
-                    group.objects.push_back(std::move(o));
-                } else if (obj.first != "<xmlattr>") {
-                    LOG_W("unknown tag in object group: \"" + obj.first + "\"");
+    std::string const setdir = posSep == std::string::npos ?
+        std::string() : vfilename.substr(0, posSep + 1);
+
+    // Layers are decoded directly into tiles, which is handed over to the
+    // tilemap as a whole, so no other copy of the map data is ever made.
+    std::vector<unsigned>& tiles = result.tiles;
+    MapInfo& info = result.info;
+    bool hasTileset = false;
+    while (xml.nextChild()) {
+        if (xml.name() == "properties") {
+            info.mapProperties = readProperties(xml);
+        } else if (xml.name() == "tileset" && !hasTileset) {
+            result.tileset = readTileset(xml, setdir);
+            hasTileset = true;
+        } else if (xml.name() == "objectgroup") {
+            readObjectGroup(xml, info, result.tileset.tileSize);
+        } else if (xml.name() == "layer") {
+            std::size_t const z = info.layerProperties.size();
+            info.layerProperties.push_back(PropertyMap());
+            tiles.resize(tiles.size() + layerTileCount);
+            bool hasData = false;
+            while (xml.nextChild()) {
+                if (xml.name() == "properties") {
+                    info.layerProperties[z] = readProperties(xml);
+                } else if (xml.name() == "data") {
+                    readLayerData(
+                        xml, &tiles[z * layerTileCount], layerTileCount, z,
+                        progress);
+                    hasData = true;
+                } else {
+                    xml.skipElement();
                 }
             }
-        } else if (layer.first == "layer") {
-            result.layerProperties[z]["name"] =
-                layer.second.get("<xmlattr>.name", std::string());
-            result.layerProperties[z] = loadPropertiesOptional(layer.second);
-            pt::ptree const& datadom = layer.second.get_child("data");
-            std::string const encoding =
-                datadom.get<std::string>("<xmlattr>.encoding");
-            if (encoding != "base64")
-                throw jd::ResourceLoadError(str(format(
-                    "layer#%1%: encoding \"%2%\" not supported") %
-                        z % encoding));
-            std::vector<base64::byte> rawdata = base64::decode(
-                boost::algorithm::trim_copy(datadom.data()));
-            if (rawdata.empty())
+            if (!hasData)
                 throw jd::ResourceLoadError(str(format(
                     "layer#%1%: empty data") % z));
-            std::string const compression =
-                datadom.get("<xmlattr>.compression", std::string());
-            std::vector<unsigned> data;
-            if (compression.empty()) {
-                data.assign(
-                    reinterpret_cast<unsigned*>(&data.front()),
-                    reinterpret_cast<unsigned*>(&data.back()));
-            } else if (compression == "zlib" || compression == "gzip") {
-                data.resize(tm.size().x * tm.size().y);
-                uLongf bufsz = data.size() * sizeof(unsigned);
-                int const r = uncompress(
-                    reinterpret_cast<Bytef*>(&data.front()),
-                    &bufsz,
-                    reinterpret_cast<Bytef*>(&rawdata.front()),
-                    rawdata.size());
-                if (r != Z_OK)
-                     throw jd::ResourceLoadError(str(format(
-                        "layer#%1%: decompression failed: %2%") %
-                        z % zError(r)));
-                if (bufsz != data.size() * sizeof(unsigned))
-                    throw jd::ResourceLoadError(str(format(
-                        "layer#%1%: too less data") % z));
-            } else {
-                throw jd::ResourceLoadError(str(format(
-                    "layer#%1%: compression \"%2%\" not supported") %
-                     z % compression));
-            }
-            jd::Vector3u p(0, 0, z);
-            std::size_t iData = 0;
-            for (; p.y < tm.size().y; ++p.y) {
-                for (; p.x < tm.size().x; ++p.x) {
-                    tm.set(p, data[iData++]);
-                }
-                p.x = 0;
+        } else {
+            xml.skipElement();
+        }
+        progress.update();
+    }
+
+    if (tiles.empty())
+        throw jd::ResourceLoadError("map is empty");
+    if (!hasTileset)
+        throw jd::ResourceLoadError("map has no tileset");
+    result.size.z = static_cast<unsigned>(info.layerProperties.size());
+    return result;
+}
+
+/*
+    Compiled maps (*.jdmap) are created from TMX maps by compileMap.py. All
+    values are 32 bit unsigned integers or floats in the byte order of the
+    target machine:
+
+    Header:
+        magic ("JDMB"), version, byte order mark (0x01020304),
+        width, height, layer count, size of the metadata block in bytes
+    Metadata block:
+        string table: count, then for each string its length and its
+            characters, padded to a multiple of 4 bytes
+        tileset: tile width, tile height, image source, transparent color
+        map properties
+        tile properties: count, then for each the tile ID and properties
+        layer properties: one entry per layer
+        object groups: count, then for each:
+            name, properties, object count, then for each object:
+                type (MapObject::T), name, type, x, y, width, height,
+                tile ID, properties, point count, points as x, y pairs
+    Tiles:
+        width * height * layer count tile IDs, in the order of Tilemap's
+        internal storage (layer by layer, row by row).
+
+    Strings are stored as indices into the string table. Properties are
+    stored as count, then key and value of each property.
+*/
+
+namespace {
+
+std::uint32_t const compiledMapMagic = 0x424D444A; // "JDMB"
+std::uint32_t const compiledMapVersion = 1;
+std::uint32_t const compiledMapByteOrderMark = 0x01020304;
+
+enum CompiledMapHeaderField {
+    hMagic, hVersion, hByteOrderMark, hWidth, hHeight, hLayerCount,
+    hMetadataSize, compiledMapHeaderSize
+};
+
+class CompiledMapReader {
+public:
+    explicit CompiledMapReader(std::vector<char> const& data):
+        m_data(data), m_pos(0)
+    {
+        m_strings.resize(count());
+        for (std::string& s : m_strings) {
+            std::uint32_t const length = u32();
+            s.assign(take(length), length);
+            take((4 - length % 4) % 4);
+        }
+    }
+
+    std::uint32_t u32() { return readValue<std::uint32_t>(); }
+
+    // Reads the count of a sequence of elements of at least 4 bytes each.
+    std::uint32_t count()
+    {
+        std::uint32_t const n = u32();
+        if (n > (m_data.size() - m_pos) / 4)
+            throw jd::ResourceLoadError("compiled map: metadata truncated");
+        return n;
+    }
+    float f32() { return readValue<float>(); }
+
+    std::string const& string()
+    {
+        std::uint32_t const i = u32();
+        if (i >= m_strings.size())
+            throw jd::ResourceLoadError("compiled map: invalid string index");
+        return m_strings[i];
+    }
+
+    PropertyMap properties()
+    {
+        PropertyMap result;
+        std::uint32_t const n = count();
+        for (std::uint32_t i = 0; i < n; ++i) {
+            std::string const& key = string();
+            result[key] = string();
+        }
+        return result;
+    }
+
+private:
+    template <typename T>
+    T readValue()
+    {
+        T result;
+        std::memcpy(&result, take(sizeof(T)), sizeof(T));
+        return result;
+    }
+
+    char const* take(std::size_t n)
+    {
+        if (n > m_data.size() - m_pos)
+            throw jd::ResourceLoadError("compiled map: metadata truncated");
+        char const* result = m_data.data() + m_pos;
+        m_pos += n;
+        return result;
+    }
+
+    std::vector<char> const& m_data;
+    std::size_t m_pos;
+    std::vector<std::string> m_strings;
+};
+
+} // anonymous namespace
+
+static void readCompiledMap(VFile& f, void* data, std::size_t size)
+{
+    if (f.read(data, size) != static_cast<sf::Int64>(size)) {
+        f.throwError();
+        throw jd::ResourceLoadError("compiled map: unexpected end of file");
+    }
+}
+
+static TilemapData parseCompiledTilemap(
+    std::string const& vfilename, std::atomic<float>* progress_)
+{
+    static_assert(sizeof(unsigned) == sizeof(std::uint32_t),
+        "compiled maps require 32 bit tile IDs");
+
+    VFile f(vfilename);
+    ParseProgress progress(f, progress_);
+    std::uint32_t header[compiledMapHeaderSize];
+    readCompiledMap(f, header, sizeof(header));
+    if (header[hMagic] != compiledMapMagic)
+        throw jd::ResourceLoadError("not a compiled map");
+    if (header[hByteOrderMark] != compiledMapByteOrderMark)
+        throw jd::ResourceLoadError(
+            "compiled map has wrong byte order (recompile it for this machine)");
+    if (header[hVersion] != compiledMapVersion)
+        throw jd::ResourceLoadError(str(format(
+            "compiled map version %1% not supported") % header[hVersion]));
+
+    TilemapData result;
+    result.size = jd::Vector3u(
+        header[hWidth], header[hHeight], header[hLayerCount]);
+    std::size_t const tileCount = result.size.x * result.size.y * result.size.z;
+    if (tileCount == 0)
+        throw jd::ResourceLoadError("map is empty");
+
+    // Read everything with few bulk reads; the tiles go straight into the
+    // storage handed over to the tilemap. They are read in chunks only to be
+    // able to report progress.
+    std::vector<char> metadata(header[hMetadataSize]);
+    if (!metadata.empty())
+        readCompiledMap(f, &metadata[0], metadata.size());
+    result.tiles.resize(tileCount);
+    std::size_t const chunkSize = progress_ ? 256 * 1024 : tileCount;
+    for (std::size_t i = 0; i < tileCount; i += chunkSize) {
+        readCompiledMap(f, &result.tiles[i],
+            std::min(chunkSize, tileCount - i) * sizeof(unsigned));
+        progress.update();
+    }
+
+    CompiledMapReader in(metadata);
+    MapInfo& info = result.info;
+
+    TilesetData& ts = result.tileset;
+    ts.tileSize.x = in.u32();
+    ts.tileSize.y = in.u32();
+    if (ts.tileSize.x == 0 || ts.tileSize.y == 0)
+        throw jd::ResourceLoadError("tileset has zero tile size");
+    ts.image = correctPath(in.string());
+    ts.transColor = in.string();
+
+    info.mapProperties = in.properties();
+
+    std::uint32_t const tilePropertiesCount = in.count();
+    ts.tileProperties.reserve(tilePropertiesCount);
+    for (std::uint32_t i = 0; i < tilePropertiesCount; ++i) {
+        std::uint32_t const tileId = in.u32();
+        ts.tileProperties.emplace_back(tileId, in.properties());
+    }
+
+    info.layerProperties.resize(result.size.z);
+    for (PropertyMap& props : info.layerProperties)
+        props = in.properties();
+
+    std::uint32_t const groupCount = in.count();
+    for (std::uint32_t i = 0; i < groupCount; ++i) {
+        std::string const& groupName = in.string();
+        MapObjectGroup& group = info.objectGroups[groupName];
+        group.name = groupName;
+        group.properties = in.properties();
+        group.objects.resize(in.count());
+        for (MapObject& o : group.objects) {
+            std::uint32_t const objectType = in.u32();
+            if (objectType > static_cast<std::uint32_t>(MapObject::T::poly))
+                throw jd::ResourceLoadError("compiled map: invalid object type");
+            o.objectType = static_cast<MapObject::T>(objectType);
+            o.name = in.string();
+            o.type = in.string();
+            o.position.x = in.f32();
+            o.position.y = in.f32();
+            o.size.x = in.f32();
+            o.size.y = in.f32();
+            o.tileId = in.u32();
+            o.properties = in.properties();
+            o.relativePoints.resize(in.count());
+            for (sf::Vector2f& p : o.relativePoints) {
+                p.x = in.f32();
+                p.y = in.f32();
             }
-            p.y = 0;
-            ++z;
         }
     }
+
     return result;
 }
+
+static TilemapData parseTilemap(
+    std::string const& vfilename, std::atomic<float>* progress)
+{
+    static char const compiledExt[] = ".jdmap";
+    if (boost::algorithm::ends_with(vfilename, compiledExt))
+        return parseCompiledTilemap(vfilename, progress);
+    return parseTmxTilemap(vfilename, progress);
+}
+
+MapInfo loadTilemap(jd::Tilemap& tm, std::string const& vfilename)
+{
+    TilemapData data = parseTilemap(vfilename, nullptr);
+    sf::Vector2u imgsz;
+    auto const texture = requestTexture(data.tileset, imgsz);
+    return finishTilemap(tm, data, texture, imgsz);
+}
+
+
+struct TilemapLoad::Data {
+    TilemapData map;
+    sf::Image image;
+    ResourceTraits<sf::Texture>::Ptr texture;
+    sf::Vector2u imageSize;
+};
+
+TilemapLoad::TilemapLoad(
+    JobQueue& jobs, std::string const& vfilename, Callback const& onDone
+):
+    m_jobs(jobs),
+    m_filename(vfilename),
+    m_onDone(onDone),
+    m_data(new Data),
+    m_progress(0),
+    m_state(State::loading)
+{ }
+
+TilemapLoad::~TilemapLoad()
+{ }
+
+MapInfo TilemapLoad::assignTo(jd::Tilemap& tm)
+{
+    if (m_state != State::loaded)
+        throw std::logic_error(
+            "TilemapLoad::assignTo: map not loaded or already assigned");
+    MapInfo result = finishTilemap(
+        tm, m_data->map, m_data->texture, m_data->imageSize);
+    m_data.reset();
+    m_state = State::assigned;
+    return result;
+}
+
+void TilemapLoad::parse()
+{
+    try {
+        m_data->map = parseTilemap(m_filename, &m_progress);
+        m_jobs.postToMain(boost::bind(&TilemapLoad::parsed, shared_from_this()));
+    } catch (std::exception const& e) {
+        postFailure(e.what());
+    }
+}
+
+void TilemapLoad::parsed()
+{
+    m_data->texture = resMng<sf::Texture>().tryGet(m_data->map.tileset.image);
+    if (m_data->texture) {
+        m_data->imageSize = m_data->texture->getSize();
+        finish();
+    } else {
+        m_jobs.post(boost::bind(&TilemapLoad::loadImage, shared_from_this()));
+    }
+}
+
+void TilemapLoad::loadImage()
+{
+    try {
+        TilesetData const& ts = m_data->map.tileset;
+        resMng<sf::Image>().loadUncached(m_data->image, ts.image);
+        if (!ts.transColor.empty())
+            m_data->image.createMaskFromColor(colorFromHexString(ts.transColor));
+        m_progress = imageLoadedProgress;
+        m_jobs.postToMain(
+            boost::bind(&TilemapLoad::imageLoaded, shared_from_this()));
+    } catch (std::exception const& e) {
+        postFailure(e.what());
+    }
+}
+
+void TilemapLoad::imageLoaded()
+{
+    std::string const& name = m_data->map.tileset.image;
+    m_data->imageSize = m_data->image.getSize();
+
+    // Another load may have created the texture in the meantime.
+    m_data->texture = resMng<sf::Texture>().tryGet(name);
+    if (!m_data->texture) {
+        auto texture = std::make_shared<sf::Texture>();
+        if (!texture->loadFromImage(m_data->image)) {
+            fail("failed creating texture \"" + name + "\" from image");
+            return;
+        }
+        resMng<sf::Texture>().insert(name, texture);
+        m_data->texture = std::move(texture);
+    }
+    m_data->image = sf::Image();
+    finish();
+}
+
+void TilemapLoad::postFailure(std::string const& msg)
+{
+    m_jobs.postToMain(boost::bind(&TilemapLoad::fail, shared_from_this(), msg));
+}
+
+void TilemapLoad::fail(std::string const& msg)
+{
+    LOG_E("Failed loading map \"" + m_filename + "\": " + msg);
+    m_data.reset();
+    m_error = msg;
+    m_state = State::failed;
+    callOnDone();
+}
+
+void TilemapLoad::finish()
+{
+    m_progress = 1;
+    m_state = State::loaded;
+    callOnDone();
+}
+
+void TilemapLoad::callOnDone()
+{
+    // Clear m_onDone before calling it, so that whatever it holds (e.g. a Lua
+    // function) is released here, on the main thread.
+    Callback onDone;
+    onDone.swap(m_onDone);
+    if (onDone)
+        onDone(*this);
+}
+
+std::shared_ptr<TilemapLoad> loadTilemapAsync(
+    JobQueue& jobs,
+    std::string const& vfilename,
+    TilemapLoad::Callback const& onDone)
+{
+    std::shared_ptr<TilemapLoad> load(
+        new TilemapLoad(jobs, vfilename, onDone));
+    jobs.post(boost::bind(&TilemapLoad::parse, load));
+    return load;
+}
+
@@ -7,8 +7,12 @@
 
 #include "Tilemap.hpp"
 
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
 #include <SFML/System/Vector2.hpp>
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -47,7 +51,74 @@ struct MapInfo {
     MapObjectGroup::Map objectGroups;
 };
 
+// Loads a TMX map or, if vfilename ends with ".jdmap", a compiled map (see
+// compileMap.py), which is much faster to load.
 MapInfo loadTilemap(jd::Tilemap& tm, std::string const& vfilename);
 std::vector<PropertyMap> loadTileset(jd::Tileset& ts, std::string const& vfilename);
 
+
+class JobQueue;
+
+// A loadTilemap() running in the background, started by loadTilemapAsync().
+// The map file is parsed and the tileset's image decoded by worker threads of
+// the JobQueue; only the texture is created on the main thread, when the
+// JobQueue processes its completions.
+class TilemapLoad:
+    public std::enable_shared_from_this<TilemapLoad>,
+    private boost::noncopyable
+{
+public:
+    // Called on the main thread when loading has finished or failed.
+    typedef boost::function<void(TilemapLoad&)> Callback;
+
+    ~TilemapLoad();
+
+    // Between 0 and 1. Unlike the other member functions, this may be called
+    // from any thread.
+    float progress() const { return m_progress; }
+
+    bool isDone() const { return m_state != State::loading; }
+    bool failed() const { return m_state == State::failed; }
+    std::string const& error() const { return m_error; }
+
+    // Hands the loaded map over to tm. Can be called only once, after
+    // loading has finished successfully.
+    MapInfo assignTo(jd::Tilemap& tm);
+
+private:
+    friend std::shared_ptr<TilemapLoad> loadTilemapAsync(
+        JobQueue&, std::string const&, Callback const&);
+
+    TilemapLoad(
+        JobQueue& jobs, std::string const& vfilename, Callback const& onDone);
+
+    // parse() and loadImage() run on worker threads, the others on the main
+    // thread.
+    void parse();
+    void parsed();
+    void loadImage();
+    void imageLoaded();
+    void postFailure(std::string const& msg);
+    void fail(std::string const& msg);
+    void finish();
+    void callOnDone();
+
+    enum class State { loading, loaded, failed, assigned };
+
+    struct Data;
+
+    JobQueue& m_jobs;
+    std::string const m_filename;
+    Callback m_onDone;
+    std::unique_ptr<Data> m_data;
+    std::atomic<float> m_progress;
+    State m_state;
+    std::string m_error;
+};
+
+std::shared_ptr<TilemapLoad> loadTilemapAsync(
+    JobQueue& jobs,
+    std::string const& vfilename,
+    TilemapLoad::Callback const& onDone = TilemapLoad::Callback());
+
 #endif
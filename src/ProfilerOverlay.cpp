@@ -0,0 +1,130 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "ProfilerOverlay.hpp"
+
+#include "ressys/VFileFont.hpp"
+#include "svc/FrameProfiler.hpp"
+
+#include <boost/format.hpp>
+#include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Text.hpp>
+#include <SFML/Graphics/Vertex.hpp>
+
+#include <algorithm>
+#include <vector>
+
+
+namespace {
+
+float const rowHeight = 14.f;
+float const indentWidth = 8.f;
+float const labelWidth = 240.f;
+float const numbersLeft = 130.f; // Average and p99 in milliseconds.
+float const barWidth = 200.f; // For the target frame time.
+float const padding = 4.f;
+
+void appendRect(
+    std::vector<sf::Vertex>& vertices,
+    float left, float top, float width, float height,
+    sf::Color color)
+{
+    vertices.push_back(sf::Vertex(sf::Vector2f(left, top), color));
+    vertices.push_back(sf::Vertex(sf::Vector2f(left, top + height), color));
+    vertices.push_back(sf::Vertex(
+        sf::Vector2f(left + width, top + height), color));
+    vertices.push_back(sf::Vertex(sf::Vector2f(left + width, top), color));
+}
+
+sf::Color barColor(unsigned depth)
+{
+    switch (depth) {
+        case 0: return sf::Color(230, 230, 230);
+        case 1: return sf::Color(90, 170, 250);
+        default: return sf::Color(120, 210, 120);
+    }
+}
+
+} // anonymous namespace
+
+
+ProfilerOverlay::ProfilerOverlay(FrameProfiler const& profiler):
+    m_profiler(profiler),
+    m_targetFrameTime(sf::microseconds(1000000 / 60)),
+    m_visible(true)
+{ }
+
+void ProfilerOverlay::draw(
+    sf::RenderTarget& target, sf::RenderStates states) const
+{
+    if (!m_visible || !m_profiler.enabled() ||
+        m_targetFrameTime <= sf::Time::Zero
+    ) {
+        return;
+    }
+    states.transform *= getTransform();
+
+    struct Row {
+        FrameProfiler::TimerId timer;
+        ProfileStats stats;
+    };
+    std::vector<Row> rows;
+    for (FrameProfiler::TimerId timer : m_profiler.timers()) {
+        Row const row = { timer, m_profiler.stats(timer) };
+
+        // Slots which are never called would only clutter the display.
+        if (m_profiler.timerDepth(timer) < 2 || row.stats.max > sf::Time::Zero)
+            rows.push_back(row);
+    }
+
+    float const barLeft = padding + (m_font ? labelWidth : 0.f);
+    float const maxBarWidth = barWidth * 2;
+    float const width = barLeft + maxBarWidth + padding;
+    float const height = rows.size() * rowHeight + 2 * padding;
+
+    std::vector<sf::Vertex> vertices;
+    vertices.reserve((rows.size() * 2 + 2) * 4);
+    appendRect(vertices, 0, 0, width, height, sf::Color(0, 0, 0, 160));
+
+    float const scale = barWidth / m_targetFrameTime.asSeconds();
+    float top = padding;
+    for (Row const& row : rows) {
+        float const avg = std::min(
+            row.stats.average.asSeconds() * scale, maxBarWidth);
+        float const p99 = std::min(
+            row.stats.p99.asSeconds() * scale, maxBarWidth);
+        appendRect(
+            vertices, barLeft, top + 2, avg, rowHeight - 4,
+            barColor(m_profiler.timerDepth(row.timer)));
+        appendRect(
+            vertices, barLeft + p99 - 1, top + 1, 2, rowHeight - 2,
+            sf::Color::Yellow);
+        top += rowHeight;
+    }
+    appendRect(
+        vertices, barLeft + barWidth, padding, 1, height - 2 * padding,
+        sf::Color::Red);
+
+    target.draw(&vertices[0], vertices.size(), sf::Quads, states);
+
+    if (!m_font)
+        return;
+    sf::Text text;
+    text.setFont(*m_font);
+    text.setCharacterSize(static_cast<unsigned>(rowHeight) - 3);
+    top = padding;
+    for (Row const& row : rows) {
+        text.setString(m_profiler.timerName(row.timer));
+        text.setPosition(
+            padding + m_profiler.timerDepth(row.timer) * indentWidth, top);
+        target.draw(text, states);
+
+        text.setString(str(boost::format("%1$6.2f %2$6.2f ms")
+            % (row.stats.average.asMicroseconds() / 1000.)
+            % (row.stats.p99.asMicroseconds() / 1000.)));
+        text.setPosition(padding + numbersLeft, top);
+        target.draw(text, states);
+        top += rowHeight;
+    }
+}
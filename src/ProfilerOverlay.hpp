@@ -0,0 +1,45 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef PROFILER_OVERLAY_HPP_INCLUDED
+#define PROFILER_OVERLAY_HPP_INCLUDED PROFILER_OVERLAY_HPP_INCLUDED
+
+#include <SFML/Graphics/Drawable.hpp>
+#include <SFML/Graphics/Transformable.hpp>
+#include <SFML/System/Time.hpp>
+
+#include <memory>
+
+
+class FrameProfiler;
+struct VFileFont;
+
+// Shows the statistics of a FrameProfiler as one bar per timer: the bar's
+// length is the average time, a marker shows the 99th percentile and a
+// line the target frame time. Without a font, the timer names and numbers
+// are left out. Nothing is drawn while the profiler is disabled.
+class ProfilerOverlay: public sf::Drawable, public sf::Transformable {
+public:
+    explicit ProfilerOverlay(FrameProfiler const& profiler);
+
+    bool visible() const { return m_visible; }
+    void setVisible(bool visible) { m_visible = visible; }
+
+    std::shared_ptr<VFileFont> const& font() const { return m_font; }
+    void setFont(std::shared_ptr<VFileFont> const& font) { m_font = font; }
+
+    sf::Time targetFrameTime() const { return m_targetFrameTime; }
+    void setTargetFrameTime(sf::Time t) { m_targetFrameTime = t; }
+
+private:
+    virtual void draw(
+        sf::RenderTarget& target, sf::RenderStates states) const;
+
+    FrameProfiler const& m_profiler;
+    std::shared_ptr<VFileFont> m_font;
+    sf::Time m_targetFrameTime;
+    bool m_visible;
+};
+
+#endif
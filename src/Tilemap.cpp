@@ -4,14 +4,17 @@
 
 #include "Tilemap.hpp"
 
+#include "profiling.hpp"
 #include "sfUtil.hpp"
 
 #include <SFML/Graphics/RenderStates.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <iomanip>
 #include <iostream>
+#include <stdexcept>
 
 
 namespace jd {
@@ -54,14 +57,16 @@ sf::Vector2u Tileset::position(unsigned index) const
 
 //////////////////////////////////////////////////////////////////////////////////////////
 
-void Tilemap::Animation::animate(sf::Time elapsedTime)
+bool Tilemap::Animation::animate(sf::Time elapsedTime)
 {
+    std::size_t const oldFrame = currentFrame();
     m_currentFrame += elapsedTime.asSeconds() * m_speed;
     if (m_currentFrame > m_lastTid) {
         m_currentFrame = static_cast<float>(
             m_firstTid + std::fmod(
                 m_currentFrame - m_firstTid, m_lastTid - m_firstTid));
     }
+    return currentFrame() != oldFrame;
 }
 
 std::size_t Tilemap::Animation::currentFrame() const
@@ -70,11 +75,43 @@ std::size_t Tilemap::Animation::currentFrame() const
     return static_cast<std::size_t>(m_currentFrame);
 }
 
+Tilemap::Animation::Animation(Animation const& rhs):
+    m_firstTid(rhs.m_firstTid), m_lastTid(rhs.m_lastTid),
+    m_speed(rhs.m_speed), m_currentFrame(rhs.m_currentFrame)
+{ }
+
+Tilemap::Animation& Tilemap::Animation::operator= (Animation const& rhs)
+{
+    m_firstTid = rhs.m_firstTid;
+    m_lastTid = rhs.m_lastTid;
+    m_speed = rhs.m_speed;
+    m_currentFrame = rhs.m_currentFrame;
+    m_slots.clear();
+    return *this;
+}
+
+void Tilemap::Animation::removeSlots(std::size_t chunk) const
+{
+    m_slots.erase(std::remove_if(
+        m_slots.begin(), m_slots.end(),
+        [chunk] (VertexSlot const& slot) {
+            return slot.chunk == chunk;
+        }), m_slots.end());
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 
+Tilemap::Tilemap():
+    m_columnCount(0),
+    m_rowCount(0),
+    m_chunkColumnCount(0)
+{
+}
+
 void Tilemap::setTileset(Tileset const& ts)
 {
     m_tileset = ts;
+    invalidateChunks();
 }
 
 Tileset const& Tilemap::tileset() const
@@ -86,8 +123,25 @@ Tileset const& Tilemap::tileset() const
 void Tilemap::setSize(Vector3u const& size)
 {
     m_map.resize(size.x * size.y * size.z);
+    setDimensions(size);
+}
+
+void Tilemap::assign(Vector3u const& size, std::vector<unsigned>&& tiles)
+{
+    if (tiles.size() != size.x * size.y * size.z)
+        throw std::invalid_argument("tile count does not match map size");
+    m_map = std::move(tiles);
+    setDimensions(size);
+}
+
+void Tilemap::setDimensions(Vector3u const& size)
+{
     m_columnCount = size.x;
     m_rowCount = size.y;
+
+    m_chunkColumnCount = (size.x + chunkSize - 1) / chunkSize;
+    m_chunks.resize(m_chunkColumnCount * ((size.y + chunkSize - 1) / chunkSize));
+    invalidateChunks();
 }
 
 Vector3u Tilemap::size() const
@@ -122,7 +176,11 @@ unsigned Tilemap::operator[] (Vector3u pos) const
 
 void Tilemap::set(Vector3u pos, unsigned tileId)
 {
-    m_map[index(pos)] = tileId;
+    unsigned& tile = m_map[index(pos)];
+    if (tile == tileId)
+        return;
+    tile = tileId;
+    m_chunks[chunkIndex(pos)].dirty = true;
 }
 
 std::size_t Tilemap::index(Vector3u pos) const
@@ -133,6 +191,32 @@ std::size_t Tilemap::index(Vector3u pos) const
       + pos.x;
 }
 
+std::size_t Tilemap::chunkIndex(Vector3u pos) const
+{
+    return pos.y / chunkSize * m_chunkColumnCount + pos.x / chunkSize;
+}
+
+void Tilemap::invalidateChunk(std::size_t chunk) const
+{
+    Chunk& c = m_chunks[chunk];
+    for (Animation const* a : c.animations)
+        a->removeSlots(chunk);
+    c.animations.clear();
+    c.dirty = true;
+}
+
+void Tilemap::invalidateChunks()
+{
+    for (Chunk& chunk : m_chunks) {
+        chunk.animations.clear();
+        chunk.dirty = true;
+    }
+    for (auto& a: m_tidAnimations)
+        a.second.clearSlots();
+    for (auto& a: m_posAnimations)
+        a.second.clearSlots();
+}
+
 sf::Vector2f Tilemap::localTilePos(sf::Vector2i pos) const
 {
     return sf::Vector2f(
@@ -180,110 +264,159 @@ void Tilemap::addAnimation(std::size_t tid, std::size_t lastTid, float speed)
 {
     checkSpeed(speed);
     m_tidAnimations[tid] = Animation(tid, lastTid, speed);
+    invalidateChunks(); // Any chunk could contain the tile ID.
 }
 
 void Tilemap::addAnimation(Vector3u pos, std::size_t lastTid, float speed)
 {
     checkSpeed(speed);
     m_posAnimations[pos] = Animation((*this)[pos], lastTid, speed);
+    invalidateChunk(chunkIndex(pos));
 }
 
 void Tilemap::removeAnimation(std::size_t tid)
 {
+    // Chunks must not keep pointers to the removed animation.
+    invalidateChunks();
     m_tidAnimations.erase(tid);
 }
 
 void Tilemap::removeAnimation(Vector3u pos)
 {
+    if (m_posAnimations.count(pos))
+        invalidateChunk(chunkIndex(pos));
     m_posAnimations.erase(pos);
 }
 
 
 void Tilemap::animate(sf::Time elapsedTime)
 {
-    for (auto& a: m_tidAnimations)
-        a.second.animate(elapsedTime);
-    for (auto& a: m_posAnimations)
-        a.second.animate(elapsedTime);
-
+    for (auto& a: m_tidAnimations) {
+        if (a.second.animate(elapsedTime))
+            updateAnimatedVertices(a.second);
+    }
+    for (auto& a: m_posAnimations) {
+        if (a.second.animate(elapsedTime))
+            updateAnimatedVertices(a.second);
+    }
 }
 
 
-void Tilemap::draw(sf::RenderTarget& target, sf::RenderStates states) const
+static void setQuadTexCoords(
+    sf::Vertex* quad, sf::Vector2f texPos, sf::Vector2f tileSize)
 {
-    sf::FloatRect const viewRect(jd::viewRect(target.getView()));
+    quad[0].texCoords = texPos;
+    quad[1].texCoords = sf::Vector2f(texPos.x, texPos.y + tileSize.y);
+    quad[2].texCoords = texPos + tileSize;
+    quad[3].texCoords = sf::Vector2f(texPos.x + tileSize.x, texPos.y);
+}
 
-    Vector3u size = this->size();
-    sf::Vector2i firstTPosI(tilePosFromGlobal(topLeft(viewRect)));
-    firstTPosI.x = std::max(firstTPosI.x, 0);
-    firstTPosI.y = std::max(firstTPosI.y, 0);
-    sf::Vector2i lastTPosI(tilePosFromGlobal(bottomRight(viewRect)));
-    lastTPosI.x = std::min(lastTPosI.x + 1, static_cast<int>(size.x));
-    lastTPosI.y = std::min(lastTPosI.y + 1, static_cast<int>(size.y));
-    sf::Vector2i distanceI = lastTPosI - firstTPosI;
-    if (distanceI.x <= 0 || distanceI.y <= 0)
-        return;
-    
-    auto distance = vec_cast<unsigned>(distanceI);
-    
-    auto firstTPos = vec_cast<unsigned>(firstTPosI);
-    auto lastTPos = vec_cast<unsigned>(lastTPosI);
-    
-    std::size_t const renderedTileCount = distance.x * distance.y * size.z;
-    static std::size_t const verticesPerTile = 4;
-    std::vector<sf::Vertex> vertices(renderedTileCount * verticesPerTile);
-
-    sf::Vector2f const firstPos(localTilePos(firstTPosI));
-    std::size_t iVertices = 0;
+void Tilemap::updateChunk(std::size_t chunkX, std::size_t chunkY) const
+{
+    std::size_t const iChunk = chunkY * m_chunkColumnCount + chunkX;
+    invalidateChunk(iChunk); // Unregister the old animated slots.
+    Chunk& chunk = m_chunks[iChunk];
+
+    // clear() keeps the capacity: rebuilding a chunk normally does not
+    // allocate.
+    chunk.vertices.clear();
+
+    Vector3u const size = this->size();
+    unsigned const beginX = static_cast<unsigned>(chunkX * chunkSize);
+    unsigned const beginY = static_cast<unsigned>(chunkY * chunkSize);
+    unsigned const endX = std::min(beginX + chunkSize, size.x);
+    unsigned const endY = std::min(beginY + chunkSize, size.y);
     auto const tileSize = vec_cast<float>(m_tileset.size());
-    std::size_t const mapSkipY = size.x - distance.x;
-    std::size_t const mapSkipZ =
-        size.x * size.y - distance.x * distance.y - mapSkipY * distance.y;
-
-    std::size_t iMap = index(Vector3u(
-        static_cast<unsigned>(firstTPos.x),
-        static_cast<unsigned>(firstTPos.y),
-        0));
-    sf::Vector2f iPos(firstPos);
-    for (unsigned z = 0; z < size.z; ++z) {
-        for (unsigned y = firstTPos.y; y < static_cast<std::size_t>(lastTPos.y); ++y){
-            for (unsigned x = firstTPos.x; x < static_cast<std::size_t>(lastTPos.x); ++x) {
-                assert(index(Vector3u(x, y, z)) == iMap);
+
+    Vector3u pos;
+    for (pos.z = 0; pos.z < size.z; ++pos.z) {
+        for (pos.y = beginY; pos.y < endY; ++pos.y) {
+            std::size_t iMap = index(Vector3u(beginX, pos.y, pos.z));
+            for (pos.x = beginX; pos.x < endX; ++pos.x) {
                 unsigned const tileId = m_map[iMap++];
-                if (tileId == 0) {
-                    vertices.pop_back();
-                    iPos.x += tileSize.x;
+                if (tileId == 0)
                     continue;
+
+                sf::Vector2f const tilePos(localTilePos(sf::Vector2i(
+                    static_cast<int>(pos.x), static_cast<int>(pos.y))));
+                std::size_t const iVertices = chunk.vertices.size();
+                std::size_t frame = tileId;
+                if (Animation const* a = animation(tileId, pos)) {
+                    frame = a->currentFrame();
+                    a->addSlot(VertexSlot(iChunk, iVertices));
+                    if (std::find(
+                            chunk.animations.begin(), chunk.animations.end(), a
+                        ) == chunk.animations.end()
+                    ) {
+                        chunk.animations.push_back(a);
+                    }
                 }
-                sf::Vector2f texPos(m_tileset.position(
-                    static_cast<unsigned>(maybeAnimated(
-                            tileId, Vector3u(x, y, z)) - 1)));
-                vertices[iVertices].texCoords  = texPos;
-                vertices[iVertices++].position = iPos;
-                vertices[iVertices].texCoords  = sf::Vector2f(texPos.x, texPos.y + tileSize.y);
-                vertices[iVertices++].position = sf::Vector2f(iPos.x,   iPos.y   + tileSize.y);
-                vertices[iVertices].texCoords  = texPos + tileSize;
-                vertices[iVertices++].position = iPos   + tileSize;
-                vertices[iVertices].texCoords  = sf::Vector2f(texPos.x +  tileSize.x, texPos.y);
-                vertices[iVertices++].position = sf::Vector2f(iPos.x   += tileSize.x,   iPos.y);
+                sf::Vector2f const texPos(m_tileset.position(
+                    static_cast<unsigned>(frame - 1)));
+
+                chunk.vertices.resize(iVertices + 4);
+                sf::Vertex* const quad = &chunk.vertices[iVertices];
+                quad[0].position = tilePos;
+                quad[1].position = sf::Vector2f(tilePos.x, tilePos.y + tileSize.y);
+                quad[2].position = tilePos + tileSize;
+                quad[3].position = sf::Vector2f(tilePos.x + tileSize.x, tilePos.y);
+                setQuadTexCoords(quad, texPos, tileSize);
             } // for x
-            iPos.x  = firstPos.x;
-            iPos.y += tileSize.y;
-            iMap   += mapSkipY;
         } // for y
-        iPos.y = firstPos.y;
-        iMap  += mapSkipZ;
     } // for z
 
-    if (vertices.empty())
+    chunk.dirty = false;
+} // Tilemap::updateChunk()
+
+void Tilemap::updateAnimatedVertices(Animation const& a)
+{
+    if (a.slots().empty())
+        return;
+    auto const tileSize = vec_cast<float>(m_tileset.size());
+    sf::Vector2f const texPos(m_tileset.position(
+        static_cast<unsigned>(a.currentFrame() - 1)));
+    for (VertexSlot const& slot : a.slots())
+        setQuadTexCoords(&m_chunks[slot.chunk].vertices[slot.vertex], texPos, tileSize);
+}
+
+
+void Tilemap::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    JD_PROFILE_ZONE("Tilemap::draw");
+    if (m_map.empty())
         return;
+
+    sf::FloatRect const viewRect(jd::viewRect(target.getView()));
+
+    Vector3u const size = this->size();
+    sf::Vector2i firstTPos(tilePosFromGlobal(topLeft(viewRect)));
+    firstTPos.x = std::max(firstTPos.x, 0);
+    firstTPos.y = std::max(firstTPos.y, 0);
+    sf::Vector2i lastTPos(tilePosFromGlobal(bottomRight(viewRect)));
+    lastTPos.x = std::min(lastTPos.x, static_cast<int>(size.x) - 1);
+    lastTPos.y = std::min(lastTPos.y, static_cast<int>(size.y) - 1);
+    if (lastTPos.x < firstTPos.x || lastTPos.y < firstTPos.y)
+        return;
+
+    auto const firstChunk = vec_cast<std::size_t>(firstTPos) / std::size_t(chunkSize);
+    auto const lastChunk = vec_cast<std::size_t>(lastTPos) / std::size_t(chunkSize);
+
     states.transform *= getTransform();
     states.texture = m_tileset.texture().get();
-    target.draw(
-        &vertices[0],
-        static_cast<unsigned>(vertices.size()),
+    for (std::size_t y = firstChunk.y; y <= lastChunk.y; ++y) {
+        for (std::size_t x = firstChunk.x; x <= lastChunk.x; ++x) {
+            Chunk const& chunk = m_chunks[y * m_chunkColumnCount + x];
+            if (chunk.dirty)
+                updateChunk(x, y);
+            if (chunk.vertices.empty())
+                continue;
+            target.draw(
+                &chunk.vertices[0],
+                static_cast<unsigned>(chunk.vertices.size()),
                 sf::Quads,
                 states);
+        } // for x
+    } // for y
 } // Tilemap::draw()
 
 bool Tilemap::isValidPosition(sf::Vector3i pos) const
@@ -294,17 +427,17 @@ bool Tilemap::isValidPosition(sf::Vector3i pos) const
         pos.x < sz.x && pos.y < sz.y && pos.z < sz.z;
 }
 
-std::size_t Tilemap::maybeAnimated(std::size_t tid, Vector3u pos) const
+Tilemap::Animation const* Tilemap::animation(std::size_t tid, Vector3u pos) const
 {
     auto iPos = m_posAnimations.find(pos);
     if (iPos != m_posAnimations.end())
-        return iPos->second.currentFrame();
+        return &iPos->second;
 
     auto iTid = m_tidAnimations.find(tid);
     if (iTid != m_tidAnimations.end())
-        return iTid->second.currentFrame();
+        return &iTid->second;
 
-    return tid;
+    return nullptr;
 }
 
 } // namespace jd
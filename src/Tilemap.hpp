@@ -12,6 +12,7 @@
 #include <SFML/Graphics/Rect.hpp>
 #include <SFML/Graphics/Texture.hpp>
 #include <SFML/Graphics/Transformable.hpp>
+#include <SFML/Graphics/Vertex.hpp>
 #include <SFML/System/Time.hpp>
 #include <SFML/System/Vector2.hpp>
 #include <SFML/System/Vector3.hpp>
@@ -49,12 +50,18 @@ private:
 class Tilemap: public sf::Drawable, public sf::Transformable
 {
 public:
+    Tilemap();
+
     void setTileset(Tileset const& ts);
     Tileset const& tileset() const;
 
     void setSize(Vector3u const& size);
     Vector3u size() const;
 
+    // Replaces the size and all tiles at once. tiles must contain
+    // size.x * size.y * size.z tile IDs, layer by layer and row by row.
+    void assign(Vector3u const& size, std::vector<unsigned>&& tiles);
+
     // get prefix for consistence with other drawables
     sf::FloatRect getLocalBounds() const;
     sf::FloatRect getGlobalBounds() const;
@@ -86,6 +93,15 @@ protected:
     ) const;
 
 private:
+    // Location of a tile's quad in the vertex cache (see Chunk below).
+    struct VertexSlot {
+        VertexSlot(std::size_t chunk, std::size_t vertex):
+            chunk(chunk), vertex(vertex) { }
+
+        std::size_t chunk;
+        std::size_t vertex; // index of the quad's first vertex
+    };
+
     class Animation {
     public:
         explicit Animation(
@@ -95,19 +111,68 @@ private:
             m_speed(speed), m_currentFrame(static_cast<float>(firstTid))
         { }
 
-        void animate(sf::Time elapsedTime);
+        // The vertex slots belong to the vertex cache of the Tilemap and are
+        // therefore not copied.
+        Animation(Animation const& rhs);
+        Animation& operator= (Animation const& rhs);
+
+        // Returns true if currentFrame() changed.
+        bool animate(sf::Time elapsedTime);
         std::size_t currentFrame() const;
 
+        // The slots whose texture coordinates show this animation.
+        std::vector<VertexSlot> const& slots() const { return m_slots; }
+        void addSlot(VertexSlot slot) const { m_slots.push_back(slot); }
+        void removeSlots(std::size_t chunk) const;
+        void clearSlots() const { m_slots.clear(); }
+
     private:
         std::size_t m_firstTid;
         std::size_t m_lastTid;
         float m_speed; // in frames per second
         float m_currentFrame;
+        mutable std::vector<VertexSlot> m_slots;
     };
-    std::size_t maybeAnimated(std::size_t tid, Vector3u pos) const;
+
+    // Returns the animation which applies to the tile at pos, or nullptr.
+    Animation const* animation(std::size_t tid, Vector3u pos) const;
 
     std::size_t index(Vector3u pos) const;
 
+    // Sets up everything depending on the size, except m_map.
+    void setDimensions(Vector3u const& size);
+
+    // The map is split into chunks of chunkSize x chunkSize tiles (including
+    // all layers), whose vertices are cached between frames and only rebuilt
+    // if a tile inside the chunk changes. Because a tile never exceeds its
+    // cell, drawing chunk after chunk gives the same result as drawing layer
+    // after layer.
+    // Animated tiles register their quads at the corresponding Animation
+    // when the chunk is built, so that animate() only has to rewrite the
+    // texture coordinates of these quads when the frame changes.
+    struct Chunk {
+        Chunk(): dirty(true) { }
+        Chunk(Chunk const&): dirty(true) { } // Copies start out empty.
+        Chunk& operator= (Chunk const&)
+        {
+            vertices.clear();
+            animations.clear();
+            dirty = true;
+            return *this;
+        }
+
+        std::vector<sf::Vertex> vertices;
+        std::vector<Animation const*> animations; // with slots in this chunk
+        bool dirty;
+    };
+    static unsigned const chunkSize = 32;
+
+    std::size_t chunkIndex(Vector3u pos) const;
+    void invalidateChunk(std::size_t chunk) const;
+    void invalidateChunks();
+    void updateChunk(std::size_t chunkX, std::size_t chunkY) const;
+    void updateAnimatedVertices(Animation const& a);
+
     std::unordered_map<std::size_t, Animation> m_tidAnimations;
     std::unordered_map<Vector3u, Animation> m_posAnimations;
 
@@ -116,6 +181,9 @@ private:
     std::size_t m_columnCount;
     std::size_t m_rowCount;
     std::vector<unsigned> m_map;
+
+    std::size_t m_chunkColumnCount;
+    mutable std::vector<Chunk> m_chunks;
 };
 
 } // namespace jd
@@ -5,29 +5,187 @@
 #include "TransformGroup.hpp"
 
 #include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Shape.hpp>
+#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Graphics/Text.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <utility>
 
-TransformGroup::TransformGroup()
+
+namespace {
+
+// Appends the sprite's quad, transformed to the coordinates of target.
+// The texture coordinates are in pixels, as sf::Sprite's own.
+void appendSpriteQuad(
+    std::vector<sf::Vertex>& vertices,
+    sf::Sprite const& sprite,
+    sf::Transform const& parentTransform)
+{
+    sf::Transform const transform = parentTransform * sprite.getTransform();
+    sf::IntRect const rect = sprite.getTextureRect();
+    float const width = static_cast<float>(std::abs(rect.width));
+    float const height = static_cast<float>(std::abs(rect.height));
+    float const left = static_cast<float>(rect.left);
+    float const top = static_cast<float>(rect.top);
+    float const right = left + rect.width;
+    float const bottom = top + rect.height;
+    sf::Color const color = sprite.getColor();
+
+    vertices.push_back(sf::Vertex(
+        transform.transformPoint(0, 0), color, sf::Vector2f(left, top)));
+    vertices.push_back(sf::Vertex(
+        transform.transformPoint(0, height), color, sf::Vector2f(left, bottom)));
+    vertices.push_back(sf::Vertex(
+        transform.transformPoint(width, height), color, sf::Vector2f(right, bottom)));
+    vertices.push_back(sf::Vertex(
+        transform.transformPoint(width, 0), color, sf::Vector2f(right, top)));
+}
+
+TransformGroup::Item::Kind kindOf(sf::Drawable const& drawable)
+{
+    typedef TransformGroup::Item::Kind Kind;
+    if (dynamic_cast<sf::Sprite const*>(&drawable))
+        return Kind::sprite;
+    if (dynamic_cast<sf::Shape const*>(&drawable))
+        return Kind::shape;
+    if (dynamic_cast<sf::Text const*>(&drawable))
+        return Kind::text;
+    return Kind::other;
+}
+
+// Returns true for items whose bounds are not known.
+bool intersects(TransformGroup::Item const& item, sf::FloatRect const& rect)
+{
+    typedef TransformGroup::Item::Kind Kind;
+    switch (item.kind) {
+        case Kind::sprite:
+            return static_cast<sf::Sprite const*>(
+                item.drawable)->getGlobalBounds().intersects(rect);
+        case Kind::shape:
+            return static_cast<sf::Shape const*>(
+                item.drawable)->getGlobalBounds().intersects(rect);
+        case Kind::text:
+            return static_cast<sf::Text const*>(
+                item.drawable)->getGlobalBounds().intersects(rect);
+        default:
+            return true;
+    }
+}
+
+bool textureLess(sf::Sprite const* lhs, sf::Sprite const* rhs)
+{
+    return std::less<sf::Texture const*>()(lhs->getTexture(), rhs->getTexture());
+}
+
+} // anonymous namespace
+
+
+TransformGroup::TransformGroup():
+    m_holeCount(0),
+    m_batching(true),
+    m_sortByTexture(false),
+    m_culling(false),
+    m_drawCalls(0),
+    m_culledCount(0)
 {
 }
 
-TransformGroup::TransformGroup(TransformGroup&& rhs)
+TransformGroup::TransformGroup(TransformGroup&& rhs):
+    m_holeCount(0),
+    m_batching(rhs.m_batching),
+    m_sortByTexture(rhs.m_sortByTexture),
+    m_culling(rhs.m_culling),
+    m_drawCalls(0),
+    m_culledCount(0)
 {
     m_items.swap(rhs.m_items);
+    m_itemSlots.swap(rhs.m_itemSlots);
+    m_slots.swap(rhs.m_slots);
+    m_freeSlots.swap(rhs.m_freeSlots);
+    std::swap(m_holeCount, rhs.m_holeCount);
 }
 
 TransformGroup& TransformGroup::operator= (TransformGroup&& rhs)
 {
     m_items = std::move(rhs.m_items);
+    m_itemSlots = std::move(rhs.m_itemSlots);
+    m_slots = std::move(rhs.m_slots);
+    m_freeSlots = std::move(rhs.m_freeSlots);
+    m_holeCount = rhs.m_holeCount;
+    m_batching = rhs.m_batching;
+    m_sortByTexture = rhs.m_sortByTexture;
+    m_culling = rhs.m_culling;
     return *this;
 }
 
-TransformGroup::Item* TransformGroup::add(
+TransformGroup::ItemId TransformGroup::add(
     sf::Drawable* drawable,
     bool visible)
 {
+    if (m_holeCount > m_items.size() / 2)
+        compact();
+
+    ItemId id;
+    if (m_freeSlots.empty()) {
+        id.slot = m_slots.size();
+        Slot const slot = { 0, 0 };
+        m_slots.push_back(slot);
+    } else {
+        id.slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    Slot& slot = m_slots[id.slot];
+    slot.index = m_items.size();
+    id.generation = slot.generation;
+
     m_items.push_back(Item(drawable, visible));
-    return &m_items.back();
+    m_itemSlots.push_back(id.slot);
+    return id;
+}
+
+TransformGroup::Item* TransformGroup::item(ItemId id)
+{
+    if (id.slot >= m_slots.size())
+        return nullptr;
+    Slot const& slot = m_slots[id.slot];
+    return slot.generation == id.generation ? &m_items[slot.index] : nullptr;
+}
+
+TransformGroup::Item const* TransformGroup::item(ItemId id) const
+{
+    return const_cast<TransformGroup*>(this)->item(id);
+}
+
+void TransformGroup::remove(ItemId id)
+{
+    Item* const removed = item(id);
+    if (!removed)
+        return;
+    removed->drawable = nullptr;
+    ++m_holeCount;
+    ++m_slots[id.slot].generation;
+    m_freeSlots.push_back(id.slot);
+}
+
+void TransformGroup::compact()
+{
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < m_items.size(); ++i) {
+        if (!m_items[i].drawable)
+            continue;
+        if (i != kept) {
+            m_items[kept] = std::move(m_items[i]);
+            m_itemSlots[kept] = m_itemSlots[i];
+            m_slots[m_itemSlots[kept]].index = kept;
+        }
+        ++kept;
+    }
+    m_items.erase(m_items.begin() + kept, m_items.end());
+    m_itemSlots.erase(m_itemSlots.begin() + kept, m_itemSlots.end());
+    m_holeCount = 0;
 }
 
 void TransformGroup::draw(
@@ -40,27 +198,80 @@ const
 
 void TransformGroup::doDraw(sf::RenderTarget& target, sf::RenderStates states)
 {
+    if (m_holeCount > 0)
+        compact();
+
     states.transform *= getTransform();
-    for (auto it = m_items.begin(); it != m_items.end(); ) {
-        if (it->drawable) {
-            if (it->visible)
-                target.draw(*it->drawable);
-            ++it;
+    m_drawCalls = 0;
+    m_culledCount = 0;
+
+    // The view's bounding rectangle, in the coordinates of the items.
+    sf::FloatRect cullRect;
+    if (m_culling) {
+        sf::FloatRect const clipSpace(-1, -1, 2, 2);
+        cullRect = states.transform.getInverse().transformRect(
+            target.getView().getInverseTransform().transformRect(clipSpace));
+    }
+
+    for (std::size_t i = 0; i < m_items.size(); ++i) {
+        Item& item = m_items[i];
+        if (!item.visible || !item.drawable)
+            continue;
+        if (item.kind == Item::Kind::unknown)
+            item.kind = kindOf(*item.drawable);
+        if (m_culling && !intersects(item, cullRect)) {
+            ++m_culledCount;
+            continue;
+        }
+        if (m_batching && item.kind == Item::Kind::sprite) {
+            auto const sprite = static_cast<sf::Sprite const*>(item.drawable);
+
+            // Like sf::Sprite, draw nothing without a texture (e.g. while it
+            // is still being loaded asynchronously).
+            if (sprite->getTexture())
+                m_spriteRun.push_back(sprite);
         } else {
-            it = m_items.erase(it);
+            flushSprites(target, states);
+            target.draw(*item.drawable, states);
+            ++m_drawCalls;
         }
     }
+    flushSprites(target, states);
+}
+
+void TransformGroup::flushSprites(
+    sf::RenderTarget& target, sf::RenderStates states)
+{
+    if (m_spriteRun.empty())
+        return;
+    if (m_sortByTexture)
+        std::stable_sort(m_spriteRun.begin(), m_spriteRun.end(), &textureLess);
+
+    // The vertices are already transformed.
+    sf::Transform const transform = states.transform;
+    states.transform = sf::Transform::Identity;
+
+    for (auto begin = m_spriteRun.begin(); begin != m_spriteRun.end(); ) {
+        states.texture = (*begin)->getTexture();
+        m_vertices.clear();
+        auto end = begin;
+        for (; end != m_spriteRun.end() && (*end)->getTexture() == states.texture; ++end)
+            appendSpriteQuad(m_vertices, **end, transform);
+        target.draw(&m_vertices[0], m_vertices.size(), sf::Quads, states);
+        ++m_drawCalls;
+        begin = end;
+    }
+    m_spriteRun.clear();
 }
 
 
 TransformGroup::AutoEntry::AutoEntry(
     TransformGroup& g, sf::Drawable* d, bool visible):
     m_group(g.ref()),
-    m_entry(g.add(d, visible))
+    m_id(g.add(d, visible))
 { }
 
-TransformGroup::AutoEntry::AutoEntry():
-    m_entry(nullptr)
+TransformGroup::AutoEntry::AutoEntry()
 { }
 
 TransformGroup::AutoEntry::~AutoEntry()
@@ -68,15 +279,22 @@ TransformGroup::AutoEntry::~AutoEntry()
     release();
 }
 
+TransformGroup::Item* TransformGroup::AutoEntry::entry() const
+{
+    return m_group.valid() ? m_group->item(m_id) : nullptr;
+}
+
 void TransformGroup::AutoEntry::setDrawable(sf::Drawable* d)
 {
     if (d) {
         if (!m_group.valid())
             throw jd::Exception("attempt to set drawable of NULL-AutoEntry");
-        if (m_entry)
-            m_entry->drawable = d;
-        else
-            m_entry = m_group->add(d);
+        if (Item* const e = entry()) {
+            e->drawable = d;
+            e->kind = Item::Kind::unknown;
+        } else {
+            m_id = m_group->add(d);
+        }
     } else {
         release();
     }
@@ -84,15 +302,15 @@ void TransformGroup::AutoEntry::setDrawable(sf::Drawable* d)
 
 sf::Drawable* TransformGroup::AutoEntry::drawable()
 {
-    return m_entry && m_group.valid() ? m_entry->drawable : nullptr;
+    Item const* const e = entry();
+    return e ? e->drawable : nullptr;
 }
 
 void TransformGroup::AutoEntry::release()
 {
-    if (m_entry && m_group.valid()) {
-        m_entry->drawable = nullptr;
-        m_entry = nullptr;
-    }
+    if (m_group.valid())
+        m_group->remove(m_id);
+    m_id = ItemId();
 }
 
 WeakRef<TransformGroup> TransformGroup::AutoEntry::group() const
@@ -108,26 +326,28 @@ void TransformGroup::AutoEntry::setGroup(WeakRef<TransformGroup> g)
     }
 
     Item entry(nullptr);
-    if (m_group.valid() && m_entry) {
-        entry.drawable = m_entry->drawable;
-        entry.visible = m_entry->visible;
+    if (Item const* const e = this->entry()) {
+        entry.drawable = e->drawable;
+        entry.visible = e->visible;
         release();
     }
     m_group = g;
     if (entry.drawable)
-        m_entry = m_group->add(entry.drawable, entry.visible);
+        m_id = m_group->add(entry.drawable, entry.visible);
     else
-        m_entry = nullptr;
+        m_id = ItemId();
 }
 
 bool TransformGroup::AutoEntry::visible() const
 {
-    return m_group.valid() && m_entry && m_entry->visible;
+    Item const* const e = entry();
+    return e && e->visible;
 }
 
 void TransformGroup::AutoEntry::setVisible(bool visible)
 {
-    if (!m_entry || !m_group)
+    Item* const e = entry();
+    if (!e)
         throw jd::Exception("attempt to set visibility of NULL-AutoEntry");
-    m_entry->visible = visible;
+    e->visible = visible;
 }
@@ -11,8 +11,12 @@
 #include <boost/noncopyable.hpp>
 #include <SFML/Graphics/Drawable.hpp>
 #include <SFML/Graphics/Transformable.hpp>
+#include <SFML/Graphics/Vertex.hpp>
 
-#include <list>
+#include <cstddef>
+#include <vector>
+
+namespace sf { class Sprite; }
 
 #ifdef _MSC_VER
 #   pragma warning(push)
@@ -30,23 +34,39 @@ class TransformGroup:
 {
 public:
     struct Item {
+        // The most derived of the classes TransformGroup knows the bounds
+        // of. Determined when the item is first drawn, because drawable may
+        // not be fully constructed when it is added.
+        enum class Kind: unsigned char { unknown, sprite, shape, text, other };
+
         Item(sf::Drawable* drawable, bool visible = true):
-            drawable(drawable), visible(visible) { }
+            drawable(drawable), visible(visible), kind(Kind::unknown) { }
 
         Item(Item&& rhs):
-           drawable(rhs.drawable), visible(rhs.visible)
+           drawable(rhs.drawable), visible(rhs.visible), kind(rhs.kind)
         { rhs.drawable = nullptr; }
 
         Item& operator= (Item&& rhs)
         {
             drawable = rhs.drawable;
             visible = rhs.visible;
+            kind = rhs.kind;
             rhs.drawable = nullptr;
             return *this;
         }
 
         sf::Drawable* drawable;
         bool visible;
+        Kind kind;
+    };
+
+    // Identifies an item of a TransformGroup. The ID stays valid while
+    // other items are added or removed, until the item itself is removed.
+    struct ItemId {
+        ItemId(): slot(static_cast<std::size_t>(-1)), generation(0) { }
+
+        std::size_t slot;
+        unsigned generation;
     };
 
     class AutoEntry: private boost::noncopyable {
@@ -70,8 +90,10 @@ public:
         void setVisible(bool visible);
 
     private:
+        Item* entry() const;
+
         WeakRef<TransformGroup> m_group;
-        Item* m_entry;
+        ItemId m_id;
     };
 
 
@@ -79,13 +101,77 @@ public:
     TransformGroup(TransformGroup&& rhs);
     TransformGroup& operator= (TransformGroup&& rhs);
 
-    Item* add(sf::Drawable* drawable, bool visible = true);
+    // Items are drawn in the order they were added.
+    ItemId add(sf::Drawable* drawable, bool visible = true);
+
+    // Returns nullptr if id does not (or no longer) refer to an item of this
+    // group. The pointer is invalidated by the next add() or draw().
+    Item* item(ItemId id);
+    Item const* item(ItemId id) const;
+
+    // Does nothing if item(id) is nullptr.
+    void remove(ItemId id);
+
+    // If enabled (the default), consecutive visible sf::Sprites with the
+    // same texture are drawn together with a single draw call. Other items
+    // (shapes, texts, nested groups, ...) are drawn one by one, as usual.
+    void setBatching(bool batch) { m_batching = batch; }
+    bool batching() const { return m_batching; }
+
+    // If enabled, each run of consecutive sprites is drawn ordered by
+    // texture (sprites with the same texture keep their order), so that
+    // they form less, longer batches. Only enable this if sprites with
+    // different textures do not overlap or the order does not matter.
+    // Disabled by default. Has no effect if batching() is false.
+    void setSortByTexture(bool sort) { m_sortByTexture = sort; }
+    bool sortByTexture() const { return m_sortByTexture; }
+
+    // If enabled, sprites, shapes and texts whose bounds are outside the
+    // render target's view are not drawn. Other items, like Tilemaps and
+    // nested TransformGroups, are always drawn (and may cull themselves).
+    // Disabled by default.
+    void setCulling(bool cull) { m_culling = cull; }
+    bool culling() const { return m_culling; }
+
+    // Number of items the last draw() skipped because of culling.
+    std::size_t culledCount() const { return m_culledCount; }
+
+    // Number of draw calls the last draw() issued directly (nested groups
+    // and other items which issue multiple calls count as one).
+    std::size_t drawCalls() const { return m_drawCalls; }
 
 protected:
     virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
 private:
     void doDraw(sf::RenderTarget& target, sf::RenderStates states);
-    std::list<Item> m_items;
+    void flushSprites(sf::RenderTarget& target, sf::RenderStates states);
+    void compact();
+
+    // Items are stored contiguously, in drawing order. remove() leaves a
+    // hole (an Item with a nullptr drawable) which is closed by the next
+    // draw() or, if there are too many of them, add(). Since this moves
+    // items, ItemIds refer to a slot, which stores the item's current index
+    // and a generation counter that is incremented when the item is removed
+    // so that the slot can be reused without old ItemIds becoming valid again.
+    struct Slot {
+        std::size_t index;
+        unsigned generation;
+    };
+
+    std::vector<Item> m_items;
+    std::vector<std::size_t> m_itemSlots; // Slot of the item at each index.
+    std::vector<Slot> m_slots;
+    std::vector<std::size_t> m_freeSlots;
+    std::size_t m_holeCount;
+    bool m_batching;
+    bool m_sortByTexture;
+    bool m_culling;
+    std::size_t m_drawCalls;
+    std::size_t m_culledCount;
+
+    // Only used while drawing; members to avoid reallocation every frame.
+    std::vector<sf::Sprite const*> m_spriteRun;
+    std::vector<sf::Vertex> m_vertices;
     TransformGroup& operator= (TransformGroup const&);
 };
 
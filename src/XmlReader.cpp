@@ -0,0 +1,344 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "XmlReader.hpp"
+
+#include <boost/format.hpp>
+#include <SFML/System/InputStream.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace {
+
+bool isWhitespace(int c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool isNameEnd(int c)
+{
+    return isWhitespace(c) || c == '/' || c == '>' || c == '=' || c < 0;
+}
+
+void appendUtf8(std::string& out, unsigned long cp)
+{
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | cp >> 6);
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | cp >> 12);
+        out += static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | cp >> 18);
+        out += static_cast<char>(0x80 | (cp >> 12 & 0x3F));
+        out += static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+} // anonymous namespace
+
+
+XmlReader::XmlReader(sf::InputStream& in, std::size_t bufferSize):
+    m_in(in),
+    m_buf(bufferSize),
+    m_pos(0),
+    m_end(0),
+    m_line(1),
+    m_token(Token::end),
+    m_attributeCount(0),
+    m_emptyElement(false)
+{
+    assert(bufferSize > 0);
+}
+
+void XmlReader::error(std::string const& msg) const
+{
+    throw XmlError(str(boost::format("XML error in line %1%: %2%") %
+        m_line % msg));
+}
+
+
+bool XmlReader::fill()
+{
+    if (m_pos < m_end)
+        return true;
+    sf::Int64 const n = m_in.read(&m_buf[0], m_buf.size());
+    if (n <= 0)
+        return false;
+    m_pos = 0;
+    m_end = static_cast<std::size_t>(n);
+    return true;
+}
+
+int XmlReader::peek()
+{
+    return fill() ? static_cast<unsigned char>(m_buf[m_pos]) : -1;
+}
+
+char XmlReader::get()
+{
+    if (!fill())
+        error("unexpected end of file");
+    char const c = m_buf[m_pos++];
+    if (c == '\n')
+        ++m_line;
+    return c;
+}
+
+void XmlReader::expect(char c)
+{
+    if (get() != c)
+        error(std::string("expected '") + c + '\'');
+}
+
+void XmlReader::skipWhitespace()
+{
+    while (isWhitespace(peek()))
+        get();
+}
+
+void XmlReader::skipUntil(char const* terminator)
+{
+    std::size_t const length = std::strlen(terminator);
+    std::string tail;
+    while (tail.size() < length || tail.compare(
+        tail.size() - length, length, terminator) != 0
+    ) {
+        tail += get();
+        if (tail.size() > 2 * length)
+            tail.erase(0, tail.size() - length);
+    }
+}
+
+void XmlReader::readName(std::string& name)
+{
+    name.clear();
+    while (!isNameEnd(peek()))
+        name += get();
+    if (name.empty())
+        error("name expected");
+}
+
+void XmlReader::readEntity(std::string& out)
+{
+    assert(peek() == '&');
+    get();
+    std::string entity;
+    for (char c = get(); c != ';'; c = get()) {
+        if (entity.size() > 10)
+            error("unterminated entity reference");
+        entity += c;
+    }
+
+    if (entity == "lt") {
+        out += '<';
+    } else if (entity == "gt") {
+        out += '>';
+    } else if (entity == "amp") {
+        out += '&';
+    } else if (entity == "quot") {
+        out += '"';
+    } else if (entity == "apos") {
+        out += '\'';
+    } else if (entity.size() > 1 && entity[0] == '#') {
+        bool const hex = entity[1] == 'x';
+        char const* const digits = entity.c_str() + (hex ? 2 : 1);
+        char* digitsEnd;
+        unsigned long const cp = std::strtoul(digits, &digitsEnd, hex ? 16 : 10);
+        if (*digits == '\0' || *digitsEnd != '\0' || cp > 0x10FFFF)
+            error("invalid character reference &" + entity + ';');
+        appendUtf8(out, cp);
+    } else {
+        error("unknown entity &" + entity + ';');
+    }
+}
+
+void XmlReader::readAttributes()
+{
+    m_attributeCount = 0;
+    for (;;) {
+        skipWhitespace();
+        int const c = peek();
+        if (c == '/') {
+            get();
+            expect('>');
+            m_emptyElement = true;
+            return;
+        }
+        if (c == '>') {
+            get();
+            return;
+        }
+
+        if (m_attributeCount == m_attributes.size())
+            m_attributes.resize(m_attributeCount + 1);
+        auto& attribute = m_attributes[m_attributeCount++];
+        readName(attribute.first);
+        skipWhitespace();
+        expect('=');
+        skipWhitespace();
+        char const quote = get();
+        if (quote != '"' && quote != '\'')
+            error("expected quoted attribute value");
+        attribute.second.clear();
+        while (peek() != quote) {
+            if (peek() == '&')
+                readEntity(attribute.second);
+            else if (peek() == '<')
+                error("'<' in attribute value");
+            else
+                attribute.second += get();
+        }
+        get();
+    }
+}
+
+void XmlReader::readText()
+{
+    m_text.clear();
+    static char const special[] = "<&";
+    while (m_text.size() < m_buf.size() && fill()) {
+        char const* const begin = &m_buf[0] + m_pos;
+        char const* const end = &m_buf[0] + m_end;
+        char const* const stop = std::find_first_of(
+            begin, end, special, special + 2);
+        m_line += std::count(begin, stop, '\n');
+        m_text.append(begin, stop);
+        m_pos += stop - begin;
+        if (stop != end) {
+            if (*stop == '<')
+                break;
+            readEntity(m_text);
+        }
+    }
+}
+
+void XmlReader::readCData()
+{
+    m_text.clear();
+    static char const terminator[] = "]]>";
+    while (m_text.size() < 3 || m_text.compare(
+        m_text.size() - 3, 3, terminator) != 0
+    ) {
+        m_text += get();
+    }
+    m_text.resize(m_text.size() - 3);
+}
+
+
+XmlReader::Token XmlReader::next()
+{
+    if (m_emptyElement) {
+        m_emptyElement = false;
+        m_openElements.pop_back();
+        return m_token = Token::endElement;
+    }
+
+    for (;;) {
+        int const c = peek();
+        if (c < 0) {
+            if (!m_openElements.empty())
+                error("unexpected end of file in element " + m_openElements.back());
+            return m_token = Token::end;
+        }
+
+        if (c != '<') {
+            readText();
+            return m_token = Token::text;
+        }
+
+        get();
+        int const c2 = peek();
+        if (c2 == '?') {
+            skipUntil("?>");
+        } else if (c2 == '!') {
+            get();
+            if (peek() == '-') {
+                get();
+                expect('-');
+                skipUntil("-->");
+            } else if (peek() == '[') {
+                for (char const* p = "[CDATA["; *p; ++p)
+                    expect(*p);
+                readCData();
+                return m_token = Token::text;
+            } else {
+                skipUntil(">"); // Document type declaration.
+            }
+        } else if (c2 == '/') {
+            get();
+            readName(m_name);
+            skipWhitespace();
+            expect('>');
+            if (m_openElements.empty() || m_openElements.back() != m_name)
+                error("unexpected end tag </" + m_name + '>');
+            m_openElements.pop_back();
+            return m_token = Token::endElement;
+        } else {
+            readName(m_name);
+            readAttributes();
+            m_openElements.push_back(m_name);
+            return m_token = Token::startElement;
+        }
+    }
+}
+
+bool XmlReader::nextChild()
+{
+    for (;;) {
+        switch (next()) {
+            case Token::startElement: return true;
+            case Token::endElement: return false;
+            case Token::text: break;
+            case Token::end: error("unexpected end of document");
+        }
+    }
+}
+
+void XmlReader::skipElement()
+{
+    std::size_t depth = 0;
+    for (;;) {
+        switch (next()) {
+            case Token::startElement:
+                ++depth;
+                break;
+            case Token::endElement:
+                if (depth == 0)
+                    return;
+                --depth;
+                break;
+            case Token::text:
+                break;
+            case Token::end:
+                error("unexpected end of document");
+        }
+    }
+}
+
+
+std::string const* XmlReader::findAttribute(std::string const& name) const
+{
+    for (std::size_t i = 0; i < m_attributeCount; ++i) {
+        if (m_attributes[i].first == name)
+            return &m_attributes[i].second;
+    }
+    return nullptr;
+}
+
+std::string const& XmlReader::attribute(std::string const& name) const
+{
+    std::string const* value = findAttribute(name);
+    if (!value)
+        error("attribute " + name + " missing in element " + m_name);
+    return *value;
+}
@@ -0,0 +1,115 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef XML_READER_HPP_INCLUDED
+#define XML_READER_HPP_INCLUDED XML_READER_HPP_INCLUDED
+
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace sf { class InputStream; }
+
+class XmlError: public std::runtime_error {
+public:
+    explicit XmlError(std::string const& msg): std::runtime_error(msg) { }
+};
+
+// A streaming pull parser for the subset of XML used by TMX and similar
+// files: elements, attributes, text with the predefined and numeric
+// entities and CDATA sections. Comments, processing instructions and the
+// document type declaration are skipped. Only a fixed size buffer and the
+// current token are kept in memory, so documents of any size can be read.
+class XmlReader: private boost::noncopyable {
+public:
+    enum class Token { startElement, endElement, text, end };
+
+    explicit XmlReader(sf::InputStream& in, std::size_t bufferSize = 64 * 1024);
+
+    // Reads the next token. An empty element (<e/>) yields a startElement
+    // and an endElement token. Long texts are split into multiple text
+    // tokens.
+    Token next();
+
+    // Reads up to the next child of the current element, skipping text.
+    // Returns false if the current element ends instead. To be called after
+    // the startElement token of the parent or the endElement token of the
+    // previous child.
+    bool nextChild();
+
+    // Skips the remaining content of the element of the last startElement
+    // token, including its endElement token.
+    void skipElement();
+
+    Token token() const { return m_token; }
+    std::string const& name() const { return m_name; } // Of the element.
+    std::string const& text() const { return m_text; }
+    std::size_t line() const { return m_line; }
+
+    // The attributes of the element of the last startElement token:
+    std::string const* findAttribute(std::string const& name) const;
+    std::string const& attribute(std::string const& name) const;
+
+    template <typename T>
+    T attribute(std::string const& name) const
+    {
+        return convertAttribute<T>(name, attribute(name));
+    }
+
+    template <typename T>
+    T attribute(std::string const& name, T const& defaultValue) const
+    {
+        std::string const* value = findAttribute(name);
+        return value ? convertAttribute<T>(name, *value) : defaultValue;
+    }
+
+    // Throws an XmlError containing the current line.
+    void error(std::string const& msg) const;
+
+private:
+    template <typename T>
+    T convertAttribute(std::string const& name, std::string const& value) const
+    {
+        try {
+            return boost::lexical_cast<T>(value);
+        } catch (boost::bad_lexical_cast const&) {
+            error("invalid value \"" + value + "\" for attribute " + name);
+            throw; // Not reached.
+        }
+    }
+
+    bool fill();
+    int peek();
+    char get();
+    void expect(char c);
+    void skipWhitespace();
+    void skipUntil(char const* terminator);
+    void readName(std::string& name);
+    void readEntity(std::string& out);
+    void readAttributes();
+    void readText();
+    void readCData();
+
+    sf::InputStream& m_in;
+    std::vector<char> m_buf;
+    std::size_t m_pos;
+    std::size_t m_end;
+    std::size_t m_line;
+
+    Token m_token;
+    std::string m_name;
+    std::string m_text;
+    std::vector<std::pair<std::string, std::string>> m_attributes;
+    std::size_t m_attributeCount; // Used entries of m_attributes.
+    std::vector<std::string> m_openElements;
+    bool m_emptyElement; // The last startElement token was <e/>.
+};
+
+#endif
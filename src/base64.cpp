@@ -4,29 +4,266 @@
 
 #include "base64.hpp"
 
-#include <array>
-#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define JD_BASE64_SSE2
+#   include <emmintrin.h>
+#   if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#       define JD_BASE64_AVX2
+#       include <immintrin.h>
+#       ifdef _MSC_VER
+#           include <intrin.h>
+#           define JD_TARGET_AVX2
+#       else
+#           define JD_TARGET_AVX2 __attribute__((target("avx2")))
+#       endif
+#   endif
+#endif
+
 namespace {
-static base64::byte charToByte(base64::byte c)
+
+using base64::byte;
+
+unsigned char const whitespace = 64;
+unsigned char const padding = 65;
+unsigned char const invalid = 0xFF;
+
+// Maps each character to its 6 bit value or to one of the constants above.
+struct DecodeTable {
+    DecodeTable()
+    {
+        std::memset(values, invalid, sizeof(values));
+        char const alphabet[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (unsigned char i = 0; i < 64; ++i)
+            values[static_cast<unsigned char>(alphabet[i])] = i;
+        values['='] = padding;
+        values[' '] = values['\t'] = values['\n'] = values['\r'] = whitespace;
+    }
+
+    unsigned char operator[] (byte c) const
+    {
+        return values[static_cast<unsigned char>(c)];
+    }
+
+    unsigned char values[256];
+} const decodeTable;
+
+void decodeQuad(unsigned char const* quad, byte* out)
+{
+    out[0] = static_cast<byte>(quad[0] << 2 | quad[1] >> 4);
+    out[1] = static_cast<byte>(quad[1] << 4 | quad[2] >> 2);
+    out[2] = static_cast<byte>(quad[2] << 6 | quad[3]);
+}
+
+// The block decoders decode as many blocks of unpadded base64 characters
+// without whitespace as possible and return the number of characters
+// consumed. They stop at the first block containing anything else, which
+// is then left to the careful character by character loop in
+// Decoder::decode(). The SIMD decoders pass the remaining characters on to
+// the next narrower decoder.
+
+std::size_t decodeBlocksScalar(byte const* encoded, std::size_t byteCount, byte* out)
+{
+    std::size_t i = 0;
+    for (; i + 4 <= byteCount; i += 4, out += 3) {
+        unsigned char const quad[4] = {
+            decodeTable[encoded[i]],     decodeTable[encoded[i + 1]],
+            decodeTable[encoded[i + 2]], decodeTable[encoded[i + 3]]
+        };
+        if ((quad[0] | quad[1] | quad[2] | quad[3]) >= 64)
+            break;
+        decodeQuad(quad, out);
+    }
+    return i;
+}
+
+#ifdef JD_BASE64_SSE2
+
+// Writes the low 3 bytes of each 32 bit value, most significant first.
+void storeTriples(std::uint32_t const* values, std::size_t count, byte* out)
+{
+    for (std::size_t i = 0; i < count; ++i, out += 3) {
+        out[0] = static_cast<byte>(values[i] >> 16);
+        out[1] = static_cast<byte>(values[i] >> 8);
+        out[2] = static_cast<byte>(values[i]);
+    }
+}
+
+// Translates 16 characters to their 6 bit values. Returns false if one of
+// them is not in the base64 alphabet. (Characters >= 128 are negative and
+// therefore in none of the ranges.)
+bool translateSse2(__m128i& v)
+{
+    __m128i const upper = _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    __m128i const lower = _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+    __m128i const digit = _mm_and_si128(
+        _mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+        _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i const plus = _mm_cmpeq_epi8(v, _mm_set1_epi8('+'));
+    __m128i const slash = _mm_cmpeq_epi8(v, _mm_set1_epi8('/'));
+
+    __m128i const valid = _mm_or_si128(
+        _mm_or_si128(upper, lower),
+        _mm_or_si128(_mm_or_si128(digit, plus), slash));
+    if (_mm_movemask_epi8(valid) != 0xFFFF)
+        return false;
+
+    __m128i const offset = _mm_or_si128(
+        _mm_or_si128(
+            _mm_and_si128(upper, _mm_set1_epi8(-'A')),
+            _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+        _mm_or_si128(
+            _mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+            _mm_or_si128(
+                _mm_and_si128(plus, _mm_set1_epi8(62 - '+')),
+                _mm_and_si128(slash, _mm_set1_epi8(63 - '/')))));
+    v = _mm_add_epi8(v, offset);
+    return true;
+}
+
+std::size_t decodeBlocksSse2(byte const* encoded, std::size_t byteCount, byte* out)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= byteCount; i += 16, out += 12) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(encoded + i));
+        if (!translateSse2(v))
+            break;
+
+        // Merge pairs of 6 bit values to 12 bits, then pairs of those to
+        // 24 bits.
+        __m128i const merged12 = _mm_or_si128(
+            _mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), 6),
+            _mm_srli_epi16(v, 8));
+        __m128i const merged24 = _mm_madd_epi16(
+            merged12, _mm_set1_epi32(0x00011000));
+
+        std::uint32_t values[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values), merged24);
+        storeTriples(values, 4, out);
+    }
+    return i + decodeBlocksScalar(encoded + i, byteCount - i, out);
+}
+
+#endif // JD_BASE64_SSE2
+
+#ifdef JD_BASE64_AVX2
+
+bool cpuHasAvx2()
+{
+#   ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        bool const osSavesYmm = (info[2] & (1 << 27)) != 0 && // OSXSAVE
+            (_xgetbv(0) & 6) == 6;
+        if (!osSavesYmm)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#   else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+#   endif
+}
+
+JD_TARGET_AVX2
+std::size_t decodeBlocksAvx2(byte const* encoded, std::size_t byteCount, byte* out)
+{
+    std::size_t i = 0;
+    for (; i + 32 <= byteCount; i += 32, out += 24) {
+        __m256i v = _mm256_loadu_si256(
+            reinterpret_cast<__m256i const*>(encoded + i));
+
+        // Same as translateSse2(), see there.
+        __m256i const upper = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+        __m256i const lower = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('a' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), v));
+        __m256i const digit = _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v));
+        __m256i const plus = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('+'));
+        __m256i const slash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('/'));
+
+        __m256i const valid = _mm256_or_si256(
+            _mm256_or_si256(upper, lower),
+            _mm256_or_si256(_mm256_or_si256(digit, plus), slash));
+        if (_mm256_movemask_epi8(valid) != -1)
+            break;
+
+        __m256i const offset = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_and_si256(upper, _mm256_set1_epi8(-'A')),
+                _mm256_and_si256(lower, _mm256_set1_epi8(26 - 'a'))),
+            _mm256_or_si256(
+                _mm256_and_si256(digit, _mm256_set1_epi8(52 - '0')),
+                _mm256_or_si256(
+                    _mm256_and_si256(plus, _mm256_set1_epi8(62 - '+')),
+                    _mm256_and_si256(slash, _mm256_set1_epi8(63 - '/')))));
+        v = _mm256_add_epi8(v, offset);
+
+        __m256i const merged24 = _mm256_madd_epi16(
+            _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140)),
+            _mm256_set1_epi32(0x00011000));
+
+        // Gather the 3 significant bytes of each value, most significant
+        // first, into the low 12 bytes of each 128 bit lane.
+        __m256i const packed = _mm256_shuffle_epi8(merged24, _mm256_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+        byte lanes[32];
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), packed);
+        std::memcpy(out, lanes, 12);
+        std::memcpy(out + 12, lanes + 16, 12);
+    }
+    return i + decodeBlocksSse2(encoded + i, byteCount - i, out);
+}
+
+#endif // JD_BASE64_AVX2
+
+typedef std::size_t (*DecodeBlocksFn)(byte const*, std::size_t, byte*);
+
+// Returns nullptr if the decoder is not available.
+DecodeBlocksFn decodeBlocksFn(base64::BlockDecoder decoder)
 {
-    switch(c) {
-        case '+': return 62;
-        case '/': return 63;
-        case '=': return -1;
+    switch (decoder) {
+        case base64::BlockDecoder::table:
+            return &decodeBlocksScalar;
+#ifdef JD_BASE64_SSE2
+        case base64::BlockDecoder::sse2:
+            return &decodeBlocksSse2;
+#endif
+#ifdef JD_BASE64_AVX2
+        case base64::BlockDecoder::avx2:
+            return cpuHasAvx2() ? &decodeBlocksAvx2 : nullptr;
+#endif
         default:
-            if (c >= '0' && c <= '9')
-                return c - '0' + 52;
-            if (c >= 'A' && c <= 'Z')
-                return c - 'A';
-            if (c >= 'a' && c <= 'z')
-                return c - 'a' + 26;
-            throw base64::InvalidCharacter();
-        }
+            return nullptr;
+    }
+}
+
+base64::BlockDecoder fastestBlockDecoder()
+{
+    if (decodeBlocksFn(base64::BlockDecoder::avx2))
+        return base64::BlockDecoder::avx2;
+    if (decodeBlocksFn(base64::BlockDecoder::sse2))
+        return base64::BlockDecoder::sse2;
+    return base64::BlockDecoder::table;
 }
+
+base64::BlockDecoder currentBlockDecoder = fastestBlockDecoder();
+DecodeBlocksFn decodeBlocks = decodeBlocksFn(currentBlockDecoder);
+
 } // anonymous namespace
 
 namespace base64 {
@@ -48,8 +285,6 @@ std::vector<byte> decode(std::string const& encoded)
     return decode(encoded.data(), encoded.size());
 }
 
-
-// Could be optimized: call transform once on encoded
 std::vector<byte> decode(byte const* encoded, std::size_t byteCount)
 {
     std::vector<byte> result;
@@ -57,42 +292,89 @@ std::vector<byte> decode(byte const* encoded, std::size_t byteCount)
     if (byteCount == 0)
         return result;
 
-    assert(encoded);
+    result.resize(maxDecodedSize(byteCount));
+    result.resize(decode(encoded, byteCount, &result[0]));
+    return result;
+}
 
-    if (byteCount % 4 != 0)
-        throw InvalidLength();
+bool isAvailable(BlockDecoder decoder)
+{
+    return decodeBlocksFn(decoder) != nullptr;
+}
 
-    result.reserve(byteCount * 3 / 4 + 2);
-    for (std::size_t i = 0; i < byteCount; i += 4) {
-
-        std::array<byte, 4> inBytes;
-        std::transform(
-            encoded + i, encoded + i + 4,
-            inBytes.begin(),
-            charToByte);
-
-        std::array<byte, 3> outBytes;
-        outBytes[0] = static_cast<byte>(inBytes[0] << 2 | inBytes[1] >> 4);
-        outBytes[1] = static_cast<byte>(inBytes[1] << 4 | inBytes[2] >> 2);
-        outBytes[2] = static_cast<byte>(inBytes[2] << 6 | inBytes[3]);
-
-        if (i + 4 == byteCount) {
-            std::size_t discard = 0;
-            if (inBytes[2] == -1) {
-                ++discard;
-                if (inBytes[1] == -1)
-                    ++discard;
-            } else if (inBytes[1] == -1) {
-                throw InvalidCharacter();
-            }
-            result.insert(result.end(), outBytes.begin(), outBytes.end() - discard);
-        } else if (inBytes[0] == -1 || inBytes[1] == -1) {
+BlockDecoder blockDecoder()
+{
+    return currentBlockDecoder;
+}
+
+void setBlockDecoder(BlockDecoder decoder)
+{
+    DecodeBlocksFn const fn = decodeBlocksFn(decoder);
+    if (!fn)
+        throw std::invalid_argument("base64 block decoder not available");
+    currentBlockDecoder = decoder;
+    decodeBlocks = fn;
+}
+
+
+std::size_t decode(byte const* encoded, std::size_t byteCount, byte* out)
+{
+    Decoder decoder;
+    std::size_t const n = decoder.decode(encoded, byteCount, out);
+    decoder.finish();
+    return n;
+}
+
+
+std::size_t Decoder::decode(byte const* encoded, std::size_t byteCount, byte* out)
+{
+    assert(encoded || byteCount == 0);
+
+    byte* const outBegin = out;
+    std::size_t i = 0;
+    while (i < byteCount) {
+        // Most of the data usually consists of long runs of plain base64
+        // characters, which are decoded block-wise.
+        if (m_quadSize == 0 && m_padding == 0) {
+            std::size_t const consumed = decodeBlocks(
+                encoded + i, byteCount - i, out);
+            i += consumed;
+            out += consumed / 4 * 3;
+            if (i == byteCount)
+                break;
+        }
+
+        unsigned char const value = decodeTable[encoded[i++]];
+        if (value == whitespace)
+            continue;
+        if (value == invalid)
             throw InvalidCharacter();
-        } else {
-            result.insert(result.end(), outBytes.begin(), outBytes.end());
+        if (value == padding) {
+            // Padding may only occupy the last two characters of a group.
+            if (m_quadSize < 2)
+                throw InvalidCharacter();
+            ++m_padding;
+        } else if (m_padding > 0) {
+            throw InvalidCharacter(); // Data after padding.
+        }
+        m_quad[m_quadSize++] = value == padding ? 0 : value;
+
+        if (m_quadSize == 4) {
+            byte decoded[3];
+            decodeQuad(m_quad, decoded);
+            std::size_t const count = 3 - m_padding;
+            std::memcpy(out, decoded, count);
+            out += count;
+            m_quadSize = 0;
         }
     }
-    return result;
+    return static_cast<std::size_t>(out - outBegin);
+}
+
+void Decoder::finish() const
+{
+    if (m_quadSize != 0)
+        throw InvalidLength();
 }
 
 } // namespace base64
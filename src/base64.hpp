@@ -28,11 +28,53 @@ namespace base64 {
 
 
     typedef char byte;
+
+    // The maximum number of bytes encodedCount characters decode to.
+    inline std::size_t maxDecodedSize(std::size_t encodedCount)
+    {
+        return (encodedCount + 3) / 4 * 3;
+    }
+
+    // Decodes data which arrives in arbitrary pieces, skipping whitespace.
+    // Runs of plain base64 characters are decoded with SSE2 or AVX2, if
+    // available (AVX2 is detected at runtime).
+    class Decoder {
+    public:
+        Decoder(): m_quadSize(0), m_padding(0) { }
+
+        // Writes the decoded bytes to out, which must have room for
+        // maxDecodedSize(byteCount) bytes, and returns their count.
+        std::size_t decode(byte const* encoded, std::size_t byteCount, byte* out);
+
+        // Throws InvalidLength if the data ended in the middle of a group
+        // of 4 characters.
+        void finish() const;
+
+    private:
+        unsigned char m_quad[4];
+        unsigned m_quadSize;
+        unsigned m_padding; // Number of '=' seen.
+    };
+
     std::vector<byte> decode(byte const* encoded, std::size_t byteCount);
 
+    // Decodes into out, which must have room for maxDecodedSize(byteCount)
+    // bytes, and returns the number of bytes written.
+    std::size_t decode(byte const* encoded, std::size_t byteCount, byte* out);
+
     std::vector<byte> decode(char const* encoded); // encoded must be null-terminated
     std::vector<byte> decode(std::vector<byte> const& encoded);
     std::vector<byte> decode(std::string const& encoded);
+
+    // The implementations for runs of plain base64 characters. By default,
+    // the fastest available one is used.
+    enum class BlockDecoder { table, sse2, avx2 };
+    bool isAvailable(BlockDecoder decoder);
+    BlockDecoder blockDecoder();
+
+    // For benchmarks. Must not be called while other threads decode.
+    // Throws std::invalid_argument if !isAvailable(decoder).
+    void setBlockDecoder(BlockDecoder decoder);
 } // namespace base64
 
 
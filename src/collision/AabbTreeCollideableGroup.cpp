@@ -0,0 +1,395 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "AabbTreeCollideableGroup.hpp"
+
+#include "comp/PositionComponent.hpp"
+#include "sfUtil.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+// The tree follows the dynamic AABB tree of Erin Catto's Box2D.
+
+namespace {
+
+sf::FloatRect combined(sf::FloatRect const& a, sf::FloatRect const& b)
+{
+    float const left = std::min(a.left, b.left);
+    float const top = std::min(a.top, b.top);
+    return sf::FloatRect(
+        left, top,
+        std::max(jd::right(a), jd::right(b)) - left,
+        std::max(jd::bottom(a), jd::bottom(b)) - top);
+}
+
+sf::FloatRect enlarged(sf::FloatRect const& r, float margin)
+{
+    return sf::FloatRect(
+        r.left - margin, r.top - margin,
+        r.width + 2 * margin, r.height + 2 * margin);
+}
+
+float perimeter(sf::FloatRect const& r)
+{
+    return 2 * (r.width + r.height);
+}
+
+bool contains(sf::FloatRect const& outer, sf::FloatRect const& inner)
+{
+    return inner.left >= outer.left && inner.top >= outer.top &&
+        jd::right(inner) <= jd::right(outer) &&
+        jd::bottom(inner) <= jd::bottom(outer);
+}
+
+// Unlike sf::Rect::intersects(), also true for touching rects.
+bool overlaps(sf::FloatRect const& a, sf::FloatRect const& b)
+{
+    return a.left <= jd::right(b) && b.left <= jd::right(a) &&
+        a.top <= jd::bottom(b) && b.top <= jd::bottom(a);
+}
+
+} // anonymous namespace
+
+
+AabbTreeCollideableGroup::AabbTreeCollideableGroup(float margin):
+    m_margin(margin),
+    m_root(nullNode),
+    m_freeNode(nullNode)
+{
+    if (margin < 0)
+        throw std::invalid_argument("margin must not be negative");
+}
+
+void AabbTreeCollideableGroup::setMargin(float margin)
+{
+    if (margin < 0)
+        throw std::invalid_argument("margin must not be negative");
+    m_margin = margin;
+}
+
+
+void AabbTreeCollideableGroup::itemAdded(
+    std::size_t id, PositionComponent const& c)
+{
+    int const leaf = allocateNode();
+    Node& node = m_nodes[leaf];
+    node.box = enlarged(c.rect(), m_margin);
+    node.height = 0;
+    node.item = id;
+    insertLeaf(leaf);
+
+    if (id >= m_leaves.size())
+        m_leaves.resize(id + 1);
+    m_leaves[id] = leaf;
+}
+
+void AabbTreeCollideableGroup::itemsCleared()
+{
+    m_leaves.clear();
+    m_nodes.clear();
+    m_root = nullNode;
+    m_freeNode = nullNode;
+}
+
+void AabbTreeCollideableGroup::itemRemoved(std::size_t id)
+{
+    removeLeaf(m_leaves[id]);
+    freeNode(m_leaves[id]);
+    m_leaves[id] = nullNode;
+}
+
+void AabbTreeCollideableGroup::itemRectChanged(
+    std::size_t id, sf::FloatRect const& newRect)
+{
+    int const leaf = m_leaves[id];
+    if (contains(m_nodes[leaf].box, newRect))
+        return;
+    removeLeaf(leaf);
+    m_nodes[leaf].box = enlarged(newRect, m_margin);
+    insertLeaf(leaf);
+}
+
+
+template <typename Pred>
+void AabbTreeCollideableGroup::queryTree(
+    Pred pred, std::vector<std::size_t>& out)
+{
+    if (m_root == nullNode)
+        return;
+
+    std::vector<int> stack;
+    stack.swap(m_stack);
+    stack.push_back(m_root);
+    while (!stack.empty()) {
+        Node const& node = m_nodes[stack.back()];
+        stack.pop_back();
+        if (!pred(node.box))
+            continue;
+        if (node.isLeaf()) {
+            out.push_back(node.item);
+        } else {
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+    m_stack.swap(stack);
+}
+
+void AabbTreeCollideableGroup::appendColliding(
+    sf::FloatRect const& r, std::vector<Collision>& result, Entity* e)
+{
+    removePending();
+
+    std::vector<std::size_t> candidates;
+    candidates.swap(m_candidates);
+    queryTree([&r](sf::FloatRect const& box) {
+        return overlaps(box, r);
+    }, candidates);
+
+    appendCollidingItems(candidates, r, result, e);
+
+    candidates.clear();
+    m_candidates.swap(candidates);
+}
+
+void AabbTreeCollideableGroup::appendColliding(
+    sf::Vector2f p1, sf::Vector2f p2, std::vector<Collision>& result)
+{
+    removePending();
+
+    std::vector<std::size_t> candidates;
+    candidates.swap(m_candidates);
+    queryTree([p1, p2](sf::FloatRect const& box) {
+        return jd::intersection(p1, p2, box);
+    }, candidates);
+
+    appendCollidingItems(candidates, p1, p2, result);
+
+    candidates.clear();
+    m_candidates.swap(candidates);
+}
+
+void AabbTreeCollideableGroup::collide()
+{
+    removePending();
+
+    PairVec pairs;
+    pairs.swap(m_pairs);
+    std::vector<std::size_t> candidates;
+    candidates.swap(m_candidates);
+
+    for (std::size_t id = 0; id < idLimit(); ++id) {
+        PositionComponent const* c = component(id);
+        if (!c)
+            continue;
+        sf::FloatRect const rect = c->rect();
+        candidates.clear();
+        queryTree([&rect](sf::FloatRect const& box) {
+            return overlaps(box, rect);
+        }, candidates);
+        for (std::size_t id2 : candidates) {
+            if (id2 <= id) // Report each pair only once.
+                continue;
+            PositionComponent const* c2 = component(id2);
+            if (c2 && rect.intersects(c2->rect()))
+                pairs.emplace_back(id, id2);
+        }
+    }
+    candidates.clear();
+    m_candidates.swap(candidates);
+
+    // Notify only now, because notifications may change the tree.
+    notifyPairs(pairs);
+
+    pairs.clear();
+    m_pairs.swap(pairs);
+}
+
+
+int AabbTreeCollideableGroup::allocateNode()
+{
+    int node;
+    if (m_freeNode != nullNode) {
+        node = m_freeNode;
+        m_freeNode = m_nodes[node].parent;
+    } else {
+        node = static_cast<int>(m_nodes.size());
+        m_nodes.emplace_back();
+    }
+    Node& n = m_nodes[node];
+    n.parent = n.left = n.right = nullNode;
+    n.height = 0;
+    n.item = 0;
+    return node;
+}
+
+void AabbTreeCollideableGroup::freeNode(int node)
+{
+    m_nodes[node].height = -1;
+    m_nodes[node].parent = m_freeNode;
+    m_freeNode = node;
+}
+
+void AabbTreeCollideableGroup::updateNode(int node)
+{
+    Node& n = m_nodes[node];
+    Node const& left = m_nodes[n.left];
+    Node const& right = m_nodes[n.right];
+    n.height = 1 + std::max(left.height, right.height);
+    n.box = combined(left.box, right.box);
+}
+
+void AabbTreeCollideableGroup::insertLeaf(int leaf)
+{
+    if (m_root == nullNode) {
+        m_root = leaf;
+        m_nodes[leaf].parent = nullNode;
+        return;
+    }
+
+    // Find the best sibling, using the surface area (here: perimeter)
+    // heuristic.
+    sf::FloatRect const box = m_nodes[leaf].box;
+    int index = m_root;
+    while (!m_nodes[index].isLeaf()) {
+        Node const& node = m_nodes[index];
+        float const nodePerimeter = perimeter(node.box);
+        float const combinedPerimeter = perimeter(combined(node.box, box));
+
+        // Cost of creating a new parent for this node and the new leaf.
+        float const cost = 2 * combinedPerimeter;
+
+        // Minimum cost of pushing the leaf further down the tree.
+        float const inheritanceCost = 2 * (combinedPerimeter - nodePerimeter);
+
+        auto const descendCost = [&](int child) -> float {
+            Node const& c = m_nodes[child];
+            float const p = perimeter(combined(box, c.box));
+            return (c.isLeaf() ? p : p - perimeter(c.box)) + inheritanceCost;
+        };
+        float const leftCost = descendCost(node.left);
+        float const rightCost = descendCost(node.right);
+
+        if (cost < leftCost && cost < rightCost)
+            break;
+        index = leftCost < rightCost ? node.left : node.right;
+    }
+
+    int const sibling = index;
+    int const oldParent = m_nodes[sibling].parent;
+    int const newParent = allocateNode(); // Invalidates references to nodes.
+    Node& parent = m_nodes[newParent];
+    parent.parent = oldParent;
+    parent.left = sibling;
+    parent.right = leaf;
+    parent.box = combined(box, m_nodes[sibling].box);
+    parent.height = m_nodes[sibling].height + 1;
+    m_nodes[sibling].parent = newParent;
+    m_nodes[leaf].parent = newParent;
+
+    if (oldParent == nullNode) {
+        m_root = newParent;
+    } else if (m_nodes[oldParent].left == sibling) {
+        m_nodes[oldParent].left = newParent;
+    } else {
+        m_nodes[oldParent].right = newParent;
+    }
+
+    for (index = m_nodes[leaf].parent; index != nullNode;
+         index = m_nodes[index].parent
+    ) {
+        index = balance(index);
+        updateNode(index);
+    }
+}
+
+void AabbTreeCollideableGroup::removeLeaf(int leaf)
+{
+    if (leaf == m_root) {
+        m_root = nullNode;
+        return;
+    }
+
+    int const parent = m_nodes[leaf].parent;
+    int const grandParent = m_nodes[parent].parent;
+    int const sibling = m_nodes[parent].left == leaf ?
+        m_nodes[parent].right : m_nodes[parent].left;
+
+    freeNode(parent);
+    m_nodes[sibling].parent = grandParent;
+    if (grandParent == nullNode) {
+        m_root = sibling;
+        return;
+    }
+
+    if (m_nodes[grandParent].left == parent)
+        m_nodes[grandParent].left = sibling;
+    else
+        m_nodes[grandParent].right = sibling;
+
+    for (int index = grandParent; index != nullNode;
+         index = m_nodes[index].parent
+    ) {
+        index = balance(index);
+        updateNode(index);
+    }
+}
+
+// Performs a left or right rotation if node a is imbalanced and returns the
+// new root of the subtree.
+int AabbTreeCollideableGroup::balance(int ia)
+{
+    Node& a = m_nodes[ia];
+    if (a.isLeaf() || a.height < 2)
+        return ia;
+
+    int const ib = a.left;
+    int const ic = a.right;
+    Node& b = m_nodes[ib];
+    Node& c = m_nodes[ic];
+    int const imbalance = c.height - b.height;
+
+    // Rotates the higher child (up) up, making a its child; a keeps its
+    // other child (keep) and gets the lower child of up (moved).
+    auto const rotateUp = [&](int iup, Node& up, int& aSlot, Node& keep) {
+        int const iupLeft = up.left;
+        int const iupRight = up.right;
+        Node& upLeft = m_nodes[iupLeft];
+        Node& upRight = m_nodes[iupRight];
+
+        up.left = ia;
+        up.parent = a.parent;
+        a.parent = iup;
+
+        if (up.parent == nullNode)
+            m_root = iup;
+        else if (m_nodes[up.parent].left == ia)
+            m_nodes[up.parent].left = iup;
+        else
+            m_nodes[up.parent].right = iup;
+
+        bool const leftHigher = upLeft.height > upRight.height;
+        int const ihigh = leftHigher ? iupLeft : iupRight;
+        int const ilow = leftHigher ? iupRight : iupLeft;
+        Node& high = m_nodes[ihigh];
+        Node& low = m_nodes[ilow];
+
+        up.right = ihigh;
+        aSlot = ilow;
+        low.parent = ia;
+        a.box = combined(keep.box, low.box);
+        up.box = combined(a.box, high.box);
+        a.height = 1 + std::max(keep.height, low.height);
+        up.height = 1 + std::max(a.height, high.height);
+        return iup;
+    };
+
+    if (imbalance > 1)
+        return rotateUp(ic, c, a.right, b);
+    if (imbalance < -1)
+        return rotateUp(ib, b, a.left, c);
+    return ia;
+}
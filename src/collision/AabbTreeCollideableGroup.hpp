@@ -0,0 +1,81 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef AABB_TREE_COLLIDEABLE_GROUP_HPP_INCLUDED
+#define AABB_TREE_COLLIDEABLE_GROUP_HPP_INCLUDED AABB_TREE_COLLIDEABLE_GROUP_HPP_INCLUDED
+
+#include "PositionCollideableGroup.hpp"
+
+#include <cstddef>
+#include <vector>
+
+
+// Keeps its items in a dynamic bounding volume tree (a balanced binary tree
+// of axis aligned bounding boxes), so that queries take logarithmic time.
+// Suited best for many mostly static items of mixed sizes, like the objects
+// of a map. Each item's box in the tree is enlarged by margin() on every
+// side, so that items moving only a little do not need to be reinserted.
+class AabbTreeCollideableGroup: public PositionCollideableGroup {
+public:
+    explicit AabbTreeCollideableGroup(float margin = 8);
+
+    float margin() const { return m_margin; }
+    void setMargin(float margin); // Affects only items inserted afterwards.
+
+    virtual void appendColliding(
+        sf::FloatRect const&, std::vector<Collision>& result,
+        Entity* e = nullptr) override;
+
+    virtual void appendColliding(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd,
+        std::vector<Collision>& result) override;
+
+    virtual void collide() override;
+
+protected:
+    virtual void itemAdded(std::size_t id, PositionComponent const& c) override;
+    virtual void itemRemoved(std::size_t id) override;
+    virtual void itemRectChanged(
+        std::size_t id, sf::FloatRect const& newRect) override;
+    virtual void itemsCleared() override;
+
+private:
+    static int const nullNode = -1;
+
+    struct Node {
+        bool isLeaf() const { return left == nullNode; }
+
+        sf::FloatRect box; // Enlarged by m_margin for leaves.
+        int parent;        // Next free node, if this node is unused.
+        int left, right;
+        int height;        // 0 for leaves, -1 for unused nodes.
+        std::size_t item;  // Only for leaves: the item ID.
+    };
+
+    int allocateNode();
+    void freeNode(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int node);
+    void updateNode(int node); // Recomputes box and height from the children.
+
+    // Appends the items whose leaves satisfy pred(box) to out.
+    template <typename Pred>
+    void queryTree(Pred pred, std::vector<std::size_t>& out);
+
+    float m_margin;
+
+    std::vector<Node> m_nodes;
+    int m_root;
+    int m_freeNode;
+
+    std::vector<int> m_leaves; // Indexed by item ID.
+
+    // Scratch buffers, to avoid allocating on every query.
+    std::vector<int> m_stack;
+    std::vector<std::size_t> m_candidates;
+    PairVec m_pairs;
+};
+
+#endif
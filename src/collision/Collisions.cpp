@@ -23,34 +23,22 @@ void CollideableGroupGroup::remove(CollideableGroup const& g)
         }), m_groups.end());
 }
 
-template <typename Container, typename Container2>
-void append(Container& c, Container2&& appended)
-{
-    c.insert(
-        end(c),
-        std::make_move_iterator(begin(appended)),
-        std::make_move_iterator(end(appended)));
-}
-
 // notify if e != nullptr
-std::vector<Collision> CollideableGroupGroup::colliding(
-    sf::FloatRect const& r, Entity* e)
+void CollideableGroupGroup::appendColliding(
+    sf::FloatRect const& r, std::vector<Collision>& result, Entity* e)
 {
-    std::vector<Collision> result;
     forEachGroup([&](WeakRef<CollideableGroup>& g) {
-        append(result, g->colliding(r, e));
+        g->appendColliding(r, result, e);
     });
-    return result;
 }
 
-std::vector<Collision> CollideableGroupGroup::colliding(
-    sf::Vector2f lineStart, sf::Vector2f lineEnd)
+void CollideableGroupGroup::appendColliding(
+    sf::Vector2f lineStart, sf::Vector2f lineEnd,
+    std::vector<Collision>& result)
 {
-    std::vector<Collision> result;
     forEachGroup([&](WeakRef<CollideableGroup>& g) {
-        append(result, g->colliding(lineStart, lineEnd));
+        g->appendColliding(lineStart, lineEnd, result);
     });
-    return result;
 }
 
 void CollideableGroupGroup::collideWith(
@@ -26,12 +26,32 @@ class CollideableGroup: public EnableWeakRefFromThis<CollideableGroup> {
 public:
     virtual ~CollideableGroup() { }
 
+    // The appendColliding() functions append the found collisions to result
+    // without clearing it first, so that the same buffer can be reused for
+    // many queries. notify if e != nullptr
+    virtual void appendColliding(
+        sf::FloatRect const&, std::vector<Collision>& result,
+        Entity* e = nullptr) = 0;
+
+    virtual void appendColliding(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd,
+        std::vector<Collision>& result) = 0;
+
     // notify if e != nullptr
-    virtual std::vector<Collision> colliding(
-        sf::FloatRect const&, Entity* e = nullptr) = 0;
+    std::vector<Collision> colliding(sf::FloatRect const& r, Entity* e = nullptr)
+    {
+        std::vector<Collision> result;
+        appendColliding(r, result, e);
+        return result;
+    }
 
-    virtual std::vector<Collision> colliding(
-        sf::Vector2f lineStart, sf::Vector2f lineEnd) = 0;
+    std::vector<Collision> colliding(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd)
+    {
+        std::vector<Collision> result;
+        appendColliding(lineStart, lineEnd, result);
+        return result;
+    }
 
     // If a CollideableGroup delegates the collision check to the other one
     // it should call collideWith with delegated = isDelegated, to detect/avoid
@@ -64,11 +84,13 @@ public:
     void remove(CollideableGroup const& g);
 
     // notify if e != nullptr
-    virtual std::vector<Collision> colliding(
-        sf::FloatRect const& r, Entity* e = nullptr) override;
+    virtual void appendColliding(
+        sf::FloatRect const& r, std::vector<Collision>& result,
+        Entity* e = nullptr) override;
 
-    virtual std::vector<Collision> colliding(
-        sf::Vector2f lineStart, sf::Vector2f lineEnd) override;
+    virtual void appendColliding(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd,
+        std::vector<Collision>& result) override;
 
     virtual void collideWith(
         CollideableGroup& other,
@@ -0,0 +1,209 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "PositionCollideableGroup.hpp"
+
+#include "comp/PositionComponent.hpp"
+#include "comp/RectCollisionComponent.hpp"
+#include "compsys/Entity.hpp"
+#include "sfUtil.hpp"
+
+#include <boost/bind.hpp>
+
+#include <cassert>
+
+
+static void notifyEntity(PositionComponent& p, PositionComponent& p2)
+{
+    if (!p.parent() || !p2.parent())
+        return;
+    auto recv = p.parent()->get<RectCollisionComponent>();
+    if (recv)
+        recv->notifyCollision(p.rect(), *p2.parent(), p2.rect());
+}
+
+
+PositionCollideableGroup::~PositionCollideableGroup()
+{
+    for (auto& item : m_items)
+        item.rectConnection.disconnect();
+}
+
+
+void PositionCollideableGroup::add(PositionComponent& c)
+{
+    // A pending remove(c) must not remove c if it is added again.
+    removePending();
+
+    auto const existing = m_ids.find(&c);
+    if (existing != m_ids.end()) {
+        if (m_items[existing->second].component.valid())
+            return;
+
+        // The item's component died without remove() and c reuses its
+        // address.
+        removeItem(existing->second);
+    }
+
+    std::size_t id;
+    if (m_freeIds.empty()) {
+        id = m_items.size();
+        m_items.emplace_back();
+    } else {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+
+    Item& item = m_items[id];
+    item.component = c.ref<PositionComponent>();
+    item.key = &c;
+    item.rectConnection = c.connect_rectChanged(boost::bind(
+        &PositionCollideableGroup::rectChanged, this, id, _2));
+    m_ids[&c] = id;
+
+    itemAdded(id, c);
+}
+
+void PositionCollideableGroup::remove(PositionComponent& c)
+{
+    m_removed.push_back(&c);
+}
+
+void PositionCollideableGroup::clear()
+{
+    for (auto& item : m_items)
+        item.rectConnection.disconnect();
+    m_items.clear();
+    m_freeIds.clear();
+    m_ids.clear();
+    m_removed.clear();
+    itemsCleared();
+}
+
+
+void PositionCollideableGroup::removePending()
+{
+    for (PositionComponent const* c : m_removed) {
+        auto const it = m_ids.find(c);
+        if (it != m_ids.end())
+            removeItem(it->second);
+    }
+    m_removed.clear();
+}
+
+void PositionCollideableGroup::removeItem(std::size_t id)
+{
+    Item& item = m_items[id];
+    assert(item.key);
+    item.rectConnection.disconnect();
+    itemRemoved(id);
+    m_ids.erase(item.key);
+    item = Item();
+    m_freeIds.push_back(id);
+}
+
+void PositionCollideableGroup::rectChanged(
+    std::size_t id, sf::FloatRect const& newRect)
+{
+    itemRectChanged(id, newRect);
+}
+
+
+void PositionCollideableGroup::collideWith(
+    CollideableGroup& other, DelegateState)
+{
+    removePending();
+
+    std::vector<Collision> collisions;
+    collisions.swap(m_collisions);
+
+    // Index based, because notifications may add items.
+    for (std::size_t id = 0; id < m_items.size(); ++id) {
+        PositionComponent* c = m_items[id].component.getOpt();
+        if (!c) {
+            if (m_items[id].key)
+                removeItem(id);
+            continue;
+        }
+        WeakRef<PositionComponent> const ref = m_items[id].component;
+
+        collisions.clear();
+        other.appendColliding(c->rect(), collisions, c->parent());
+
+        if (!ref.valid() || !c->parent())
+            continue;
+
+        auto recv = c->parent()->get<RectCollisionComponent>();
+
+        if (!recv)
+            continue;
+
+        for (auto const& collision : collisions) {
+            if (collision.entity) // Shapes need not have an entity.
+                recv->notifyCollision(
+                    ref->rect(), *collision.entity, collision.rect);
+        }
+    }
+
+    collisions.clear();
+    m_collisions.swap(collisions);
+}
+
+void PositionCollideableGroup::appendCollidingItems(
+    std::vector<std::size_t> const& candidates,
+    sf::FloatRect const& r, std::vector<Collision>& result, Entity* e)
+{
+    for (std::size_t id : candidates) {
+        if (id >= m_items.size())
+            continue;
+        PositionComponent* c = m_items[id].component.getOpt();
+        if (!c) {
+            if (m_items[id].key)
+                removeItem(id);
+            continue;
+        }
+        sf::FloatRect const rect = c->rect();
+        if (!rect.intersects(r))
+            continue;
+
+        result.push_back(Collision(c->parent(), rect));
+
+        if (!e || !c->parent())
+            continue;
+
+        if (auto recv = c->parent()->get<RectCollisionComponent>())
+            recv->notifyCollision(rect, *e, r);
+
+    } // foreach
+}
+
+void PositionCollideableGroup::appendCollidingItems(
+    std::vector<std::size_t> const& candidates,
+    sf::Vector2f p1, sf::Vector2f p2, std::vector<Collision>& result)
+{
+    for (std::size_t id : candidates) {
+        PositionComponent* c = m_items[id].component.getOpt();
+        if (!c) {
+            if (m_items[id].key)
+                removeItem(id);
+            continue;
+        }
+        if (jd::intersection(p1, p2, c->rect()))
+            result.push_back(Collision(c->parent(), c->rect()));
+    }
+}
+
+void PositionCollideableGroup::notifyPairs(PairVec const& pairs)
+{
+    for (auto const& pair : pairs) {
+        if (pair.first >= m_items.size() || pair.second >= m_items.size())
+            continue;
+        PositionComponent* p = m_items[pair.first].component.getOpt();
+        PositionComponent* p2 = m_items[pair.second].component.getOpt();
+        if (!p || !p2)
+            continue;
+        notifyEntity(*p, *p2);
+        notifyEntity(*p2, *p);
+    }
+}
@@ -0,0 +1,103 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef POSITION_COLLIDEABLE_GROUP_HPP_INCLUDED
+#define POSITION_COLLIDEABLE_GROUP_HPP_INCLUDED POSITION_COLLIDEABLE_GROUP_HPP_INCLUDED
+
+#include "Collisions.hpp"
+#include "WeakRef.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <ssig.hpp>
+
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+class PositionComponent;
+
+// Base for groups of PositionComponents. Keeps track of the added
+// components, of their rectChanged signals and of removed or dead
+// components, leaving the spatial data structure to the derived class.
+// Each item is identified by an index (ID), which is reused after the item is
+// removed.
+class PositionCollideableGroup:
+    public CollideableGroup, private boost::noncopyable {
+public:
+    ~PositionCollideableGroup();
+
+    void add(PositionComponent& c);
+    void remove(PositionComponent& c); // Takes effect on the next query.
+
+    virtual void collideWith(
+        CollideableGroup& other,
+        DelegateState delegated = DelegateState::notDelegated) override;
+
+    virtual void clear() override;
+
+protected:
+    typedef std::vector<std::pair<std::size_t, std::size_t>> PairVec;
+
+    PositionCollideableGroup() { }
+
+    // Called after the item was added and before it is removed, respectively.
+    virtual void itemAdded(std::size_t id, PositionComponent const& c) = 0;
+    virtual void itemRemoved(std::size_t id) = 0;
+
+    virtual void itemRectChanged(
+        std::size_t id, sf::FloatRect const& newRect) = 0;
+
+    // Called by clear(), after all items were dropped.
+    virtual void itemsCleared() = 0;
+
+    // All IDs are below idLimit().
+    std::size_t idLimit() const { return m_items.size(); }
+    bool isUsed(std::size_t id) const { return m_items[id].key != nullptr; }
+
+    // nullptr if the item is unused or its component has died.
+    PositionComponent* component(std::size_t id) const
+    { return m_items[id].component.getOpt(); }
+
+    void removePending();
+    void removeItem(std::size_t id);
+
+    // Append the candidates which actually collide to result, removing those
+    // whose component has died. The first overload notifies like
+    // CollideableGroup::appendColliding().
+    void appendCollidingItems(
+        std::vector<std::size_t> const& candidates,
+        sf::FloatRect const& r, std::vector<Collision>& result, Entity* e);
+    void appendCollidingItems(
+        std::vector<std::size_t> const& candidates,
+        sf::Vector2f p1, sf::Vector2f p2, std::vector<Collision>& result);
+
+    // Notifies both items of each pair, unless one of them has died in the
+    // meantime.
+    void notifyPairs(PairVec const& pairs);
+
+private:
+    typedef ssig::Connection<void(sf::FloatRect const&, sf::FloatRect const&)>
+        RectConnection;
+
+    struct Item {
+        Item(): key(nullptr) { }
+
+        WeakRef<PositionComponent> component;
+        PositionComponent const* key; // Still valid if component is not.
+        RectConnection rectConnection;
+    };
+
+    void rectChanged(std::size_t id, sf::FloatRect const& newRect);
+
+    std::vector<Item> m_items;
+    std::vector<std::size_t> m_freeIds;
+    std::unordered_map<PositionComponent const*, std::size_t> m_ids;
+    std::vector<PositionComponent const*> m_removed;
+
+    std::vector<Collision> m_collisions; // Scratch buffer for collideWith().
+};
+
+#endif
@@ -5,110 +5,392 @@
 #include "RectCollideableGroup.hpp"
 
 #include "comp/PositionComponent.hpp"
-#include "comp/RectCollisionComponent.hpp"
-#include "compsys/Entity.hpp"
-#include "sfUtil.hpp"
+#include "profiling.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
-void RectCollideableGroup::add(PositionComponent& c)
+
+namespace {
+
+// Items covering more cells are not inserted into the cells.
+double const maxItemCells = 64;
+
+// Cell coordinates are clamped to this magnitude, so that huge, infinite or
+// NaN coordinates neither overflow int nor the cell count computations.
+double const maxCellCoord = 1 << 28;
+
+int cellCoord(float x, float cellSize)
+{
+    double const c = std::floor(static_cast<double>(x) / cellSize);
+    if (!(c > -maxCellCoord)) // Also catches NaN.
+        return static_cast<int>(-maxCellCoord);
+    if (c > maxCellCoord)
+        return static_cast<int>(maxCellCoord);
+    return static_cast<int>(c);
+}
+
+double cellCount(sf::Vector2i firstCell, sf::Vector2i lastCell)
 {
-    m_items.push_back(c.ref<PositionComponent>());
+    return (static_cast<double>(lastCell.x) - firstCell.x + 1) *
+           (static_cast<double>(lastCell.y) - firstCell.y + 1);
 }
 
+} // anonymous namespace
+
 
-void RectCollideableGroup::remove(PositionComponent& c)
+RectCollideableGroup::RectCollideableGroup(float cellSize):
+    m_cellSize(cellSize),
+    m_broadphase(Broadphase::grid),
+    m_visitStamp(0)
 {
-    m_removed.push_front(c.ref<PositionComponent>());
+    if (!(cellSize > 0))
+        throw std::invalid_argument("cell size must be positive");
 }
 
+void RectCollideableGroup::itemAdded(
+    std::size_t id, PositionComponent const& c)
+{
+    if (id >= m_gridItems.size())
+        m_gridItems.resize(id + 1);
+    GridItem& item = m_gridItems[id];
+    item.visitStamp = 0;
+    insertIntoCells(id, cellRange(c.rect()));
+    if (m_broadphase == Broadphase::sweepAndPrune)
+        m_sweepList.push_back(SweepEntry(id, item.generation));
+}
 
+void RectCollideableGroup::itemRemoved(std::size_t id)
+{
+    removeFromCells(id);
+    ++m_gridItems[id].generation; // Marks the item's sweep entry as dead.
+}
 
-std::vector<Collision> RectCollideableGroup::colliding(
-    sf::FloatRect const& r, Entity* e)
+void RectCollideableGroup::itemsCleared()
 {
-    removePending();
+    m_gridItems.clear();
+    m_cells.clear();
+    m_oversized.clear();
+    m_sweepList.clear();
+}
+
 
-    std::vector<Collision> result;
-    for (auto const& item : m_items) {
-        if (!item->rect().intersects(r))
+void RectCollideableGroup::setCellSize(float cellSize)
+{
+    if (!(cellSize > 0))
+        throw std::invalid_argument("cell size must be positive");
+    m_cellSize = cellSize;
+    m_cells.clear();
+    m_oversized.clear();
+    for (std::size_t id = 0; id < idLimit(); ++id) {
+        if (!isUsed(id))
+            continue;
+        PositionComponent const* c = component(id);
+        if (!c) {
+            removeItem(id);
             continue;
+        }
+        insertIntoCells(id, cellRange(c->rect()));
+    }
+}
 
-        result.push_back(Collision(item->parent(), item->rect()));
 
-        if (!e || !item->parent())
-            continue;
+void RectCollideableGroup::appendColliding(
+    sf::FloatRect const& r, std::vector<Collision>& result, Entity* e)
+{
+    removePending();
 
-        if (auto recv = item->parent()->get<RectCollisionComponent>())
-            recv->notifyCollision(item->rect(), *e, r);
+    std::vector<std::size_t> candidates;
+    candidates.swap(m_candidates);
+    gatherCandidates(r, candidates);
 
-    } // foreach
-    return result;
-} // RectCollideableGroup::colliding
+    appendCollidingItems(candidates, r, result, e);
 
+    candidates.clear();
+    m_candidates.swap(candidates);
+} // RectCollideableGroup::appendColliding
 
-void RectCollideableGroup::collideWith(
-    CollideableGroup& other, DelegateState)
+
+void RectCollideableGroup::appendColliding(
+    sf::Vector2f p1, sf::Vector2f p2, std::vector<Collision>& result)
 {
     removePending();
 
-    for (auto const& item : m_items) {
-        std::vector<Collision> const collisions =
-            other.colliding(item->rect(), item->parent());
+    std::vector<std::size_t> candidates;
+    candidates.swap(m_candidates);
+    unsigned const stamp = nextVisitStamp();
+    jd::traverseGrid(p1, p2, sf::Vector2f(m_cellSize, m_cellSize),
+        [&](sf::Vector2i pos, float, sf::Vector2i) -> bool {
+            auto const it = m_cells.find(pos);
+            if (it == m_cells.end())
+                return true;
+            for (std::size_t id : it->second) {
+                if (m_gridItems[id].visitStamp != stamp) {
+                    m_gridItems[id].visitStamp = stamp;
+                    candidates.push_back(id);
+                }
+            }
+            return true;
+        });
+    candidates.insert(
+        candidates.end(), m_oversized.begin(), m_oversized.end());
 
-        if (!item->parent())
-            continue;
+    appendCollidingItems(candidates, p1, p2, result);
+
+    candidates.clear();
+    m_candidates.swap(candidates);
+}
+
+void RectCollideableGroup::collide()
+{
+    JD_PROFILE_ZONE("RectCollideableGroup::collide");
+    removePending();
+
+    PairVec pairs;
+    pairs.swap(m_pairs);
+
+    if (m_broadphase == Broadphase::sweepAndPrune)
+        findPairsBySweep(pairs);
+    else
+        findPairsInGrid(pairs);
+
+    // Notify only now, because notifications may change the group.
+    notifyPairs(pairs);
+
+    pairs.clear();
+    m_pairs.swap(pairs);
+}
+
+void RectCollideableGroup::findPairsInGrid(PairVec& out)
+{
+    std::vector<std::size_t> expired;
+    expired.swap(m_candidates);
+
+    for (auto const& cell : m_cells) {
+        Cell const& ids = cell.second;
+        for (std::size_t i = 0; i < ids.size(); ++i) {
+            GridItem const& a = m_gridItems[ids[i]];
+            PositionComponent const* ca = component(ids[i]);
+            if (!ca) {
+                expired.push_back(ids[i]);
+                continue;
+            }
+            for (std::size_t j = i + 1; j < ids.size(); ++j) {
+                GridItem const& b = m_gridItems[ids[j]];
 
-        auto recv = item->parent()->get<RectCollisionComponent>();
+                // Report each pair only in the first cell both items cover.
+                sf::Vector2i const firstShared(
+                    std::max(a.firstCell.x, b.firstCell.x),
+                    std::max(a.firstCell.y, b.firstCell.y));
+                if (firstShared != cell.first)
+                    continue;
 
-        if (!recv)
+                PositionComponent const* cb = component(ids[j]);
+                if (cb && ca->rect().intersects(cb->rect()))
+                    out.emplace_back(ids[i], ids[j]);
+            }
+        }
+    }
+
+    if (!m_oversized.empty()) {
+        // Oversized items are checked against everything near them. Pairs of
+        // two oversized items are found from both, so report only one.
+        std::vector<std::size_t> candidates;
+        for (std::size_t o : m_oversized) {
+            PositionComponent const* co = component(o);
+            if (!co) {
+                expired.push_back(o);
+                continue;
+            }
+            candidates.clear();
+            gatherCandidates(co->rect(), candidates);
+            for (std::size_t id : candidates) {
+                if (id == o || (m_gridItems[id].oversized && id < o))
+                    continue;
+                PositionComponent const* c = component(id);
+                if (c && co->rect().intersects(c->rect()))
+                    out.emplace_back(o, id);
+            }
+        }
+    }
+
+    for (std::size_t id : expired)
+        if (isUsed(id)) // Not yet removed (may be in multiple cells).
+            removeItem(id);
+    expired.clear();
+    m_candidates.swap(expired);
+}
+
+void RectCollideableGroup::findPairsBySweep(PairVec& out)
+{
+    // Drop dead entries and refresh the rects of the others.
+    std::size_t live = 0;
+    for (std::size_t i = 0; i < m_sweepList.size(); ++i) {
+        SweepEntry entry = m_sweepList[i];
+        if (entry.generation != m_gridItems[entry.id].generation)
+            continue; // The ID may already be used by another item.
+        PositionComponent const* c = component(entry.id);
+        if (!c) {
+            removeItem(entry.id);
             continue;
+        }
+        entry.rect = c->rect();
+        m_sweepList[live++] = entry;
+    }
+    m_sweepList.erase(m_sweepList.begin() + live, m_sweepList.end());
 
-        for (auto const& collision : collisions)
-            recv->notifyCollision(
-                item->rect(), *collision.entity, collision.rect);
+    // Insertion sort: items move only a little between frames, so the list
+    // is nearly sorted and this is close to linear.
+    for (std::size_t i = 1; i < m_sweepList.size(); ++i) {
+        SweepEntry const entry = m_sweepList[i];
+        std::size_t j = i;
+        for (; j > 0 && m_sweepList[j - 1].rect.left > entry.rect.left; --j)
+            m_sweepList[j] = m_sweepList[j - 1];
+        m_sweepList[j] = entry;
+    }
+
+    for (std::size_t i = 0; i < m_sweepList.size(); ++i) {
+        sf::FloatRect const& r = m_sweepList[i].rect;
+        float const r_right = jd::right(r);
+        for (std::size_t j = i + 1; j < m_sweepList.size(); ++j) {
+            sf::FloatRect const& r2 = m_sweepList[j].rect;
+            if (r2.left >= r_right)
+                break; // All following items start even further right.
+            if (r.intersects(r2))
+                out.emplace_back(m_sweepList[i].id, m_sweepList[j].id);
+        }
     }
 }
 
-void RectCollideableGroup::removePending()
+void RectCollideableGroup::setBroadphase(Broadphase broadphase)
 {
-    while (!m_removed.empty()) {
-        m_items.remove(m_removed.front());
-        m_removed.pop_front();
+    if (broadphase == m_broadphase)
+        return;
+    m_broadphase = broadphase;
+    m_sweepList.clear();
+    if (m_broadphase == Broadphase::sweepAndPrune) {
+        for (std::size_t id = 0; id < idLimit(); ++id) {
+            if (isUsed(id))
+                m_sweepList.push_back(
+                    SweepEntry(id, m_gridItems[id].generation));
+        }
     }
 }
 
-std::vector<Collision> RectCollideableGroup::colliding(
-    sf::Vector2f p1, sf::Vector2f p2)
+
+RectCollideableGroup::CellRange RectCollideableGroup::cellRange(
+    sf::FloatRect const& r) const
 {
-    removePending();
+    return std::make_pair(
+        sf::Vector2i(
+            cellCoord(r.left, m_cellSize),
+            cellCoord(r.top, m_cellSize)),
+        sf::Vector2i(
+            cellCoord(jd::right(r), m_cellSize),
+            cellCoord(jd::bottom(r), m_cellSize)));
+}
+
+void RectCollideableGroup::insertIntoCells(
+    std::size_t id, CellRange const& range)
+{
+    GridItem& item = m_gridItems[id];
+    item.firstCell = range.first;
+    item.lastCell = range.second;
+    item.oversized = cellCount(range.first, range.second) > maxItemCells;
+    if (item.oversized) {
+        m_oversized.push_back(id);
+        return;
+    }
+    sf::Vector2i pos;
+    for (pos.y = item.firstCell.y; pos.y <= item.lastCell.y; ++pos.y)
+        for (pos.x = item.firstCell.x; pos.x <= item.lastCell.x; ++pos.x)
+            m_cells[pos].push_back(id);
+}
 
-    std::vector<Collision> result;
-    for (auto const& item : m_items) {
-        if (jd::intersection(p1, p2, item->rect()))
-            result.push_back(Collision(item->parent(), item->rect()));
+void RectCollideableGroup::removeFromCells(std::size_t id)
+{
+    GridItem const& item = m_gridItems[id];
+    if (item.oversized) {
+        auto const it = std::find(m_oversized.begin(), m_oversized.end(), id);
+        if (it != m_oversized.end()) {
+            *it = m_oversized.back();
+            m_oversized.pop_back();
+        }
+        return;
+    }
+    sf::Vector2i pos;
+    for (pos.y = item.firstCell.y; pos.y <= item.lastCell.y; ++pos.y) {
+        for (pos.x = item.firstCell.x; pos.x <= item.lastCell.x; ++pos.x) {
+            auto const it = m_cells.find(pos);
+            if (it == m_cells.end())
+                continue;
+            Cell& cell = it->second;
+            auto const idIt = std::find(cell.begin(), cell.end(), id);
+            if (idIt != cell.end()) {
+                *idIt = cell.back();
+                cell.pop_back();
+            }
+        }
     }
-    return result;
 }
 
-static void notifyEntity(PositionComponent& p, PositionComponent& p2)
+void RectCollideableGroup::itemRectChanged(
+    std::size_t id, sf::FloatRect const& newRect)
 {
-    auto recv = p.parent()->get<RectCollisionComponent>();
-    if (recv)
-        recv->notifyCollision(p.rect(), *p2.parent(), p2.rect());
+    GridItem& item = m_gridItems[id];
+    auto const range = cellRange(newRect);
+    if (range.first == item.firstCell && range.second == item.lastCell)
+        return;
+    removeFromCells(id);
+    insertIntoCells(id, range);
 }
 
-void RectCollideableGroup::collide()
+unsigned RectCollideableGroup::nextVisitStamp()
 {
-    removePending();
+    if (++m_visitStamp == 0) { // Wrapped around: reset all stamps.
+        for (auto& item : m_gridItems)
+            item.visitStamp = 0;
+        m_visitStamp = 1;
+    }
+    return m_visitStamp;
+}
 
-    for (auto it = begin(m_items); it != end(m_items); ++it) {
-        PositionComponent& p = **it;
-        for (auto it2 = std::next(it); it2 != end(m_items); ++it2) {
-            PositionComponent& p2 = **it2;
-            if (!p.rect().intersects(p2.rect()))
-                continue;
-            notifyEntity(p, p2);
-            notifyEntity(p2, p);
+void RectCollideableGroup::gatherCandidates(
+    sf::FloatRect const& r, std::vector<std::size_t>& out)
+{
+    unsigned const stamp = nextVisitStamp();
+    auto const range = cellRange(r);
+    auto const visitCell = [&](Cell const& cell) {
+        for (std::size_t id : cell) {
+            if (m_gridItems[id].visitStamp != stamp) {
+                m_gridItems[id].visitStamp = stamp;
+                out.push_back(id);
+            }
+        }
+    };
+
+    out.insert(out.end(), m_oversized.begin(), m_oversized.end());
+
+    // For huge query rects, it is cheaper to look at all existing cells.
+    if (cellCount(range.first, range.second) > m_cells.size()) {
+        for (auto const& cell : m_cells) {
+            sf::Vector2i const& pos = cell.first;
+            if (pos.x >= range.first.x && pos.x <= range.second.x &&
+                pos.y >= range.first.y && pos.y <= range.second.y
+            ) {
+                visitCell(cell.second);
+            }
+        }
+        return;
+    }
+
+    sf::Vector2i pos;
+    for (pos.y = range.first.y; pos.y <= range.second.y; ++pos.y) {
+        for (pos.x = range.first.x; pos.x <= range.second.x; ++pos.x) {
+            auto const it = m_cells.find(pos);
+            if (it != m_cells.end())
+                visitCell(it->second);
         }
     }
 }
@@ -5,38 +5,111 @@
 #ifndef RECT_COLLIDEABLE_GROUP_HPP_INCLUDED
 #define RECT_COLLIDEABLE_GROUP_HPP_INCLUDED RECT_COLLIDEABLE_GROUP_HPP_INCLUDED
 
-#include "Collisions.hpp"
-#include "WeakRef.hpp"
+#include "PositionCollideableGroup.hpp"
+#include "sfUtil.hpp" // std::hash<sf::Vector2i>
 
-#include <forward_list>
-#include <list>
+#include <SFML/System/Vector2.hpp>
 
+#include <cstddef>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-class PositionComponent;
 
-class RectCollideableGroup: public CollideableGroup {
+// Items are kept in a uniform grid (spatial hash) of square cells, which is
+// updated whenever an item's PositionComponent::rectChanged signal fires.
+// Queries and collide() thus only look at items in the same cells. Items
+// covering very many cells are kept in a separate list instead, which every
+// query checks.
+// Alternatively, collide() can use sort and sweep on the x axis, which
+// copes better with items clustered along one axis (e.g. side-scrollers).
+class RectCollideableGroup: public PositionCollideableGroup {
 public:
-    void add(PositionComponent& c);
-    void remove(PositionComponent& c);
+    enum class Broadphase { grid, sweepAndPrune };
 
-    virtual std::vector<Collision> colliding(
-        sf::FloatRect const&, Entity* e = nullptr) override;
-    virtual void collideWith(
-        CollideableGroup& other,
-        DelegateState delegated = DelegateState::notDelegated) override;
+    // cellSize should be somewhat larger than the typical item.
+    explicit RectCollideableGroup(float cellSize = 64);
 
-    virtual std::vector<Collision> colliding(
-        sf::Vector2f lineStart, sf::Vector2f lineEnd) override;
+    float cellSize() const { return m_cellSize; }
+    void setCellSize(float cellSize); // Rebuilds the grid.
+
+    // Strategy used by collide(). Queries always use the grid.
+    Broadphase broadphase() const { return m_broadphase; }
+    void setBroadphase(Broadphase broadphase);
+
+    virtual void appendColliding(
+        sf::FloatRect const&, std::vector<Collision>& result,
+        Entity* e = nullptr) override;
+
+    virtual void appendColliding(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd,
+        std::vector<Collision>& result) override;
 
     virtual void collide() override;
 
-    virtual void clear()  override { m_removed.clear(); m_items.clear(); }
+protected:
+    virtual void itemAdded(std::size_t id, PositionComponent const& c) override;
+    virtual void itemRemoved(std::size_t id) override;
+    virtual void itemRectChanged(
+        std::size_t id, sf::FloatRect const& newRect) override;
+    virtual void itemsCleared() override;
 
 private:
-    void removePending();
+    struct GridItem {
+        GridItem(): oversized(false), visitStamp(0), generation(0) { }
+
+        sf::Vector2i firstCell, lastCell; // Inclusive range of covered cells.
+        bool oversized; // In m_oversized instead of the cells.
+        unsigned visitStamp;
+        unsigned generation; // Incremented whenever the item is removed.
+    };
+
+    // Grid cells store item IDs.
+    typedef std::vector<std::size_t> Cell;
+
+    // Entry of the list sorted by rect.left for sweep and prune.
+    struct SweepEntry {
+        SweepEntry(std::size_t id, unsigned generation):
+            id(id), generation(generation) { }
+
+        std::size_t id;
+        unsigned generation; // Outdated if the item was removed.
+        sf::FloatRect rect;  // Cached, refreshed before each sweep.
+    };
+
+    void findPairsInGrid(PairVec& out);
+    void findPairsBySweep(PairVec& out);
+
+    typedef std::pair<sf::Vector2i, sf::Vector2i> CellRange;
+
+    CellRange cellRange(sf::FloatRect const& r) const;
+    void insertIntoCells(std::size_t id, CellRange const& range);
+    void removeFromCells(std::size_t id);
+
+    // Returns a fresh visit stamp, used to report each item only once even if
+    // it covers multiple of the inspected cells.
+    unsigned nextVisitStamp();
+    void gatherCandidates(sf::FloatRect const& r, std::vector<std::size_t>& out);
+
+    float m_cellSize;
+    Broadphase m_broadphase;
+
+    std::vector<GridItem> m_gridItems; // Indexed by item ID.
+
+    // Emptied cells are kept to avoid reallocating them when items move back
+    // and forth; clear() and setCellSize() release them.
+    std::unordered_map<sf::Vector2i, Cell> m_cells;
+    std::vector<std::size_t> m_oversized; // IDs of items not in m_cells.
+    unsigned m_visitStamp;
+
+    // Only maintained if m_broadphase == Broadphase::sweepAndPrune. Kept
+    // between calls to collide(), so that it is nearly sorted already.
+    // Entries of removed items are only dropped by the next collide().
+    std::vector<SweepEntry> m_sweepList;
 
-    std::list<WeakRef<PositionComponent>> m_items;
-    std::forward_list<WeakRef<PositionComponent>> m_removed;
+    // Scratch buffers, to avoid allocating on every query.
+    std::vector<std::size_t> m_candidates;
+    PairVec m_pairs;
 };
 
 #endif
@@ -0,0 +1,274 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "ShapeCollideableGroup.hpp"
+
+#include "comp/RectCollisionComponent.hpp"
+#include "compsys/Entity.hpp"
+#include "MapInfo.hpp"
+#include "sfUtil.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+namespace {
+
+// > 0 if o, a, b are counterclockwise, < 0 if clockwise, 0 if collinear.
+float orientation(sf::Vector2f o, sf::Vector2f a, sf::Vector2f b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+// p must be collinear with a and b.
+bool inSegmentBounds(sf::Vector2f a, sf::Vector2f b, sf::Vector2f p)
+{
+    return p.x >= std::min(a.x, b.x) && p.x <= std::max(a.x, b.x) &&
+        p.y >= std::min(a.y, b.y) && p.y <= std::max(a.y, b.y);
+}
+
+bool segmentsIntersect(
+    sf::Vector2f a, sf::Vector2f b, sf::Vector2f c, sf::Vector2f d)
+{
+    float const o1 = orientation(c, d, a);
+    float const o2 = orientation(c, d, b);
+    float const o3 = orientation(a, b, c);
+    float const o4 = orientation(a, b, d);
+    if (((o1 > 0 && o2 < 0) || (o1 < 0 && o2 > 0)) &&
+        ((o3 > 0 && o4 < 0) || (o3 < 0 && o4 > 0))
+    ) {
+        return true;
+    }
+    return
+        (o1 == 0 && inSegmentBounds(c, d, a)) ||
+        (o2 == 0 && inSegmentBounds(c, d, b)) ||
+        (o3 == 0 && inSegmentBounds(a, b, c)) ||
+        (o4 == 0 && inSegmentBounds(a, b, d));
+}
+
+} // anonymous namespace
+
+
+std::size_t ShapeCollideableGroup::add(
+    std::vector<sf::Vector2f> const& points, bool closed, Entity* e)
+{
+    if (points.empty())
+        throw std::invalid_argument("cannot add a shape without points");
+
+    float left = points[0].x, right = points[0].x;
+    float top = points[0].y, bottom = points[0].y;
+    for (sf::Vector2f p : points) {
+        left = std::min(left, p.x);
+        right = std::max(right, p.x);
+        top = std::min(top, p.y);
+        bottom = std::max(bottom, p.y);
+        m_xs.push_back(p.x);
+        m_ys.push_back(p.y);
+    }
+
+    m_lefts.push_back(left);
+    m_tops.push_back(top);
+    m_rights.push_back(right);
+    m_bottoms.push_back(bottom);
+    m_firstPoints.push_back(
+        static_cast<std::uint32_t>(m_xs.size() - points.size()));
+    m_pointCounts.push_back(static_cast<std::uint32_t>(points.size()));
+    m_closed.push_back(closed);
+    m_entities.push_back(e);
+    return m_entities.size() - 1;
+}
+
+std::size_t ShapeCollideableGroup::add(MapObject const& o, Entity* e)
+{
+    switch (o.objectType) {
+        case MapObject::T::line:
+            return add(o.absolutePoints(), false, e);
+
+        case MapObject::T::poly:
+            return add(o.absolutePoints(), true, e);
+
+        case MapObject::T::rect: {
+            sf::FloatRect const r(o.position, o.size);
+            std::vector<sf::Vector2f> points;
+            points.push_back(jd::topLeft(r));
+            points.push_back(jd::topRight(r));
+            points.push_back(jd::bottomRight(r));
+            points.push_back(jd::bottomLeft(r));
+            return add(points, true, e);
+        }
+
+        default:
+            throw std::invalid_argument(
+                "ShapeCollideableGroup supports only line, poly and rect objects");
+    }
+}
+
+void ShapeCollideableGroup::remove(std::size_t id)
+{
+    if (id >= m_entities.size())
+        throw std::out_of_range("invalid shape ID");
+
+    // Make the bounding box prefilter reject the shape.
+    float const inf = std::numeric_limits<float>::infinity();
+    m_lefts[id] = m_tops[id] = inf;
+    m_rights[id] = m_bottoms[id] = -inf;
+    m_pointCounts[id] = 0;
+    m_entities[id] = static_cast<Entity*>(nullptr);
+}
+
+void ShapeCollideableGroup::clear()
+{
+    m_lefts.clear();
+    m_tops.clear();
+    m_rights.clear();
+    m_bottoms.clear();
+    m_firstPoints.clear();
+    m_pointCounts.clear();
+    m_closed.clear();
+    m_entities.clear();
+    m_xs.clear();
+    m_ys.clear();
+}
+
+
+sf::FloatRect ShapeCollideableGroup::bounds(std::size_t id) const
+{
+    return sf::FloatRect(
+        m_lefts[id], m_tops[id],
+        m_rights[id] - m_lefts[id], m_bottoms[id] - m_tops[id]);
+}
+
+bool ShapeCollideableGroup::contains(std::size_t id, sf::Vector2f p) const
+{
+    // Crossing number test.
+    std::size_t const first = m_firstPoints[id];
+    std::size_t const end = first + m_pointCounts[id];
+    bool inside = false;
+    for (std::size_t i = first, j = end - 1; i < end; j = i++) {
+        if ((m_ys[i] > p.y) != (m_ys[j] > p.y) &&
+            p.x < (m_xs[j] - m_xs[i]) * (p.y - m_ys[i]) /
+                (m_ys[j] - m_ys[i]) + m_xs[i]
+        ) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+bool ShapeCollideableGroup::intersects(
+    std::size_t id, sf::FloatRect const& r) const
+{
+    std::size_t const first = m_firstPoints[id];
+    std::size_t const end = first + m_pointCounts[id];
+    if (end - first == 1)
+        return r.contains(point(first));
+
+    for (std::size_t i = first + 1; i < end; ++i) {
+        if (jd::intersection(point(i - 1), point(i), r))
+            return true;
+    }
+    return m_closed[id] && (
+        jd::intersection(point(end - 1), point(first), r) ||
+        contains(id, jd::topLeft(r)));
+}
+
+bool ShapeCollideableGroup::intersects(
+    std::size_t id, sf::Vector2f p1, sf::Vector2f p2) const
+{
+    std::size_t const first = m_firstPoints[id];
+    std::size_t const end = first + m_pointCounts[id];
+    if (end - first == 1)
+        return segmentsIntersect(p1, p2, point(first), point(first));
+
+    for (std::size_t i = first + 1; i < end; ++i) {
+        if (segmentsIntersect(p1, p2, point(i - 1), point(i)))
+            return true;
+    }
+    return m_closed[id] && (
+        segmentsIntersect(p1, p2, point(end - 1), point(first)) ||
+        contains(id, p1));
+}
+
+
+void ShapeCollideableGroup::appendColliding(
+    sf::FloatRect const& r, std::vector<Collision>& result, Entity* e)
+{
+    float const right = jd::right(r);
+    float const bottom = jd::bottom(r);
+    for (std::size_t id = 0; id < m_entities.size(); ++id) {
+        if (m_lefts[id] > right || m_rights[id] < r.left ||
+            m_tops[id] > bottom || m_bottoms[id] < r.top ||
+            !intersects(id, r)
+        ) {
+            continue;
+        }
+
+        Entity* const entity = m_entities[id].getOpt();
+        sf::FloatRect const shapeBounds = bounds(id);
+        result.push_back(Collision(entity, shapeBounds));
+
+        if (!e || !entity)
+            continue;
+
+        if (auto recv = entity->get<RectCollisionComponent>())
+            recv->notifyCollision(shapeBounds, *e, r);
+    }
+}
+
+void ShapeCollideableGroup::appendColliding(
+    sf::Vector2f p1, sf::Vector2f p2, std::vector<Collision>& result)
+{
+    float const left = std::min(p1.x, p2.x), right = std::max(p1.x, p2.x);
+    float const top = std::min(p1.y, p2.y), bottom = std::max(p1.y, p2.y);
+    for (std::size_t id = 0; id < m_entities.size(); ++id) {
+        if (m_lefts[id] > right || m_rights[id] < left ||
+            m_tops[id] > bottom || m_bottoms[id] < top ||
+            !intersects(id, p1, p2)
+        ) {
+            continue;
+        }
+        result.push_back(Collision(m_entities[id].getOpt(), bounds(id)));
+    }
+}
+
+void ShapeCollideableGroup::collideWith(
+    CollideableGroup& other, DelegateState delegated)
+{
+    if (delegated == DelegateState::notDelegated) {
+        other.collideWith(*this, nextDelegateState(delegated));
+        return;
+    }
+
+    // The other group delegated to this one: query it with the bounding box
+    // of each shape, without notifications, and notify both sides only of
+    // the results which pass the exact test.
+    std::vector<Collision> collisions;
+    collisions.swap(m_collisions);
+    for (std::size_t id = 0; id < m_entities.size(); ++id) {
+        if (isRemoved(id) || !m_entities[id].valid())
+            continue;
+        WeakRef<Entity> const ref = m_entities[id];
+
+        collisions.clear();
+        other.appendColliding(bounds(id), collisions);
+        for (auto const& collision : collisions) {
+            if (!collision.entity || !intersects(id, collision.rect))
+                continue;
+            WeakRef<Entity> const otherRef = collision.entity;
+            if (auto otherRecv = collision.entity->get<RectCollisionComponent>())
+                otherRecv->notifyCollision(collision.rect, *ref, bounds(id));
+            if (!ref.valid())
+                break;
+            if (!otherRef.valid())
+                continue;
+            if (auto recv = ref->get<RectCollisionComponent>())
+                recv->notifyCollision(bounds(id), *otherRef, collision.rect);
+            if (!ref.valid())
+                break;
+        }
+    }
+    collisions.clear();
+    m_collisions.swap(collisions);
+}
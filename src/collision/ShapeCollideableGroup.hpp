@@ -0,0 +1,85 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef SHAPE_COLLIDEABLE_GROUP_HPP_INCLUDED
+#define SHAPE_COLLIDEABLE_GROUP_HPP_INCLUDED SHAPE_COLLIDEABLE_GROUP_HPP_INCLUDED
+
+#include "Collisions.hpp"
+#include "WeakRef.hpp"
+
+#include <SFML/System/Vector2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+class Entity;
+struct MapObject;
+
+// Holds static polygons and polylines, e.g. the LINE and POLY objects of a
+// map. Each shape may have an Entity, which is reported as the colliding
+// entity and notified through its RectCollisionComponent. The rect of
+// reported Collisions is the shape's bounding box.
+//
+// Shapes are stored as structure of arrays: the bounding boxes, used to
+// prefilter shapes before the exact test, are scanned linearly, and the
+// points of all shapes are kept in one coordinate array per axis.
+// Polygons may be concave: a rect collides with a polygon if it touches one
+// of its edges or lies completely inside of it.
+class ShapeCollideableGroup: public CollideableGroup {
+public:
+    // Returns an ID for remove(). The points must not be empty.
+    std::size_t add(
+        std::vector<sf::Vector2f> const& points, bool closed,
+        Entity* e = nullptr);
+
+    // Adds o's polygon or polyline, or its rect as polygon (tile objects
+    // are not supported).
+    std::size_t add(MapObject const& o, Entity* e = nullptr);
+
+    // The storage of removed shapes is reclaimed only by clear().
+    void remove(std::size_t id);
+
+    std::size_t count() const { return m_entities.size(); }
+
+    virtual void appendColliding(
+        sf::FloatRect const&, std::vector<Collision>& result,
+        Entity* e = nullptr) override;
+
+    virtual void appendColliding(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd,
+        std::vector<Collision>& result) override;
+
+    // Lets the other group query this one (so that shapes are tested
+    // exactly), unless it already delegated to this one.
+    virtual void collideWith(
+        CollideableGroup& other,
+        DelegateState delegated = DelegateState::notDelegated) override;
+
+    virtual void clear() override;
+
+private:
+    bool isRemoved(std::size_t id) const { return m_pointCounts[id] == 0; }
+    sf::FloatRect bounds(std::size_t id) const;
+    sf::Vector2f point(std::size_t i) const { return sf::Vector2f(m_xs[i], m_ys[i]); }
+
+    bool intersects(std::size_t id, sf::FloatRect const& r) const;
+    bool intersects(std::size_t id, sf::Vector2f p1, sf::Vector2f p2) const;
+    bool contains(std::size_t id, sf::Vector2f p) const; // Polygons only.
+
+    // Per shape:
+    std::vector<float> m_lefts, m_tops, m_rights, m_bottoms;
+    std::vector<std::uint32_t> m_firstPoints;
+    std::vector<std::uint32_t> m_pointCounts; // 0 for removed shapes.
+    std::vector<char> m_closed;
+    std::vector<WeakRef<Entity>> m_entities;
+
+    // Points of all shapes:
+    std::vector<float> m_xs, m_ys;
+
+    std::vector<Collision> m_collisions; // Scratch buffer for collideWith().
+};
+
+#endif
@@ -9,7 +9,7 @@
 #include "Logfile.hpp"
 #include "Tilemap.hpp"
 
-#include <array>
+#include <algorithm>
 #include <boost/current_function.hpp>
 #include <functional>
 #include <unordered_set>
@@ -18,44 +18,126 @@
 TileCollideableInfo::TileCollideableInfo(jd::Tilemap& tilemap):
     m_tilemap(tilemap)
 {
+    syncSize();
+}
+
+TileCollideableInfo::Slot TileCollideableInfo::allocSlot(
+    TileCollisionComponent* c)
+{
+    assert(c);
+    if (!m_freeSlots.empty()) {
+        Slot const s = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        m_components[s - 1] = c;
+        return s;
+    }
+    m_components.push_back(c);
+    return static_cast<Slot>(m_components.size());
+}
+
+void TileCollideableInfo::freeSlot(Slot s)
+{
+    assert(s);
+    m_components[s - 1] = static_cast<Component*>(nullptr);
+    m_freeSlots.push_back(s);
+}
+
+TileCollideableInfo::Slot TileCollideableInfo::slotAt(Vector3u pos) const
+{
+    if (isOnMap(pos))
+        return m_slots[index(pos)];
+    auto const it = m_offMapSlots.find(pos);
+    return it != m_offMapSlots.end() ? it->second : 0;
+}
+
+void TileCollideableInfo::setSlotAt(Vector3u pos, Slot s)
+{
+    if (isOnMap(pos))
+        m_slots[index(pos)] = s;
+    else if (s)
+        m_offMapSlots[pos] = s;
+    else
+        m_offMapSlots.erase(pos);
+}
+
+void TileCollideableInfo::syncSize()
+{
+    Vector3u const size = m_tilemap.size();
+    if (size == m_size)
+        return;
+
+    std::vector<std::pair<Vector3u, Slot>> occupied;
+    Vector3u pos;
+    std::size_t i = 0;
+    for (pos.z = 0; pos.z < m_size.z; ++pos.z)
+        for (pos.y = 0; pos.y < m_size.y; ++pos.y)
+            for (pos.x = 0; pos.x < m_size.x; ++pos.x, ++i)
+                if (m_slots[i])
+                    occupied.emplace_back(pos, m_slots[i]);
+    occupied.insert(occupied.end(), m_offMapSlots.begin(), m_offMapSlots.end());
+
+    m_size = size;
+    m_slots.assign(
+        static_cast<std::size_t>(size.x) * size.y * size.z, 0);
+    m_offMapSlots.clear();
+    for (auto const& entry : occupied)
+        setSlotAt(entry.first, entry.second);
+}
+
+void TileCollideableInfo::clear()
+{
+    m_components.clear();
+    m_freeSlots.clear();
+    std::fill(m_slots.begin(), m_slots.end(), 0);
+    m_offMapSlots.clear();
+    m_proxySlots.clear();
 }
 
 void TileCollideableInfo::setProxy(unsigned tileId, TileCollisionComponent* proxy)
 {
+    Slot const s = tileId < m_proxySlots.size() ? m_proxySlots[tileId] : 0;
     if (!proxy) {
-        std::size_t const erasedCount = m_proxyEntities.erase(tileId);
-        assert(erasedCount < 2);
-        if (!erasedCount)
+        if (s) {
+            freeSlot(s);
+            m_proxySlots[tileId] = 0;
+        } else {
             LOG_W("Attempt to unset a proxy, which was not set.");
-    } else if (!m_proxyEntities.insert(std::make_pair(tileId, proxy)).second)
+        }
+    } else if (component(s)) {
         throw std::logic_error(
             BOOST_CURRENT_FUNCTION +
             std::string(": cannot assign proxy entity: already assigned"));
+    } else {
+        if (s)
+            freeSlot(s);
+        if (tileId >= m_proxySlots.size())
+            m_proxySlots.resize(tileId + 1, 0);
+        m_proxySlots[tileId] = allocSlot(proxy);
+    }
 }
 
  WeakRef<TileCollisionComponent> TileCollideableInfo::proxy(unsigned tileId)
 {
-    auto const it = m_proxyEntities.find(tileId);
-    if (it != m_proxyEntities.end())
-        return it->second;
+    if (tileId < m_proxySlots.size() && m_proxySlots[tileId])
+        return m_components[m_proxySlots[tileId] - 1];
     return static_cast<Component*>(nullptr);
 }
 
 void TileCollideableInfo::setColliding(Vector3u pos, TileCollisionComponent* e)
 {
-    auto const it = m_entities.find(pos);
-    bool const found = it != m_entities.end();
+    syncSize();
+    Slot const s = slotAt(pos);
     if (e) {
-        if (found) {
-            it->second->notifyOverride(pos, *e);
-            it->second = e;
+        if (s) {
+            if (TileCollisionComponent* old = component(s))
+                old->notifyOverride(pos, *e);
+            m_components[s - 1] = e;
         } else {
-            bool const success = m_entities.insert(std::make_pair(pos, e)).second;
-            assert(success);
-            (void)success;
+            setSlotAt(pos, allocSlot(e));
         }
-    } else if (found) {
-        m_entities.erase(pos);
+    } else if (s) {
+        freeSlot(s);
+        setSlotAt(pos, 0);
     } else {
         LOG_W("Attempt to unregister a TileCollisionComponent which was not registered.");
     }
@@ -63,9 +145,9 @@ void TileCollideableInfo::setColliding(Vector3u pos, TileCollisionComponent* e)
 
  WeakRef<TileCollisionComponent> TileCollideableInfo::colliding(Vector3u pos)
 {
-    auto const it = m_entities.find(pos);
-    if (it != m_entities.end())
-        return it->second;
+    syncSize();
+    if (Slot const s = slotAt(pos))
+        return m_components[s - 1];
     return static_cast<Component*>(nullptr);
 }
 
@@ -77,152 +159,214 @@ Vector3u TileCollideableInfo::mapsize() const
 Collision TileCollideableInfo::makeCollision(
     Vector3u pos, Entity* e, sf::FloatRect const& r)
 {
-    auto const iEntity = m_entities.find(pos);
-    sf::Vector2i const ipos2(static_cast<int>(pos.x), static_cast<int>(pos.y));
-    if (iEntity != m_entities.end()) {
+    syncSize();
+    if (!isOnMap(pos)) {
+        TileCollisionComponent* const c = component(slotAt(pos));
+        if (!c)
+            return Collision();
+        Entity* const parent = c->parent();
         if (e)
-            iEntity->second->notifyCollision(pos, *e, r);
-         return Collision(
-            iEntity->second->parent(),
-            m_tilemap.globalTileRect(ipos2));
-    } else {
+            c->notifyCollision(pos, *e, r);
+        return Collision(parent, m_tilemap.globalTileRect(
+            sf::Vector2i(static_cast<int>(pos.x), static_cast<int>(pos.y))));
+    }
+    return makeCollision(pos, index(pos), e, r);
+}
+
+Collision TileCollideableInfo::makeCollision(
+    Vector3u pos, std::size_t idx, Entity* e, sf::FloatRect const& r)
+{
+    assert(idx == index(pos));
+    TileCollisionComponent* c = component(m_slots[idx]);
+    if (!c) {
         unsigned const tileId = m_tilemap[pos];
-        auto const iProxy = m_proxyEntities.find(tileId);
-        if (iProxy != m_proxyEntities.end()) {
-            if (e)
-                iProxy->second->notifyCollision(pos, *e, r);
-            return Collision(
-                iProxy->second->parent(),
-                m_tilemap.globalTileRect(ipos2));
-        }
-    } // if no entity at pos registered
-    return Collision();
+        if (tileId >= m_proxySlots.size())
+            return Collision();
+        c = component(m_proxySlots[tileId]);
+        if (!c)
+            return Collision();
+    }
+
+    // Notifying may change this TileCollideableInfo, so get the parent first.
+    Entity* const parent = c->parent();
+    if (e)
+        c->notifyCollision(pos, *e, r);
+    return Collision(parent, m_tilemap.globalTileRect(
+        sf::Vector2i(static_cast<int>(pos.x), static_cast<int>(pos.y))));
 }
 
 std::vector<Collision> TileCollideableInfo::colliding(
     sf::FloatRect const& r, Entity* e, std::vector<Vector3u>* positions)
 {
+    std::vector<Collision> result;
+    appendColliding(r, result, e, positions);
+    return result;
+}
+
+void TileCollideableInfo::appendColliding(
+    sf::FloatRect const& r, std::vector<Collision>& result,
+    Entity* e, std::vector<Vector3u>* positions, LayerMask const* layers)
+{
+    syncSize();
+
     sf::Vector2u begin;
     sf::Vector2u last;
     std::size_t const intersectingCount = mapCorners(r, begin, last);
 
-
-    std::vector<Collision> result;
     if (intersectingCount <= 0)
-        return result;
-    result.reserve(intersectingCount);
+        return;
 
-    Vector3u pos;
-    for (pos.z = 0; pos.z < m_tilemap.size().z; ++pos.z) {
-        for (pos.x = begin.x; pos.x <= last.x; ++pos.x) {
-            for (pos.y = begin.y; pos.y <= last.y; ++pos.y) {
-                auto const c = makeCollision(pos, e, r);
+    forEachLayer(layers, [&](unsigned z) -> bool {
+        Vector3u pos(0, 0, z);
+        for (pos.y = begin.y; pos.y <= last.y; ++pos.y) {
+            pos.x = begin.x;
+            std::size_t idx = index(pos);
+            for (; pos.x <= last.x; ++pos.x, ++idx) {
+                auto const c = makeCollision(pos, idx, e, r);
                 if (c.entity) {
                     if (positions)
                         positions->push_back(pos);
                     result.push_back(c);
                 }
-            } // for y
-        } // for x
-    } // for z
-    return result;
-}
-
-namespace {
-    std::array<sf::Vector2i, 8> surroundingTiles(sf::Vector2i p)
-    {
-        std::array<sf::Vector2i, 8> result;
-        result.fill(p);
-
-        // 012
-        // 3p4
-        // 567
-        --result[0].x; --result[0].y;
-                       --result[1].y;
-        ++result[2].x; --result[2].y;
-        --result[3].x;
-        ++result[4].x;
-        --result[5].x; ++result[5].y;
-                       ++result[6].y;
-        ++result[7].x; ++result[7].y;
-
-        return result;
-    }
+            } // for x
+        } // for y
+        return true;
+    });
 }
 
 std::vector<Collision> TileCollideableInfo::colliding(
     sf::Vector2f gp1, sf::Vector2f gp2, std::vector<Vector3u>* positions)
 {
-    sf::Vector2u p1;
-    sf::Vector2u p2;
-
     std::vector<Collision> result;
+    appendColliding(gp1, gp2, result, positions);
+    return result;
+}
 
-    if (!clipToMap(gp1, gp2, p1, p2))
-        return result;
-
-    result.reserve(static_cast<std::size_t>(
-        jd::math::abs(static_cast<sf::Vector2f>(p2 - p1)) * mapsize().z));
-
-    sf::Vector2u pos = p1;
-    sf::Vector2u lastPos = p1;
-    for (;;) {
-        Vector3u idx(pos.x, pos.y, 0);
-        for (; idx.z < m_tilemap.size().z; ++idx.z) {
-            auto const c = makeCollision(idx, nullptr, sf::FloatRect());
-            if (c.entity) {
-                if (positions)
-                    positions->push_back(idx);
-                result.push_back(c);
-            }
-        }
-        bool found;
-        sf::Vector2u const nextPos = findNext(pos, lastPos, p1, p2, &found);
-        if (!found)
-            break;
+void TileCollideableInfo::appendColliding(
+    sf::Vector2f gp1, sf::Vector2f gp2, std::vector<Collision>& result,
+    std::vector<Vector3u>* positions, LayerMask const* layers)
+{
+    forEachTileOnLine(gp1, gp2,
+        [&](sf::Vector2u pos2, sf::Vector2f, sf::Vector2i) -> bool {
+            forEachLayer(layers, [&](unsigned z) -> bool {
+                Vector3u const pos(pos2.x, pos2.y, z);
+                auto const c = makeCollision(
+                    pos, index(pos), nullptr, sf::FloatRect());
+                if (c.entity) {
+                    if (positions)
+                        positions->push_back(pos);
+                    result.push_back(c);
+                }
+                return true;
+            });
+            return true;
+        });
+}
 
-        lastPos = pos;
-        pos = nextPos;
-    }
-    return result;
+bool TileCollideableInfo::raycast(
+    sf::Vector2f lineStart, sf::Vector2f lineEnd, RaycastHit& hit)
+{
+    return raycast(lineStart, lineEnd, hit, nullptr);
 }
 
-bool TileCollideableInfo::clipToMap(
-    sf::Vector2f lineStart, sf::Vector2f lineEnd,
-    sf::Vector2u& clipStart, sf::Vector2u& clipEnd)
+bool TileCollideableInfo::raycast(
+    sf::Vector2f lineStart, sf::Vector2f lineEnd, RaycastHit& hit,
+    LayerMask const& layers)
 {
-    clipStart = static_cast<sf::Vector2u>(
-        m_tilemap.tilePosFromGlobal(lineStart));
-    clipEnd = static_cast<sf::Vector2u>(
-        m_tilemap.tilePosFromGlobal(lineEnd));
+    return raycast(lineStart, lineEnd, hit, &layers);
+}
 
-    if (!jd::clipLine(clipStart, clipEnd, sf::Rect<unsigned>(
-        0, 0, m_tilemap.size().x - 1, m_tilemap.size().y - 1)))
+bool TileCollideableInfo::raycast(
+    sf::Vector2f lineStart, sf::Vector2f lineEnd, RaycastHit& hit,
+    LayerMask const* layers)
+{
+    bool found = false;
+    forEachTileOnLine(lineStart, lineEnd,
+        [&](sf::Vector2u pos2, sf::Vector2f entry, sf::Vector2i normal) -> bool {
+            forEachLayer(layers, [&](unsigned z) -> bool {
+                Vector3u const pos(pos2.x, pos2.y, z);
+                auto const c = makeCollision(
+                    pos, index(pos), nullptr, sf::FloatRect());
+                if (c.entity) {
+                    found = true;
+                    hit.collision = c;
+                    hit.position = pos;
+                }
+                return !found;
+            });
+            if (found) {
+                hit.point = entry;
+                hit.normal = static_cast<sf::Vector2f>(normal);
+            }
+            return !found;
+        });
+    if (!found)
         return false;
+
+    // hit.point and hit.normal are still in tile coordinates.
+    sf::Transform const& transform = m_tilemap.getTransform();
+    sf::Vector2f const tileSize(m_tilemap.tileset().size());
+    hit.point = transform.transformPoint(
+        hit.point.x * tileSize.x, hit.point.y * tileSize.y);
+    hit.distance = jd::math::abs(hit.point - lineStart);
+    if (hit.normal != sf::Vector2f()) {
+        // Normals transform with the inverse transpose of the tile to global
+        // transformation, (transform * scale(tileSize)).
+        float const* const inv = m_tilemap.getInverseTransform().getMatrix();
+        sf::Vector2f const n(
+            hit.normal.x / tileSize.x, hit.normal.y / tileSize.y);
+        hit.normal = sf::Vector2f(
+            inv[0] * n.x + inv[1] * n.y,
+            inv[4] * n.x + inv[5] * n.y);
+        hit.normal /= jd::math::abs(hit.normal);
+    }
     return true;
 }
 
-sf::Vector2u TileCollideableInfo::findNext(
-    sf::Vector2u pos, sf::Vector2u oldPos_,
-    sf::Vector2u lineStart, sf::Vector2u lineEnd,
-    bool* found)
-{
-    sf::Vector2i const oldPos(oldPos_);
-    auto const surrounding(surroundingTiles(static_cast<sf::Vector2i>(pos)));
-    for (sf::Vector2i next : surrounding) {
-        using jd::vec_cast;
-        if (next != oldPos &&
-            m_tilemap.isValidPosition(jd::vec2to3(next, 0)) &&
-            jd::onLine(vec_cast<int>(lineStart), vec_cast<int>(lineEnd), next)
-        ) {
-            if (found)
-                *found = true;
-            return static_cast<sf::Vector2u>(next);
-        }
+bool TileCollideableInfo::lineToTileSpace(
+    sf::Vector2f& lineStart, sf::Vector2f& lineEnd, sf::Vector2i* startNormal)
+{
+    syncSize();
+    sf::Vector2f const tileSize(m_tilemap.tileset().size());
+    if (tileSize.x <= 0 || tileSize.y <= 0)
+        return false;
+
+    sf::Transform const& toLocal = m_tilemap.getInverseTransform();
+    lineStart = toLocal.transformPoint(lineStart);
+    lineEnd = toLocal.transformPoint(lineEnd);
+    lineStart.x /= tileSize.x;
+    lineStart.y /= tileSize.y;
+    lineEnd.x /= tileSize.x;
+    lineEnd.y /= tileSize.y;
+
+    sf::Vector2f const mapSize(
+        static_cast<float>(m_size.x), static_cast<float>(m_size.y));
+    if (startNormal) {
+        // The line enters the map through the side it reaches last.
+        sf::Vector2f const d = lineEnd - lineStart;
+        float tEnter = 0;
+        *startNormal = sf::Vector2i();
+        auto const checkSide = [&](
+            float start, float delta, float bound, sf::Vector2i normal)
+        {
+            float const t = (bound - start) / delta;
+            if (t > tEnter) {
+                tEnter = t;
+                *startNormal = normal;
+            }
+        };
+        if (lineStart.x < 0)
+            checkSide(lineStart.x, d.x, 0, sf::Vector2i(-1, 0));
+        else if (lineStart.x > mapSize.x)
+            checkSide(lineStart.x, d.x, mapSize.x, sf::Vector2i(1, 0));
+        if (lineStart.y < 0)
+            checkSide(lineStart.y, d.y, 0, sf::Vector2i(0, -1));
+        else if (lineStart.y > mapSize.y)
+            checkSide(lineStart.y, d.y, mapSize.y, sf::Vector2i(0, 1));
     }
-    if (found)
-        *found = false;
-    return pos;
+
+    return jd::clipLine(lineStart, lineEnd,
+        sf::FloatRect(0, 0, mapSize.x, mapSize.y));
 }
 
 std::size_t TileCollideableInfo::mapCorners(
@@ -250,113 +394,116 @@ std::size_t TileCollideableInfo::mapCorners(
 }
 
 
-template <typename Pred>
-std::vector<Collision> filter(
-        std::vector<Collision>&& collisions,
-        std::vector<Vector3u>&& positions,
-        Pred pred)
-{
-    std::size_t i = 0;
-    while (i < collisions.size()) {
-        if (!pred(positions[i].z)) {
-            auto off = static_cast<std::ptrdiff_t>(i);
-            collisions.erase(collisions.begin() + off);
-            positions.erase(positions.begin() + off);
-        } else {
-            ++i;
-        }
-    }
-    return collisions;
-}
-
 TileLayersCollideableGroup::TileLayersCollideableGroup(
     TileCollideableInfo* data,
     unsigned firstLayer, unsigned endLayer):
-    m_data(data),
-    m_firstLayer(firstLayer),
-    m_endLayer(endLayer)
+    m_data(data)
 {
-    // must call setEndLayer before setFirstLayer
-    // to check if map has enough layers
-    setEndLayer(endLayer);
-    setFirstLayer(firstLayer);
+    setLayerRange(firstLayer, endLayer);
 }
 
 
+unsigned TileLayersCollideableGroup::firstLayer() const
+{
+    std::size_t const first = m_layers.find_first();
+    return first == LayerMask::npos ? 0 : static_cast<unsigned>(first);
+}
 
 void TileLayersCollideableGroup::setFirstLayer(unsigned layer)
 {
-    if (layer >= m_endLayer)
-        throw std::out_of_range("first layer >= end layer");
-    assert(layer < m_data->mapsize().z);
-    m_firstLayer = layer;
+    setLayerRange(layer, endLayer());
 }
 
-void TileLayersCollideableGroup::setEndLayer(unsigned layer)
+unsigned TileLayersCollideableGroup::endLayer() const
 {
-    if (layer <= m_firstLayer)
-        throw std::out_of_range("end layer <= first layer");
-    if (layer >= m_data->mapsize().z)
-        throw std::out_of_range("end layer >= count of layers");
-    m_endLayer = layer;
+    for (std::size_t z = m_layers.size(); z > 0; --z) {
+        if (m_layers[z - 1])
+            return static_cast<unsigned>(z);
+    }
+    return 0;
 }
 
+void TileLayersCollideableGroup::setEndLayer(unsigned layer)
+{
+    setLayerRange(firstLayer(), layer);
+}
 
-std::vector<Collision> TileLayersCollideableGroup::colliding(
-    sf::FloatRect const& r, Entity* e)
+void TileLayersCollideableGroup::setLayerRange(
+    unsigned firstLayer, unsigned endLayer)
 {
-    if (m_firstLayer == m_endLayer) // was clear() called?
-        return std::vector<Collision>();
-    if (isUnfiltered())
-        return m_data->colliding(r, e);
+    if (firstLayer >= endLayer)
+        throw std::out_of_range("first layer >= end layer");
+    unsigned const layerCount = m_data->mapsize().z;
+    if (endLayer > layerCount)
+        throw std::out_of_range("end layer > count of layers");
+    m_layers.resize(layerCount);
+    m_layers.reset();
+    for (unsigned z = firstLayer; z < endLayer; ++z)
+        m_layers.set(z);
+}
 
-    std::vector<Vector3u> positions;
-    return filter(
-        m_data->colliding(r, e, &positions),
-        std::move(positions),
-        std::bind(&TileLayersCollideableGroup::layerInRange, this, std::placeholders::_1));
+void TileLayersCollideableGroup::setLayers(LayerMask const& layers)
+{
+    m_layers = layers;
 }
 
-std::vector<Collision> TileLayersCollideableGroup::colliding(
-    sf::Vector2f lineStart, sf::Vector2f lineEnd)
+bool TileLayersCollideableGroup::isLayerEnabled(unsigned layer) const
 {
-    if (m_firstLayer == m_endLayer) // was clear() called?
-        return std::vector<Collision>();
-    if (isUnfiltered())
-        return m_data->colliding(lineStart, lineEnd);
+    return layer < m_layers.size() && m_layers.test(layer);
+}
 
-    std::vector<Vector3u> positions;
-    return filter(
-        m_data->colliding(lineStart, lineEnd, &positions),
-        std::move(positions),
-        std::bind(&TileLayersCollideableGroup::layerInRange, this, std::placeholders::_1));
+void TileLayersCollideableGroup::setLayerEnabled(unsigned layer, bool enabled)
+{
+    if (layer >= m_data->mapsize().z)
+        throw std::out_of_range("layer >= count of layers");
+    if (layer >= m_layers.size())
+        m_layers.resize(layer + 1);
+    m_layers.set(layer, enabled);
 }
 
-bool TileLayersCollideableGroup::isUnfiltered() const {
-    return m_firstLayer == 0 && m_endLayer == m_data->mapsize().z;
+
+void TileLayersCollideableGroup::appendColliding(
+    sf::FloatRect const& r, std::vector<Collision>& result, Entity* e)
+{
+    if (m_layers.any())
+        m_data->appendColliding(r, result, e, nullptr, &m_layers);
 }
 
+void TileLayersCollideableGroup::appendColliding(
+    sf::Vector2f lineStart, sf::Vector2f lineEnd,
+    std::vector<Collision>& result)
+{
+    if (m_layers.any())
+        m_data->appendColliding(lineStart, lineEnd, result, nullptr, &m_layers);
+}
 
-std::vector<Collision> TileStackCollideableGroup::colliding(
-    sf::FloatRect const& r, Entity* e)
+bool TileLayersCollideableGroup::raycast(
+    sf::Vector2f lineStart, sf::Vector2f lineEnd,
+    TileCollideableInfo::RaycastHit& hit)
 {
-    std::vector<Collision> result;
+    return m_layers.any() && m_data->raycast(lineStart, lineEnd, hit, m_layers);
+}
+
 
+void TileStackCollideableGroup::appendColliding(
+    sf::FloatRect const& r, std::vector<Collision>& result, Entity* e)
+{
     if (!m_filter)
-        return result;
+        return;
 
     sf::Vector2u begin;
     sf::Vector2u last;
     std::size_t const intersectingCount = m_data->mapCorners(r, begin, last);
 
     if (intersectingCount <= 0)
-        return result;
-    result.reserve(intersectingCount);
+        return;
 
+    std::vector<Info> stack;
+    stack.swap(m_stack);
     Vector3u pos;
-    for (pos.x = begin.x; pos.x <= last.x; ++pos.x) {
-        for (pos.y = begin.y; pos.y <= last.y; ++pos.y) {
-            std::vector<Info> stack;
+    for (pos.y = begin.y; pos.y <= last.y; ++pos.y) {
+        for (pos.x = begin.x; pos.x <= last.x; ++pos.x) {
+            stack.clear();
             auto const pos2 = jd::vec3to2(pos);
 
             for (pos.z = 0; pos.z < m_data->mapsize().z; ++pos.z) {
@@ -371,9 +518,10 @@ std::vector<Collision> TileStackCollideableGroup::colliding(
                 stack,
                 result,
                 m_data->tilemap().globalTileRect(sf::Vector2i(pos2)));
-        } // for y
-    } // for x
-    return result;
+        } // for x
+    } // for y
+    stack.clear();
+    m_stack.swap(stack);
 }
 
 
@@ -388,48 +536,32 @@ void TileStackCollideableGroup::processStack(
 }
 
 
-std::vector<Collision> TileStackCollideableGroup::colliding(
-    sf::Vector2f gp1, sf::Vector2f gp2)
+void TileStackCollideableGroup::appendColliding(
+    sf::Vector2f gp1, sf::Vector2f gp2, std::vector<Collision>& result)
 {
-    std::vector<Collision> result;
-
     if (!m_filter)
-        return result;
-
-    sf::Vector2u p1;
-    sf::Vector2u p2;
-    if (!m_data->clipToMap(gp1, gp2, p1, p2))
-        return result;
-
-    result.reserve(static_cast<std::size_t>(
-        jd::math::abs(
-            jd::vec_cast<float>(p2) - jd::vec_cast<float>(p1)
-        ) * m_data->mapsize().z));
-
-    sf::Vector2u pos = p1;
-    sf::Vector2u lastPos = p1;
-    for (;;) {
-        std::vector<Info> stack;
-        Vector3u idx(pos.x, pos.y, 0);
-        for (; idx.z < m_data->mapsize().z; ++idx.z) {
-            auto const c = m_data->makeCollision(idx, nullptr, sf::FloatRect());
-            if (c.entity)
-                stack.emplace_back(m_data->tilemap()[idx], c.entity);
-            else
-                stack.emplace_back();
-        }
-        m_filter(pos, stack);
-        processStack(
-            stack, result, m_data->tilemap().globalTileRect(sf::Vector2i(pos)));
-
-        bool found;
-        sf::Vector2u const nextPos = m_data->findNext(pos, lastPos, p1, p2, &found);
-        if (!found)
-            break;
-        lastPos = pos;
-        pos = nextPos;
-    }
-    return result;
+        return;
+
+    std::vector<Info> stack;
+    stack.swap(m_stack);
+    m_data->forEachTileOnLine(gp1, gp2,
+        [&](sf::Vector2u pos, sf::Vector2f, sf::Vector2i) -> bool {
+            stack.clear();
+            Vector3u idx(pos.x, pos.y, 0);
+            for (; idx.z < m_data->mapsize().z; ++idx.z) {
+                auto const c = m_data->makeCollision(idx, nullptr, sf::FloatRect());
+                if (c.entity)
+                    stack.emplace_back(m_data->tilemap()[idx], c.entity);
+                else
+                    stack.emplace_back();
+            }
+            m_filter(pos, stack);
+            processStack(
+                stack, result, m_data->tilemap().globalTileRect(sf::Vector2i(pos)));
+            return true;
+        });
+    stack.clear();
+    m_stack.swap(stack);
 }
 
 
@@ -9,7 +9,11 @@
 #include "sfUtil.hpp" // std::hash<sf::Vector2<T>>
 #include "WeakRef.hpp"
 
+#include <boost/dynamic_bitset.hpp>
+
+#include <cstdint>
 #include <unordered_map>
+#include <vector>
 
 
 class TileCollisionComponent;
@@ -17,6 +21,9 @@ class TileCollisionComponent;
 namespace jd { class Tilemap; }
 typedef sf::Vector3<unsigned> Vector3u;
 
+// Bit z is set if layer z should be considered.
+typedef boost::dynamic_bitset<> LayerMask;
+
 class TileCollideableInfo: public EnableWeakRefFromThis<TileCollideableInfo> {
 public:
     TileCollideableInfo(jd::Tilemap& tilemap);
@@ -38,23 +45,68 @@ public:
         sf::Vector2f lineEnd,
         std::vector<Vector3u>* positions = nullptr);
 
+    // Like colliding(), but append to result and positions instead of
+    // returning a new vector. If layers is not null, only the layers in it
+    // are visited.
+    void appendColliding(
+        sf::FloatRect const&,
+        std::vector<Collision>& result,
+        Entity* e = nullptr,
+        std::vector<Vector3u>* positions = nullptr,
+        LayerMask const* layers = nullptr);
+
+    void appendColliding(
+        sf::Vector2f lineStart,
+        sf::Vector2f lineEnd,
+        std::vector<Collision>& result,
+        std::vector<Vector3u>* positions = nullptr,
+        LayerMask const* layers = nullptr);
+
     jd::Tilemap& tilemap() { return m_tilemap; }
     Vector3u mapsize() const;
 
-    void clear() { m_entities.clear(); m_proxyEntities.clear(); }
+    void clear();
 
     Collision makeCollision(
         Vector3u pos,
         Entity* notified = nullptr,
         sf::FloatRect const& foreignRect = sf::FloatRect());
 
-    bool clipToMap(
-        sf::Vector2f lineStart, sf::Vector2f lineEnd,
-        sf::Vector2u& clipStart, sf::Vector2u& clipEnd);
-    sf::Vector2u findNext(
-        sf::Vector2u pos, sf::Vector2u oldPos,
-        sf::Vector2u lineStart, sf::Vector2u lineEnd,
-        bool* found = nullptr);
+    struct RaycastHit {
+        RaycastHit(): distance(0) { }
+
+        Collision collision;
+        Vector3u position;   // of the hit tile
+        sf::Vector2f point;  // where the line enters the hit tile
+        float distance;      // from the line's start to point
+        sf::Vector2f normal; // of the entered tile side (or map border);
+                             // (0, 0) if the line starts inside the hit tile.
+    };
+
+    // Finds the first tile (on any layer) on the line from lineStart to
+    // lineEnd which has a TileCollisionComponent or proxy. Returns false if
+    // there is none.
+    bool raycast(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd, RaycastHit& hit);
+    bool raycast(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd, RaycastHit& hit,
+        LayerMask const& layers);
+
+    // Transforms the line to tile coordinates (one unit per tile) and clips
+    // it to the map. Returns false if the line does not touch the map.
+    // startNormal, if given, is set to the normal of the map side through
+    // which the line enters the map, or to (0, 0) if it starts inside.
+    bool lineToTileSpace(
+        sf::Vector2f& lineStart, sf::Vector2f& lineEnd,
+        sf::Vector2i* startNormal = nullptr);
+
+    // Calls f(pos, entry, normal) for each tile position the line from
+    // lineStart to lineEnd passes through, in order, until f returns false.
+    // entry is the point (in tile coordinates) where the line enters the
+    // tile; normal is as documented for jd::traverseGrid, except that it is
+    // the map side's normal for the first tile if the line starts outside.
+    template <typename F>
+    void forEachTileOnLine(sf::Vector2f lineStart, sf::Vector2f lineEnd, F f);
     std::size_t mapCorners(
         sf::FloatRect const& r,
         sf::Vector2u& begin,
@@ -62,11 +114,100 @@ public:
 private:
     TileCollideableInfo& operator= (TileCollideableInfo const&);
 
-    std::unordered_map<Vector3u, WeakRef<TileCollisionComponent>> m_entities;
-    std::unordered_map<unsigned, WeakRef<TileCollisionComponent>> m_proxyEntities;
+    // 0 means "no component", anything else is an index + 1 into
+    // m_components.
+    typedef std::uint32_t Slot;
+
+    Slot allocSlot(TileCollisionComponent* c);
+    void freeSlot(Slot s);
+    TileCollisionComponent* component(Slot s) const
+        { return s ? m_components[s - 1].getOpt() : nullptr; }
+
+    bool isOnMap(Vector3u pos) const
+        { return pos.x < m_size.x && pos.y < m_size.y && pos.z < m_size.z; }
+
+    // Same layout as jd::Tilemap's tile storage (layers of rows).
+    std::size_t index(Vector3u pos) const
+        { return (pos.z * m_size.y + pos.y) * m_size.x + pos.x; }
+
+    Slot slotAt(Vector3u pos) const;
+    void setSlotAt(Vector3u pos, Slot s);
+
+    // Adapts m_slots to the tilemap's size, if it has changed.
+    void syncSize();
+
+    // Calls f(z) for each layer in layers (all if layers is null) until f
+    // returns false.
+    template <typename F>
+    void forEachLayer(LayerMask const* layers, F f) const;
+
+    bool raycast(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd, RaycastHit& hit,
+        LayerMask const* layers);
+
+    Collision makeCollision(
+        Vector3u pos, std::size_t idx,
+        Entity* notified, sf::FloatRect const& foreignRect);
+
+    std::vector<WeakRef<TileCollisionComponent>> m_components;
+    std::vector<Slot> m_freeSlots;
+
+    Vector3u m_size; // Size of the tilemap m_slots was made for.
+    std::vector<Slot> m_slots;
+
+    // Components may be set at positions outside of the map, e.g. for
+    // entities which have left it.
+    std::unordered_map<Vector3u, Slot> m_offMapSlots;
+
+    std::vector<Slot> m_proxySlots; // Indexed by tile ID.
+
     jd::Tilemap& m_tilemap;
 };
 
+template <typename F>
+void TileCollideableInfo::forEachLayer(LayerMask const* layers, F f) const
+{
+    if (!layers) {
+        for (unsigned z = 0; z < m_size.z; ++z) {
+            if (!f(z))
+                return;
+        }
+        return;
+    }
+    for (std::size_t z = layers->find_first();
+         z != LayerMask::npos && z < m_size.z;
+         z = layers->find_next(z)
+    ) {
+        if (!f(static_cast<unsigned>(z)))
+            return;
+    }
+}
+
+template <typename F>
+void TileCollideableInfo::forEachTileOnLine(
+    sf::Vector2f lineStart, sf::Vector2f lineEnd, F f)
+{
+    sf::Vector2i startNormal;
+    if (!lineToTileSpace(lineStart, lineEnd, &startNormal))
+        return;
+    sf::Vector2f const d = lineEnd - lineStart;
+    Vector3u const size = m_size;
+    jd::traverseGrid(lineStart, lineEnd, sf::Vector2f(1, 1),
+        [&](sf::Vector2i pos, float t, sf::Vector2i normal) -> bool {
+            // Clipping may leave the line ending exactly on the map border.
+            if (pos.x < 0 || pos.y < 0 ||
+                static_cast<unsigned>(pos.x) >= size.x ||
+                static_cast<unsigned>(pos.y) >= size.y
+            ) {
+                return true;
+            }
+            // Only the first tile has no normal.
+            return f(
+                static_cast<sf::Vector2u>(pos), lineStart + d * t,
+                normal == sf::Vector2i() ? startNormal : normal);
+        });
+}
+
 class TileLayersCollideableGroup: public CollideableGroup {
 public:
     TileLayersCollideableGroup(
@@ -75,31 +216,38 @@ public:
 
     WeakRef<TileCollideableInfo> data() { return m_data; }
 
-    unsigned firstLayer() const { return m_firstLayer; }
+    // Lowest enabled layer and one past the highest enabled layer; both 0 if
+    // no layer is enabled. The setters enable exactly the layers in
+    // [firstLayer, endLayer).
+    unsigned firstLayer() const;
     void setFirstLayer(unsigned layer);
-    unsigned endLayer() const { return m_endLayer; }
+    unsigned endLayer() const;
     void setEndLayer(unsigned layer);
 
+    LayerMask const& layers() const { return m_layers; }
+    void setLayers(LayerMask const& layers);
+    bool isLayerEnabled(unsigned layer) const;
+    void setLayerEnabled(unsigned layer, bool enabled);
+
+    bool raycast(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd,
+        TileCollideableInfo::RaycastHit& hit);
 
-    virtual std::vector<Collision> colliding(
-        sf::FloatRect const&, Entity* e = nullptr) override;
+    virtual void appendColliding(
+        sf::FloatRect const&, std::vector<Collision>& result,
+        Entity* e = nullptr) override;
 
-    virtual std::vector<Collision> colliding(
-        sf::Vector2f lineStart, sf::Vector2f lineEnd) override;
+    virtual void appendColliding(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd,
+        std::vector<Collision>& result) override;
 
-    virtual void clear()  override { m_firstLayer = m_endLayer; }
+    virtual void clear()  override { m_layers.reset(); }
 
 private:
-    bool layerInRange(unsigned layer) const
-    {
-        return layer >= m_firstLayer && layer < m_endLayer;
-    }
-
-    bool isUnfiltered() const;
+    void setLayerRange(unsigned firstLayer, unsigned endLayer);
 
     WeakRef<TileCollideableInfo> m_data;
-    unsigned m_firstLayer;
-    unsigned m_endLayer;
+    LayerMask m_layers;
 };
 
 class TileStackCollideableGroup: public CollideableGroup {
@@ -124,11 +272,13 @@ public:
         m_filter(filter)
     { }
 
-    virtual std::vector<Collision> colliding(
-        sf::FloatRect const&, Entity* e = nullptr) override;
+    virtual void appendColliding(
+        sf::FloatRect const&, std::vector<Collision>& result,
+        Entity* e = nullptr) override;
 
-    virtual std::vector<Collision> colliding(
-        sf::Vector2f lineStart, sf::Vector2f lineEnd) override;
+    virtual void appendColliding(
+        sf::Vector2f lineStart, sf::Vector2f lineEnd,
+        std::vector<Collision>& result) override;
 
     virtual void clear() override { m_filter = FilterCallback(); }
 
@@ -143,6 +293,7 @@ private:
 
     WeakRef<TileCollideableInfo> m_data;
     FilterCallback m_filter;
+    std::vector<Info> m_stack; // Reused for each tile's stack.
 };
 
 #endif
@@ -0,0 +1,213 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+# This file is subject to the terms of the BSD 2-Clause License.
+# See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+"""Compiles TMX maps to the binary *.jdmap format read by loadTilemap().
+
+Usage: compileMap.py MAP.tmx [OUTPUT.jdmap]
+
+The format is documented in MapInfo.cpp. Values are written in the byte
+order of the machine running this script, which must therefore match the
+one of the machine running the game.
+"""
+
+from __future__ import print_function
+
+import base64
+import os.path
+import struct
+import sys
+import xml.etree.ElementTree as ET
+import zlib
+
+MAGIC = 0x424D444A # "JDMB"
+VERSION = 1
+BYTE_ORDER_MARK = 0x01020304
+
+# MapObject::T
+OBJT_RECT, OBJT_TILE, OBJT_LINE, OBJT_POLY = range(4)
+
+
+class MapError(Exception):
+    pass
+
+
+class MetadataWriter(object):
+    def __init__(self):
+        self.data = bytearray()
+        self.strings = []
+        self.stringIds = {}
+
+    def u32(self, v):
+        self.data += struct.pack("=I", v)
+
+    def f32(self, v):
+        self.data += struct.pack("=f", v)
+
+    def string(self, s):
+        if s not in self.stringIds:
+            self.stringIds[s] = len(self.strings)
+            self.strings.append(s)
+        self.u32(self.stringIds[s])
+
+    def properties(self, props):
+        self.u32(len(props))
+        for key, value in sorted(props.items()):
+            self.string(key)
+            self.string(value)
+
+    def result(self):
+        table = bytearray(struct.pack("=I", len(self.strings)))
+        for s in self.strings:
+            encoded = s.encode("utf-8")
+            table += struct.pack("=I", len(encoded))
+            table += encoded
+            table += b"\0" * ((4 - len(encoded) % 4) % 4)
+        return bytes(table + self.data)
+
+
+def loadProperties(parent):
+    props = parent.find("properties")
+    if props is None:
+        return {}
+    result = {}
+    for p in props:
+        if p.tag != "property":
+            print("Warning: unknown tag in properties:", p.tag, file=sys.stderr)
+            continue
+        # Multi-line values are stored as text instead of an attribute.
+        value = p.get("value")
+        result[p.get("name")] = value if value is not None else (p.text or "")
+    return result
+
+
+def loadTileset(elem, mapdir):
+    source = elem.get("source")
+    if source is not None:
+        path = os.path.join(mapdir, source)
+        return loadTileset(ET.parse(path).getroot(), os.path.dirname(path))
+
+    image = elem.find("image")
+    tileProperties = []
+    for tile in elem.findall("tile"):
+        props = loadProperties(tile)
+        if props:
+            tileProperties.append((int(tile.get("id")), props))
+    return {
+        "tileSize": (int(elem.get("tilewidth")), int(elem.get("tileheight"))),
+        "image": image.get("source"),
+        "trans": image.get("trans", ""),
+        "tileProperties": tileProperties}
+
+
+def loadPoints(elem):
+    coordinates = elem.get("points", "").replace(",", " ").split()
+    if len(coordinates) % 2 != 0:
+        print("Warning: coordinate missing for point; ignoring last coordinate",
+              file=sys.stderr)
+        coordinates.pop()
+    coordinates = [float(c) for c in coordinates]
+    return list(zip(coordinates[0::2], coordinates[1::2]))
+
+
+def loadLayerData(layer, z, tileCount):
+    data = layer.find("data")
+    if data.get("encoding") != "base64":
+        raise MapError("layer#{0}: encoding \"{1}\" not supported".format(
+            z, data.get("encoding")))
+    raw = base64.b64decode("".join(data.text.split()))
+    compression = data.get("compression", "")
+    if compression in ("zlib", "gzip"):
+        raw = zlib.decompress(raw, 32 + zlib.MAX_WBITS) # Detects the header.
+    elif compression:
+        raise MapError("layer#{0}: compression \"{1}\" not supported".format(
+            z, compression))
+    if len(raw) != tileCount * 4:
+        raise MapError("layer#{0}: wrong data size".format(z))
+    tiles = struct.unpack("<{0}I".format(tileCount), raw)
+    return struct.pack("={0}I".format(tileCount), *tiles)
+
+
+def compileMap(inPath, outPath):
+    root = ET.parse(inPath).getroot()
+    width, height = int(root.get("width")), int(root.get("height"))
+    layers = root.findall("layer")
+    if width * height * len(layers) == 0:
+        raise MapError("map is empty")
+
+    tileset = loadTileset(root.find("tileset"), os.path.dirname(inPath))
+    meta = MetadataWriter()
+    meta.u32(tileset["tileSize"][0])
+    meta.u32(tileset["tileSize"][1])
+    meta.string(tileset["image"])
+    meta.string(tileset["trans"])
+    meta.properties(loadProperties(root))
+    meta.u32(len(tileset["tileProperties"]))
+    for tileId, props in tileset["tileProperties"]:
+        meta.u32(tileId)
+        meta.properties(props)
+
+    for layer in layers:
+        meta.properties(loadProperties(layer))
+
+    groups = root.findall("objectgroup")
+    meta.u32(len(groups))
+    for group in groups:
+        meta.string(group.get("name"))
+        meta.properties(loadProperties(group))
+        objects = group.findall("object")
+        meta.u32(len(objects))
+        for o in objects:
+            x, y = float(o.get("x")), float(o.get("y"))
+            tileId = int(o.get("gid", 0))
+            points = []
+            if tileId:
+                objectType = OBJT_TILE
+                y -= tileset["tileSize"][1] # Assuming orthogonal orientation.
+            elif o.find("polyline") is not None:
+                objectType = OBJT_LINE
+                points = loadPoints(o.find("polyline"))
+            elif o.find("polygon") is not None:
+                objectType = OBJT_POLY
+                points = loadPoints(o.find("polygon"))
+            else:
+                objectType = OBJT_RECT
+            meta.u32(objectType)
+            meta.string(o.get("name", ""))
+            meta.string(o.get("type", ""))
+            meta.f32(x)
+            meta.f32(y)
+            meta.f32(float(o.get("width", 0)))
+            meta.f32(float(o.get("height", 0)))
+            meta.u32(tileId)
+            meta.properties(loadProperties(o))
+            meta.u32(len(points))
+            for px, py in points:
+                meta.f32(px)
+                meta.f32(py)
+
+    metadata = meta.result()
+    with open(outPath, "wb") as f:
+        f.write(struct.pack(
+            "=7I", MAGIC, VERSION, BYTE_ORDER_MARK,
+            width, height, len(layers), len(metadata)))
+        f.write(metadata)
+        for z, layer in enumerate(layers):
+            f.write(loadLayerData(layer, z, width * height))
+
+
+if __name__ == "__main__":
+    if not 2 <= len(sys.argv) <= 3:
+        print(__doc__, file=sys.stderr)
+        sys.exit(2)
+    inPath = sys.argv[1]
+    outPath = sys.argv[2] if len(sys.argv) > 2 else \
+        os.path.splitext(inPath)[0] + ".jdmap"
+    try:
+        compileMap(inPath, outPath)
+    except MapError as e:
+        print("Error:", e, file=sys.stderr)
+        sys.exit(1)
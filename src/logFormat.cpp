@@ -0,0 +1,327 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "logFormat.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iomanip>
+#include <istream>
+#include <sstream>
+
+
+namespace {
+
+char const binaryMagic[] = "JDLOG\1"; // Includes the format version.
+std::size_t const binaryMagicSize = sizeof(binaryMagic) - 1;
+
+enum : unsigned char { locationTag = 0, firstMessageTag = 1 };
+
+std::string const printableTime(boost::int64_t microseconds)
+{
+    std::stringstream str;
+    str << std::setprecision(6) << std::fixed << microseconds / 1e6;
+    return str.str();
+}
+
+std::string const filterHtml(std::string const& s)
+{
+    std::string result;
+    result.reserve(s.size() * 3 / 2);
+    for (char const c : s) switch (c)
+    {
+        case '<':
+            result += "&lt;";
+            break;
+        case '>':
+            result += "&gt;";
+            break;
+        case '&':
+            result += "&amp;";
+            break;
+        case '"':
+            result += "&quot;";
+            break;
+        default:
+            result += c;
+            break;
+    }
+    return result;
+}
+
+void appendVarint(std::string& out, boost::uint64_t n)
+{
+    while (n >= 0x80) {
+        out += static_cast<char>((n & 0x7f) | 0x80);
+        n >>= 7;
+    }
+    out += static_cast<char>(n);
+}
+
+boost::uint64_t zigzag(boost::int64_t n)
+{
+    return (static_cast<boost::uint64_t>(n) << 1) ^
+        static_cast<boost::uint64_t>(n >> 63);
+}
+
+boost::int64_t unzigzag(boost::uint64_t n)
+{
+    return static_cast<boost::int64_t>(n >> 1) ^ -static_cast<boost::int64_t>(n & 1);
+}
+
+void appendString(std::string& out, std::string const& s)
+{
+    appendVarint(out, s.size());
+    out += s;
+}
+
+// Returns false if in is at its end before the first byte.
+bool readVarint(std::istream& in, boost::uint64_t& result)
+{
+    result = 0;
+    for (unsigned shift = 0; ; shift += 7) {
+        int const c = in.get();
+        if (c == std::char_traits<char>::eof()) {
+            if (shift == 0)
+                return false;
+            throw logformat::FormatError("truncated binary log (in number)");
+        }
+        if (shift >= 64)
+            throw logformat::FormatError("invalid number in binary log");
+        result |= static_cast<boost::uint64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+}
+
+boost::uint64_t readRequiredVarint(std::istream& in)
+{
+    boost::uint64_t result;
+    if (!readVarint(in, result))
+        throw logformat::FormatError("truncated binary log (entry incomplete)");
+    return result;
+}
+
+void readString(std::istream& in, std::string& result)
+{
+    // Do not trust the size with the allocation: the file may be corrupted.
+    static boost::uint64_t const chunkSize = 4096;
+    boost::uint64_t size = readRequiredVarint(in);
+    result.clear();
+    while (size > 0) {
+        std::size_t const n = static_cast<std::size_t>(
+            std::min(size, chunkSize));
+        std::size_t const oldSize = result.size();
+        result.resize(oldSize + n);
+        if (!in.read(&result[oldSize], n))
+            throw logformat::FormatError("truncated binary log (in string)");
+        size -= n;
+    }
+}
+
+} // anonymous namespace
+
+
+namespace logformat {
+
+logstyle styleFromFilename(std::string const& filename)
+{
+    std::string::size_type const posDot = filename.rfind('.');
+    std::string const extension = posDot == std::string::npos ?
+        "" : filename.substr(posDot);
+    if (extension == ".html" || extension == ".htm")
+        return logstyle::html;
+    if (extension == ".jdlog")
+        return logstyle::binary;
+    return logstyle::plain;
+}
+
+std::string header(logstyle style)
+{
+    switch (style) {
+        case logstyle::html:
+            return "<html> <head> <title>Logfile</title>"
+                   "<link rel=\"stylesheet\" href=\"logstyle.css\" type=\"text/css\"/> </head>\n"
+                   "<body ><h1>Logfile</h1>\n<table> <thead><tr> "
+                   "<td>Level</td> <td>Time(s)</td> <td>Location</td> <td>Message</td> </tr></thead><tbody>\n";
+        case logstyle::binary:
+            return std::string(binaryMagic, binaryMagicSize);
+        default:
+            return "===< LOGFILE >===\n\n"
+                   "Level      Time(s)    Location                              Message\n"
+                   "---------- ---------- ------------------------------------- ----------" \
+                   "----------------------------------------\n";
+    }
+}
+
+std::string footer(logstyle style)
+{
+    return style == logstyle::html ?
+        "\n</tbody></table> </body> </html>\n" : std::string();
+}
+
+std::string formatText(
+    logstyle style,
+    loglevel level_,
+    char const* location,
+    boost::int64_t microseconds,
+    std::string const& msg)
+{
+    auto const level = static_cast<unsigned>(level_);
+
+    static auto const maxloglevel = static_cast<int>(loglevel::max);
+    static_assert(maxloglevel == 5, "Please correct levelnames below!");
+    static const std::array<const char* const, maxloglevel> levelnames =
+        { "debug", "info", "warning", "error", "fatal" };
+    static const std::array<const char* const, maxloglevel> levelpreambles =
+        { "    ", "   _", "  + ", " *  ", "!>>>" };
+
+    std::string fmt;
+    std::string real_msg;
+    real_msg.reserve(msg.size());
+
+    if (style == logstyle::html)
+    {
+        real_msg = filterHtml(msg);
+        fmt = str(boost::format("<tr class=\"%1%\"><td>%1%</td>") % levelnames[level]) +
+            "<td>%1%</td><td>%2%</td><td><pre>%3%</pre></td></tr>";
+    }
+    else // if (style == logstyle::plain)
+    {
+        fmt = levelpreambles[level] + str(boost::format("%|-8|") % levelnames[level]) + "%|9| %|-37| %||";
+        std::string msg2 = msg;
+        if (!msg.empty() && msg.back() == '\n')
+            msg2.pop_back();
+
+        // Add indentation to linebreaks
+        for (const char c : msg2) switch (c)
+        {
+            case '\n':
+                real_msg += "\n" + std::string(60, ' ');
+                break;
+            default:
+                real_msg += c;
+                break;
+        }
+    }
+
+    std::string filename(location ? location : "<unknown>");
+    if (location) {
+        std::string::size_type posSrc;
+#ifdef _WIN32
+        posSrc = filename.rfind("src\\");
+        if (posSrc == std::string::npos)
+#endif
+            posSrc = filename.rfind("src/");
+        if (posSrc != std::string::npos)
+            filename.erase(0, posSrc + 4);
+    }
+    return str(boost::format(fmt)
+        % printableTime(microseconds)
+        % (style == logstyle::html ? filterHtml(filename) : filename)
+        % real_msg) + '\n';
+}
+
+
+BinaryWriter::BinaryWriter():
+    m_locationCount(0),
+    m_lastTime(0)
+{ }
+
+unsigned BinaryWriter::internLocation(
+    std::string& out, char const* location, std::string const* dynamicLocation)
+{
+    if (location) {
+        auto const it = m_staticLocations.find(location);
+        if (it != m_staticLocations.end())
+            return it->second;
+    } else if (dynamicLocation) {
+        auto const it = m_dynamicLocations.find(*dynamicLocation);
+        if (it != m_dynamicLocations.end())
+            return it->second;
+    } else {
+        return 0;
+    }
+
+    unsigned const id = ++m_locationCount;
+    out += static_cast<char>(locationTag);
+    appendVarint(out, id);
+    if (location) {
+        appendString(out, location);
+        m_staticLocations[location] = id;
+    } else {
+        appendString(out, *dynamicLocation);
+        m_dynamicLocations[*dynamicLocation] = id;
+    }
+    return id;
+}
+
+void BinaryWriter::append(
+    std::string& out,
+    loglevel level,
+    char const* location,
+    std::string const* dynamicLocation,
+    boost::int64_t microseconds,
+    std::string const& message)
+{
+    unsigned const locationId = internLocation(out, location, dynamicLocation);
+    out += static_cast<char>(firstMessageTag + static_cast<unsigned>(level));
+    appendVarint(out, zigzag(microseconds - m_lastTime));
+    m_lastTime = microseconds;
+    appendVarint(out, locationId);
+    appendString(out, message);
+}
+
+
+BinaryReader::BinaryReader(std::istream& in):
+    m_in(in),
+    m_lastTime(0)
+{
+    char magic[binaryMagicSize];
+    if (!m_in.read(magic, binaryMagicSize) ||
+        std::memcmp(magic, binaryMagic, binaryMagicSize) != 0
+    ) {
+        throw FormatError("not a binary log (or unsupported version)");
+    }
+}
+
+bool BinaryReader::read(BinaryRecord& record)
+{
+    for (;;) {
+        int const tag = m_in.get();
+        if (tag == std::char_traits<char>::eof())
+            return false;
+
+        if (tag == locationTag) {
+            boost::uint64_t const id = readRequiredVarint(m_in);
+            if (id != m_locations.size() + 1)
+                throw FormatError("unexpected location ID in binary log");
+            m_locations.push_back(std::string());
+            readString(m_in, m_locations.back());
+            continue;
+        }
+
+        unsigned const level = static_cast<unsigned>(tag - firstMessageTag);
+        if (level >= static_cast<unsigned>(loglevel::max))
+            throw FormatError("invalid entry tag in binary log");
+        record.level = static_cast<loglevel>(level);
+
+        m_lastTime += unzigzag(readRequiredVarint(m_in));
+        record.microseconds = m_lastTime;
+
+        boost::uint64_t const locationId = readRequiredVarint(m_in);
+        if (locationId > m_locations.size())
+            throw FormatError("undefined location ID in binary log");
+        record.location = locationId == 0 ?
+            nullptr : &m_locations[static_cast<std::size_t>(locationId - 1)];
+
+        readString(m_in, record.message);
+        return true;
+    }
+}
+
+} // namespace logformat
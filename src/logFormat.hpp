@@ -0,0 +1,107 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef LOG_FORMAT_HPP_INCLUDED
+#define LOG_FORMAT_HPP_INCLUDED LOG_FORMAT_HPP_INCLUDED
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <deque>
+#include <iosfwd>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+
+enum class loglevel { debug, info, warning, error, fatal,  max  };
+enum class logstyle { html, plain, binary, like_extension,  max };
+
+// The file formats written by Logfile, separated from it so that tools
+// reading log files can use them too.
+namespace logformat {
+
+// Returns the style for a file name with the given extension: html for
+// ".html" and ".htm", binary for ".jdlog" and plain for anything else.
+logstyle styleFromFilename(std::string const& filename);
+
+// Text which starts or ends a log file of the given style.
+std::string header(logstyle style);
+std::string footer(logstyle style);
+
+// Returns the line for one message (with a trailing newline); style must
+// be html or plain. location may be nullptr.
+std::string formatText(
+    logstyle style,
+    loglevel level,
+    char const* location,
+    boost::int64_t microseconds,
+    std::string const& message);
+
+// The binary style is a header followed by entries, each of which starts
+// with a tag byte:
+//  - 0 (location): varint ID, varint length, location string.
+//  - 1 + loglevel (message): zigzag varint time difference to the previous
+//    message in microseconds, varint location ID (0 if unknown), varint
+//    length, message string.
+// Each location string is written only once, before the first message
+// using it. Varints are unsigned LEB128 (7 bits per byte, low bits first).
+class BinaryWriter: private boost::noncopyable {
+public:
+    BinaryWriter();
+
+    // location is interned by address (so it must have static storage
+    // duration); dynamicLocation, which is used if location is nullptr, by
+    // content. Both may be nullptr.
+    void append(
+        std::string& out,
+        loglevel level,
+        char const* location,
+        std::string const* dynamicLocation,
+        boost::int64_t microseconds,
+        std::string const& message);
+
+private:
+    unsigned internLocation(
+        std::string& out, char const* location,
+        std::string const* dynamicLocation);
+
+    std::unordered_map<char const*, unsigned> m_staticLocations;
+    std::unordered_map<std::string, unsigned> m_dynamicLocations;
+    unsigned m_locationCount;
+    boost::int64_t m_lastTime;
+};
+
+struct BinaryRecord {
+    loglevel level;
+    std::string const* location; // nullptr if unknown.
+    boost::int64_t microseconds;
+    std::string message;
+};
+
+class FormatError: public std::runtime_error {
+public:
+    explicit FormatError(std::string const& msg): std::runtime_error(msg) { }
+};
+
+// Reads the output of BinaryWriter (including header(logstyle::binary)).
+class BinaryReader: private boost::noncopyable {
+public:
+    // Throws FormatError if in does not start with the binary header.
+    explicit BinaryReader(std::istream& in);
+
+    // Returns false at the end of the input. Throws FormatError if the
+    // input is malformed or truncated. record.location stays valid as long
+    // as the reader.
+    bool read(BinaryRecord& record);
+
+private:
+    std::istream& m_in;
+    std::deque<std::string> m_locations; // Index is location ID - 1.
+    boost::int64_t m_lastTime;
+};
+
+} // namespace logformat
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "luaUtils.hpp"
 
+#include "profiling.hpp"
 #include "svc/FileSystem.hpp"
 
 #include <boost/lexical_cast.hpp>
@@ -86,6 +87,7 @@ std::string const errstring(int luaerr)
 
 void pcall(lua_State* L, int nargs, int nresults)
 {
+    JD_PROFILE_ZONE("luaU::pcall");
     int const msghidx = lua_absindex(L, -nargs - 1);
     lua_pushcfunction(L, luabind::get_pcall_callback());
     lua_insert(L, msghidx); // move beneath arguments and function
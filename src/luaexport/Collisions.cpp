@@ -4,13 +4,16 @@
 
 #include "collision/Collisions.hpp"
 
+#include "collision/AabbTreeCollideableGroup.hpp"
 #include "collision/RectCollideableGroup.hpp"
+#include "collision/ShapeCollideableGroup.hpp"
 #include "collision/TileCollideableGroup.hpp"
 #include "comp/TileCollisionComponent.hpp"
 #include "comp/PositionComponent.hpp"
 #include "compsys/Entity.hpp"
 #include "container.hpp"
 #include "LuaFunction.hpp"
+#include "MapInfo.hpp"
 #include "SfBaseTypes.hpp"
 #include "sfUtil.hpp"
 #include "Tilemap.hpp"
@@ -57,6 +60,19 @@ static std::vector<Collision> const CollideableGroup_colliding(
     return self.colliding(r);
 }
 
+static std::size_t ShapeCollideableGroup_addPoints(
+    ShapeCollideableGroup& this_,
+    std::vector<sf::Vector2f> const& points, bool closed)
+{
+    return this_.add(points, closed);
+}
+
+static std::size_t ShapeCollideableGroup_addObject(
+    ShapeCollideableGroup& this_, MapObject const& o)
+{
+    return this_.add(o);
+}
+
 static void TileStackCollideableGroup_callFilter(
     luabind::object& filter,
     sf::Vector2u pos,
@@ -166,11 +182,27 @@ static void init(LuaVm& vm)
             .def("colliding",
                 (CollisionVec (LHCURCLASS::*)(sf::Vector2f, sf::Vector2f))
                     &LHCURCLASS::colliding)
+            .def("appendColliding",
+                (void (LHCURCLASS::*)(sf::FloatRect const&, CollisionVec&, Entity*))
+                    &LHCURCLASS::appendColliding)
+            .def("appendColliding",
+                (void (LHCURCLASS::*)(sf::Vector2f, sf::Vector2f, CollisionVec&))
+                    &LHCURCLASS::appendColliding)
             .LHMEMFN(collideWith)
             .LHMEMFN(collide)
             .LHMEMFN(clear),
 #       undef LHCURCLASS
 
+#       define LHCURCLASS TileCollideableInfo::RaycastHit
+        class_<LHCURCLASS>("TileRaycastHit")
+            .def(constructor<>())
+            .LHPROPRW(collision)
+            .LHPROPRW(position)
+            .LHPROPRW(point)
+            .LHPROPRW(distance)
+            .LHPROPRW(normal),
+#       undef LHCURCLASS
+
 #       define LHCURCLASS TileCollideableInfo
         LHCLASS
             .def(constructor<jd::Tilemap&>())
@@ -184,6 +216,9 @@ static void init(LuaVm& vm)
                 (CollisionVec (LHCURCLASS::*)(sf::Vector2f, sf::Vector2f, PositionVec*))
                     &LHCURCLASS::colliding, pure_out_value(_4))
             .def("colliding", &TileCollideableInfo_colliding)
+            .def("raycast",
+                (bool (LHCURCLASS::*)(sf::Vector2f, sf::Vector2f, LHCURCLASS::RaycastHit&))
+                    &LHCURCLASS::raycast, pure_out_value(_4))
             .LHPROPG(tilemap),
 #       undef LHCURCLASS
 
@@ -192,6 +227,9 @@ static void init(LuaVm& vm)
             .def(constructor<TileCollideableInfo*, unsigned, unsigned>())
             .property("firstLayer", &LHCURCLASS::firstLayer, &LHCURCLASS::setFirstLayer)
             .property("endLayer", &LHCURCLASS::endLayer, &LHCURCLASS::setEndLayer)
+            .LHMEMFN(isLayerEnabled)
+            .LHMEMFN(setLayerEnabled)
+            .def("raycast", &LHCURCLASS::raycast, pure_out_value(_4))
             .LHPROPG(data),
 #       undef LHCURCLASS
 
@@ -215,13 +253,46 @@ static void init(LuaVm& vm)
             ],
 #       undef LHCURCLASS
 
-#       define LHCURCLASS RectCollideableGroup
-        class_<LHCURCLASS, CollideableGroup>("RectCollideableGroup")
-            .def(constructor<>())
+#       define LHCURCLASS PositionCollideableGroup
+        class_<LHCURCLASS, CollideableGroup>("PositionCollideableGroup")
             .LHMEMFN(add)
             .LHMEMFN(remove),
 #       undef LHCURCLASS
 
+#       define LHCURCLASS RectCollideableGroup
+        class_<LHCURCLASS, PositionCollideableGroup>("RectCollideableGroup")
+            .def(constructor<>())
+            .def(constructor<float>())
+            .property("cellSize", &LHCURCLASS::cellSize, &LHCURCLASS::setCellSize)
+            .property("broadphase",
+                &LHCURCLASS::broadphase, &LHCURCLASS::setBroadphase)
+            .enum_("broadphase") [
+                value("GRID", LHCURCLASS::Broadphase::grid),
+                value("SWEEP_AND_PRUNE", LHCURCLASS::Broadphase::sweepAndPrune)
+            ],
+#       undef LHCURCLASS
+
+#       define LHCURCLASS AabbTreeCollideableGroup
+        class_<LHCURCLASS, PositionCollideableGroup>("AabbTreeCollideableGroup")
+            .def(constructor<>())
+            .def(constructor<float>())
+            .property("margin", &LHCURCLASS::margin, &LHCURCLASS::setMargin),
+#       undef LHCURCLASS
+
+#       define LHCURCLASS ShapeCollideableGroup
+        class_<LHCURCLASS, CollideableGroup>("ShapeCollideableGroup")
+            .def(constructor<>())
+            .def("add", &ShapeCollideableGroup_addPoints)
+            .def("add", &ShapeCollideableGroup_addObject)
+            .def("add", static_cast<std::size_t(LHCURCLASS::*)(
+                std::vector<sf::Vector2f> const&, bool, Entity*)>(
+                    &LHCURCLASS::add))
+            .def("add", static_cast<std::size_t(LHCURCLASS::*)(
+                MapObject const&, Entity*)>(&LHCURCLASS::add))
+            .LHMEMFN(remove)
+            .LHPROPG(count),
+#       undef LHCURCLASS
+
 #       define LHCURCLASS CollideableGroupGroup
         class_<LHCURCLASS, CollideableGroup>("CollideableGroupGroup")
             .def(constructor<>())
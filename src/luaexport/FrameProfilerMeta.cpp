@@ -0,0 +1,57 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "svc/FrameProfiler.hpp"
+#include "ProfilerOverlay.hpp"
+#include "ressys/VFileFont.hpp"
+
+static char const libname[] = "FrameProfiler";
+#include "ExportThis.hpp"
+
+
+// Returns an array with a table {name, depth, min, average, p99, max} for
+// each timer, in the order they were added.
+static luabind::object FrameProfiler_report(
+    FrameProfiler const& profiler, lua_State* L)
+{
+    luabind::object result = luabind::newtable(L);
+    int i = 0;
+    for (FrameProfiler::TimerId timer : profiler.timers()) {
+        ProfileStats const stats = profiler.stats(timer);
+        luabind::object entry = luabind::newtable(L);
+        entry["name"] = profiler.timerName(timer);
+        entry["depth"] = profiler.timerDepth(timer);
+        entry["min"] = stats.min;
+        entry["average"] = stats.average;
+        entry["p99"] = stats.p99;
+        entry["max"] = stats.max;
+        result[++i] = entry;
+    }
+    return result;
+}
+
+static void init(LuaVm& vm)
+{
+    vm.initLib("SfGraphics");
+    LHMODULE [
+#       define LHCURCLASS FrameProfiler
+        LHCLASS
+            .property("enabled",
+                &LHCURCLASS::enabled, &LHCURCLASS::setEnabled)
+            .property("frameCount",
+                &LHCURCLASS::frameCount, &LHCURCLASS::setFrameCount)
+            .LHPROPG(recordedFrames)
+            .def("report", &FrameProfiler_report),
+#       undef LHCURCLASS
+#       define LHCURCLASS ProfilerOverlay
+        class_<LHCURCLASS, bases<sf::Transformable, sf::Drawable>>(
+            "ProfilerOverlay")
+            .property("visible",
+                &LHCURCLASS::visible, &LHCURCLASS::setVisible)
+            .property("font", &LHCURCLASS::font, &LHCURCLASS::setFont)
+            .property("targetFrameTime",
+                &LHCURCLASS::targetFrameTime, &LHCURCLASS::setTargetFrameTime)
+#       undef LHCURCLASS
+    ];
+}
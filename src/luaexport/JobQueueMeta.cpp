@@ -0,0 +1,18 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "svc/JobQueue.hpp"
+
+static char const libname[] = "JobQueue";
+#include "ExportThis.hpp"
+
+static void init(LuaVm& vm)
+{
+    LHMODULE [
+#       define LHCURCLASS JobQueue
+        LHCLASS
+            .LHPROPG(threadCount)
+#       undef LHCURCLASS
+    ];
+}
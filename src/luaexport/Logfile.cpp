@@ -15,8 +15,8 @@ static void writelog(lua_State* L, std::string const& msg, loglevel lv)
     if (lua_getstack(L, 1, &ar)) {  /* check function at level */
         lua_getinfo(L, "Sl", &ar);  /* get info about it */
         if (ar.currentline > 0) {  /* is there info? */
-            log().write(msg, lv,
-                lua_pushfstring(L, "%s:%d", ar.short_src, ar.currentline));
+            log().write(msg, lv, std::string(
+                lua_pushfstring(L, "%s:%d", ar.short_src, ar.currentline)));
             lua_pop(L, 1);
             return;
         }
@@ -14,14 +14,21 @@ static void quit0(Mainloop& ml)
     ml.quit(); // use default value for exitcode
 }
 
+static FrameProfiler& Mainloop_profiler(Mainloop& ml)
+{
+    return ml.profiler();
+}
+
 static void init(LuaVm& vm)
 {
     vm.initLib("ComponentSystem");
+    vm.initLib("FrameProfiler");
     LHMODULE [
 #       define LHCURCLASS Mainloop
         LHCLASS
             .LHMEMFN(quit)
             .def("quit", &quit0)
+            .property("profiler", &Mainloop_profiler)
             .JD_EVENT(started, Started)
             .JD_EVENT(preFrame, PreFrame)
             .JD_EVENT(processInput, ProcessInput)
@@ -0,0 +1,47 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "profiling.hpp"
+
+static char const libname[] = "Profiling";
+#include "ExportThis.hpp"
+
+#include <vector>
+
+
+// Lua runs only in the main thread, so one stack for the zones begun from
+// Lua is enough.
+static std::vector<profiling::ZoneHandle> luaZones;
+
+static void beginZone(std::string const& name)
+{
+    profiling::ZoneHandle zone = { nullptr, 0, 0 };
+    if (profiling::isCapturing())
+        zone = profiling::beginZone(name);
+    luaZones.push_back(zone);
+}
+
+// Ends the zone begun last. Named finish because end is a Lua keyword.
+static void finishZone()
+{
+    if (luaZones.empty())
+        throw "jd.profile.finish() without matching begin()";
+    profiling::endZone(luaZones.back());
+    luaZones.pop_back();
+}
+
+static void init(LuaVm& vm)
+{
+    LHMODULE [
+        namespace_("profile") [
+            def("begin", &beginZone),
+            def("finish", &finishZone),
+            def("startCapture", &profiling::startCapture),
+            def("stopCapture", &profiling::stopCapture),
+            def("isCapturing", &profiling::isCapturing),
+            def("droppedZones", &profiling::droppedZones),
+            def("saveTrace", &profiling::saveChromeTrace)
+        ]
+    ];
+}
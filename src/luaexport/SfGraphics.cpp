@@ -6,6 +6,7 @@
 #include "ressys/AutoFont.hpp"
 #include "ressys/AutoTexture.hpp"
 #include "ressys/ResourceManager.hpp"
+#include "ressys/TextureAtlas.hpp"
 #include "ressys/VFileFont.hpp"
 #include "SfBaseTypes.hpp"
 #include "sfUtil.hpp"
@@ -127,6 +128,12 @@ static sf::Vector2f Shape_point(sf::Shape const& s, unsigned idx)
 typedef AutoResource<sf::Sprite, sf::Texture> AutoSprite;
 typedef GroupedDrawable<AutoSprite> SpriteEntry;
 
+static void Sprite_setRegion(SpriteEntry& sprite, TextureRegion const& region)
+{
+    sprite.setResource(region.texture);
+    sprite.setTextureRect(region.rect);
+}
+
 typedef GroupedDrawable<TransformGroup> GroupEntry;
 
 typedef AutoResource<sf::Text, VFileFont> AutoText;
@@ -142,6 +149,7 @@ typedef GroupedDrawable<AutoCircleShape> CircleShapeEntry;
 static void init(LuaVm& vm)
 {
     vm.initLib("SfWindow"); // RenderWindow derives from Window
+    vm.initLib("JobQueue"); // for requestAsync and prefetch
     using namespace sf;
     using namespace luabind;
 
@@ -183,13 +191,23 @@ static void init(LuaVm& vm)
 #   undef LHCURCLASS
     addResMngMethods(cFont);
 
+#   define LHCURCLASS TextureRegion
+    class_<LHCURCLASS, std::shared_ptr<LHCURCLASS>> cTextureRegion("TextureRegion");
+    cTextureRegion
+        .def(constructor<LHCURCLASS const&>())
+        .LHPROPRW(texture)
+        .LHPROPRW(rect);
+#   undef LHCURCLASS
+    addResMngMethods(cTextureRegion);
+
 #   define LHCURCLASS SpriteEntry
     class_<LHCURCLASS, bases<Sprite, TransformGroup::AutoEntry>> cSprite("Sprite");
     cSprite
         .property("textureRect",
             &LHCURCLASS::getTextureRect, &LHCURCLASS::setTextureRect)
         .property("color",
-            &LHCURCLASS::getColor, &LHCURCLASS::setColor, copy(result));
+            &LHCURCLASS::getColor, &LHCURCLASS::setColor, copy(result))
+        .def("setRegion", &Sprite_setRegion);
 #   undef LHCURCLASS
     addDrawableDefs(cSprite);
     addTextureProp(cSprite);
@@ -296,9 +314,20 @@ static void init(LuaVm& vm)
 
         cImage,
         cTexture,
+        cTextureRegion,
         class_<Font>("@Font@"),
         cFont,
-        class_<TransformGroup, bases<Transformable, Drawable>>("@TranformGroup@"),
+#       define LHCURCLASS TransformGroup
+        class_<LHCURCLASS, bases<Transformable, Drawable>>("@TranformGroup@")
+            .property("batching",
+                &LHCURCLASS::batching, &LHCURCLASS::setBatching)
+            .property("sortByTexture",
+                &LHCURCLASS::sortByTexture, &LHCURCLASS::setSortByTexture)
+            .property("culling",
+                &LHCURCLASS::culling, &LHCURCLASS::setCulling)
+            .LHPROPG(culledCount)
+            .LHPROPG(drawCalls),
+#       undef LHCURCLASS
 
 #       define LHCURCLASS GroupEntry
         class_<GroupEntry, bases<TransformGroup, TransformGroup::AutoEntry>>("TransformGroup")
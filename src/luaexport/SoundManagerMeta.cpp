@@ -12,6 +12,8 @@ static char const libname[] = "SoundManager";
 
 static void init(LuaVm& vm)
 {
+    vm.initLib("JobQueue"); // for requestAsync and prefetch
+
     using namespace sf;
     using namespace luabind;
 
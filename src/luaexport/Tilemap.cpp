@@ -3,9 +3,11 @@
 // See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
 
 #include "container.hpp"
+#include "LuaFunction.hpp"
 #include "MapInfo.hpp"
 #include "SfBaseTypes.hpp"
 #include "sharedPtrConverter.hpp"
+#include "svc/JobQueue.hpp"
 #include "Tilemap.hpp"
 #include "TransformGroup.hpp" // GroupedDrawable
 
@@ -27,9 +29,16 @@ static void Tilemap_set(jd::Tilemap& map, sf::Vector3i p, unsigned tid)
     map.set(static_cast<jd::Vector3u>(p), tid);
 }
 
+static std::shared_ptr<TilemapLoad> loadTilemapAsyncNoCallback(
+    JobQueue& jobs, std::string const& vfilename)
+{
+    return loadTilemapAsync(jobs, vfilename);
+}
+
 static void init(LuaVm& vm)
 {
     vm.initLib("SfGraphics");
+    vm.initLib("JobQueue");
 
     using namespace luabind;
     class_<PropertyMap> cPropertyMap("StringTable");
@@ -134,7 +143,18 @@ static void init(LuaVm& vm)
             .LHMEMFN(tilePosFromGlobal)
             .def("tileRect", &LHCURCLASS::globalTileRect)
             .LHMEMFN(localTileRect)
-            .def("loadFromFile", &loadTilemap)
+            .def("loadFromFile", &loadTilemap),
+#   undef LHCURCLASS
+
+#   define LHCURCLASS TilemapLoad
+        class_<LHCURCLASS, std::shared_ptr<LHCURCLASS>>("TilemapLoad")
+            .LHPROPG(progress)
+            .LHPROPG(isDone)
+            .LHPROPG(failed)
+            .LHPROPG(error)
+            .LHMEMFN(assignTo),
 #   undef LHCURCLASS
+        def("loadTilemapAsync", &loadTilemapAsync),
+        def("loadTilemapAsync", &loadTilemapAsyncNoCallback)
     ];
 }
@@ -139,6 +139,18 @@ static int fileExists(lua_State* L)
     return 1;
 }
 
+// Returns the last modification time in seconds since the epoch, or nil if
+// it is unknown (e.g. because the file does not exist).
+static int fileModTime(lua_State* L)
+{
+    PHYSFS_sint64 const t = PHYSFS_getLastModTime(luaL_checkstring(L, 1));
+    if (t < 0)
+        lua_pushnil(L);
+    else
+        lua_pushnumber(L, static_cast<lua_Number>(t));
+    return 1;
+}
+
 
 void init(LuaVm& vm)
 {
@@ -150,6 +162,7 @@ void init(LuaVm& vm)
         {"readString",  &readString},
         {"createDirectory", &createDirectory},
         {"fileExists",  &fileExists},
+        {"fileModTime", &fileModTime},
         {"compress",    &compressString},
         {"uncompress",  &uncompressString},
         {nullptr, nullptr}
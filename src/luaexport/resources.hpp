@@ -5,6 +5,7 @@
 #ifndef RESOURCES_HPP_INCLUDED
 #define RESOURCES_HPP_INCLUDED RESOURCES_HPP_INCLUDED
 
+#include "LuaFunction.hpp"
 #include "ressys/ResourceManager.hpp"
 #include "sharedPtrConverter.hpp"
 #include <luabind/luabind.hpp>
@@ -27,19 +28,56 @@ M(keepLoaded)
 M(releaseAll)
 M(tidy)
 M(purge)
+M(clearCache)
+M(resetCacheStats)
 #undef M
 
 RESMNG_METHOD(void, release, (std::string const& name), (name))
+RESMNG_METHOD(void, setCacheBudget, (std::size_t bytes), (bytes))
 RESMNG_METHOD(void, insert, \
     (std::string const& name, typename ResourceManager<T>::Ptr p), (name, p))
 
+RESMNG_METHOD(typename ResourceManager<T>::RequestPtr, requestAsync, \
+    (JobQueue& jobs, std::string const& name, \
+     typename ResourceRequest<T>::Callback const& onDone), \
+    (jobs, name, onDone))
+
 #undef RESMNG_METHOD
 
+template <typename T>
+static luabind::object ResMng_cacheStats(lua_State* L)
+{
+    ResourceCacheStats const stats = resMng<T>().cacheStats();
+    luabind::object result = luabind::newtable(L);
+    result["budget"] = stats.budget;
+    result["bytes"] = stats.bytes;
+    result["entries"] = stats.entries;
+    result["hits"] = stats.hits;
+    result["misses"] = stats.misses;
+    result["evictions"] = stats.evictions;
+    return result;
+}
+
+// Like requestAsync, but without callback.
+template <typename T>
+static typename ResourceManager<T>::RequestPtr ResMng_prefetch(
+    JobQueue& jobs, std::string const& name)
+{
+    return resMng<T>().requestAsync(jobs, name);
+}
+
 template <typename T, typename B>
 static void addResMngMethods(luabind::class_<T, std::shared_ptr<T>, B >& c)
 {
+    typedef ResourceRequest<T> Request;
 #define F(n) luabind::def(#n, &ResMng_##n<T>)
     c.scope [
+        luabind::class_<Request, std::shared_ptr<Request>>("Request")
+            .property("name", &Request::name)
+            .property("isDone", &Request::isDone)
+            .property("failed", &Request::failed)
+            .property("error", &Request::error)
+            .property("resource", &Request::resource),
         F(get),
         F(tryGet),
         F(request),
@@ -48,7 +86,13 @@ static void addResMngMethods(luabind::class_<T, std::shared_ptr<T>, B >& c)
         F(tidy),
         F(purge),
         F(release),
-        F(insert)
+        F(insert),
+        F(requestAsync),
+        F(prefetch),
+        F(setCacheBudget),
+        F(clearCache),
+        F(cacheStats),
+        F(resetCacheStats)
     ];
 #undef F
 }
@@ -6,6 +6,8 @@
 
 #include "Logfile.hpp"
 #include "luaUtils.hpp"
+#include "ProfilerOverlay.hpp"
+#include "profiling.hpp"
 #include "ressys/resourceLoaders.hpp"
 #include "ressys/ResourceManager.hpp"
 #include "State.hpp"
@@ -17,6 +19,7 @@
 #include "svc/Configuration.hpp"
 #include "svc/StateManager.hpp"
 #include "svc/Timer.hpp"
+#include "svc/JobQueue.hpp"
 #include "svc/SoundManager.hpp"
 
 #include <boost/bind.hpp>
@@ -29,8 +32,10 @@
 #include <luabind/function.hpp> // call_function (used @ loadStateFromLua)
 #include <luabind/back_reference.hpp>
 #include <physfs.h>
+#include <SFML/Audio/SoundBuffer.hpp>
 #include <SFML/Graphics/Image.hpp>
 #include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/Graphics/Texture.hpp>
 
 #include <iostream> // for cout, clog, cerr, cin .imbue()
 #include <locale>
@@ -68,7 +73,7 @@ public:
         if (!PHYSFS_exists(filename.c_str()))
             return nullptr;
 
-        LOG_D("Loading state \"" + name + "\"...");
+        LOG_DF("Loading state \"%1%\"...", name);
         State* s = nullptr;
         try {
             luaU::load(m_L, filename);
@@ -334,6 +339,32 @@ int main(int argc, char* argv[])
             conf.load();
             LOG_D("Finished loading configuration.");
 
+            log().setAsync(
+                conf.get<bool>("log.async", false),
+                conf.get<std::size_t>("log.queueSize", 4096UL));
+
+            resMng<sf::Image>().setCacheBudget(
+                conf.get<std::size_t>("cache.imageBytes", 0UL));
+            resMng<sf::Texture>().setCacheBudget(
+                conf.get<std::size_t>("cache.textureBytes", 64UL << 20));
+            resMng<sf::SoundBuffer>().setCacheBudget(
+                conf.get<std::size_t>("cache.soundBufferBytes", 32UL << 20));
+
+            mainloop.profiler().setFrameCount(
+                conf.get<std::size_t>("profiler.frames", 300UL));
+            mainloop.profiler().setEnabled(
+                conf.get<bool>("profiler.enabled", false));
+
+            // Capture profiling zones from here to the end of the mainloop.
+            profiling::setThreadName("main");
+            std::string const traceFile =
+                conf.get<std::string>("profiler.traceFile", std::string());
+            if (!traceFile.empty())
+                profiling::startCapture();
+
+            JobQueue jobQueue(conf.get<unsigned>("misc.workerThreadCount", 1U));
+            luabind::rawset(svctable, "jobQueue", &jobQueue);
+
 
             // Create the RenderWindow now, because some services depend on it.
             LOG_D("Creating Window and preparing SFML...");
@@ -362,8 +393,15 @@ int main(int argc, char* argv[])
             DrawService drawService(
                 *window, conf.get<std::size_t>("misc.layerCount", 1UL));
             luabind::rawset(svctable, "drawService", &drawService);
+
+            ProfilerOverlay profilerOverlay(mainloop.profiler());
+            profilerOverlay.setVisible(conf.get<bool>("profiler.overlay", false));
+            drawService.setOverlay(&profilerOverlay);
+            luabind::rawset(svctable, "profilerOverlay", &profilerOverlay);
             
             mainloop.connect_preFrame(bind(&Timer::beginFrame, &timer));
+            mainloop.connect_preFrame(
+                bind(&JobQueue::processCompletions, &jobQueue));
             mainloop.connect_update(bind(&Timer::processCallbacks, &timer));
             mainloop.connect_update([&timer, &sound]() {
                 sound.fade(timer.frameDuration());
@@ -376,9 +414,8 @@ int main(int argc, char* argv[])
             timer.callEvery(sf::seconds(10), bind(&SoundManager::tidy, &sound));
 
             timer.callEvery(sf::seconds(60), [&timer]() {
-                std::string const fps = boost::lexical_cast<std::string>(
+                LOG_DF("Current framerate (fps): %1%",
                     1.f / timer.frameDuration().asSeconds());
-                LOG_D("Current framerate (fps): " + fps);
             });
 
             // Execute init.lua //
@@ -396,8 +433,22 @@ int main(int argc, char* argv[])
             LOG_D("Mainloop finished with exit code " +
                   boost::lexical_cast<std::string>(r) + ".");
 
+            if (!traceFile.empty()) {
+                profiling::stopCapture();
+                try {
+                    profiling::saveChromeTrace(traceFile);
+                    LOG_I("Saved profiling trace to \"" + traceFile + "\".");
+                } catch (std::exception const& e) {
+                    LOG_EX(e);
+                }
+            }
+
             LOG_D("Cleanup...");
             stateManager.clear();
+            jobQueue.stop();
+            resMng<sf::Image>().clearCache();
+            resMng<sf::Texture>().clearCache();
+            resMng<sf::SoundBuffer>().clearCache();
             luaVm.deinit();
 
         } catch (luabind::error const& e) {
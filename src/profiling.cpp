@@ -0,0 +1,254 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "profiling.hpp"
+
+#include "Logfile.hpp"
+#include "svc/FileSystem.hpp"
+
+#include <SFML/System/Clock.hpp>
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <unordered_set>
+#include <vector>
+
+// VS2012 has no thread_local, but supports thread local PODs.
+#ifdef _MSC_VER
+#   define JD_THREAD_LOCAL __declspec(thread)
+#else
+#   define JD_THREAD_LOCAL __thread
+#endif
+
+
+namespace {
+
+// About 24 MiB per thread.
+std::size_t const maxEventsPerThread = 1 << 20;
+
+struct Event {
+    char const* name;
+    sf::Int64 start;    // Microseconds.
+    sf::Int64 duration; // Negative while the zone has not ended.
+};
+
+} // anonymous namespace
+
+
+namespace profiling {
+namespace detail {
+
+std::atomic<bool> capturing(false);
+
+struct ThreadBuffer {
+    std::mutex mutex;
+    unsigned threadId;
+    std::string threadName;
+    unsigned capture; // The capture which the events belong to.
+    std::vector<Event> events;
+    std::unordered_set<std::string> names; // For dynamic zone names.
+    std::size_t dropped;
+};
+
+} // namespace detail
+} // namespace profiling
+
+using profiling::detail::ThreadBuffer;
+
+
+namespace {
+
+// The buffers stay alive after their threads have ended, so that their
+// zones can still be exported.
+std::mutex buffersMutex;
+std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+unsigned currentCapture = 0; // Protected by buffersMutex.
+
+JD_THREAD_LOCAL ThreadBuffer* threadBuffer = nullptr;
+
+sf::Clock const profilingClock;
+
+sf::Int64 now()
+{
+    return profilingClock.getElapsedTime().asMicroseconds();
+}
+
+ThreadBuffer& currentBuffer()
+{
+    if (!threadBuffer) {
+        auto const buffer = std::make_shared<ThreadBuffer>();
+        buffer->dropped = 0;
+        std::lock_guard<std::mutex> lock(buffersMutex);
+        buffer->threadId = static_cast<unsigned>(buffers.size() + 1);
+        buffer->capture = currentCapture;
+        buffers.push_back(buffer);
+        threadBuffer = buffer.get();
+    }
+    return *threadBuffer;
+}
+
+// Must be called with buffer.mutex locked.
+profiling::ZoneHandle recordZone(ThreadBuffer& buffer, char const* name)
+{
+    profiling::ZoneHandle zone = { nullptr, 0, 0 };
+    if (buffer.events.size() >= maxEventsPerThread) {
+        ++buffer.dropped;
+        return zone;
+    }
+    Event const event = { name, now(), -1 };
+    zone.buffer = &buffer;
+    zone.event = buffer.events.size();
+    zone.capture = buffer.capture;
+    buffer.events.push_back(event);
+    return zone;
+}
+
+void writeJsonString(std::ostream& out, std::string const& s)
+{
+    out << '"';
+    for (char const c : s) switch (c) {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[7];
+                std::sprintf(escaped, "\\u%04x", static_cast<unsigned>(c));
+                out << escaped;
+            } else {
+                out << c;
+            }
+            break;
+    }
+    out << '"';
+}
+
+} // anonymous namespace
+
+
+namespace profiling {
+
+void startCapture()
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    ++currentCapture;
+    for (auto const& buffer : buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        buffer->capture = currentCapture;
+        buffer->events.clear();
+        buffer->names.clear();
+        buffer->dropped = 0;
+    }
+    detail::capturing = true;
+}
+
+void stopCapture()
+{
+    detail::capturing = false;
+}
+
+void setThreadName(std::string const& name)
+{
+    ThreadBuffer& buffer = currentBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.threadName = name;
+}
+
+std::size_t droppedZones()
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    std::size_t result = 0;
+    for (auto const& buffer : buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        result += buffer->dropped;
+    }
+    return result;
+}
+
+ZoneHandle beginZone(char const* name)
+{
+    ThreadBuffer& buffer = currentBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    return recordZone(buffer, name);
+}
+
+ZoneHandle beginZone(std::string const& name)
+{
+    ThreadBuffer& buffer = currentBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+
+    // Elements of unordered_set are never moved, so the pointer stays
+    // valid until the next capture clears the names.
+    return recordZone(buffer, buffer.names.insert(name).first->c_str());
+}
+
+void endZone(ZoneHandle const& zone)
+{
+    if (!zone.buffer)
+        return;
+    std::lock_guard<std::mutex> lock(zone.buffer->mutex);
+    if (zone.capture != zone.buffer->capture)
+        return; // A new capture was started since the zone began.
+    Event& event = zone.buffer->events[zone.event];
+    event.duration = now() - event.start;
+}
+
+void writeChromeTrace(std::ostream& out)
+{
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    sf::Int64 const end = now();
+    bool first = true;
+    out << "{\"traceEvents\":[";
+    for (auto const& buffer : buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        if (!buffer->threadName.empty()) {
+            out << (first ? "\n" : ",\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << buffer->threadId << ",\"args\":{\"name\":";
+            writeJsonString(out, buffer->threadName);
+            out << "}}";
+            first = false;
+        }
+        for (Event const& event : buffer->events) {
+            out << (first ? "\n" : ",\n") << "{\"name\":";
+            writeJsonString(out, event.name);
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                << ",\"ts\":" << event.start
+                << ",\"dur\":" << (event.duration >= 0 ?
+                    event.duration : end - event.start)
+                << '}';
+            first = false;
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void saveChromeTrace(std::string const& vfilename)
+{
+    std::ostringstream out;
+    writeChromeTrace(out);
+    std::string const trace = out.str();
+
+    VFile f(vfilename, VFile::openW);
+    f.write(trace.c_str(), static_cast<sf::Int64>(trace.size()));
+    f.throwError();
+    f.close();
+
+    std::size_t const dropped = droppedZones();
+    if (dropped > 0) {
+        LOG_WF("%1% profiling zones were dropped from \"%2%\" "
+            "because of full buffers.", dropped, vfilename);
+    }
+}
+
+} // namespace profiling
@@ -0,0 +1,95 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef PROFILING_HPP_INCLUDED
+#define PROFILING_HPP_INCLUDED PROFILING_HPP_INCLUDED
+
+#include <boost/noncopyable.hpp>
+#include <boost/preprocessor/cat.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+
+// Records nested, named zones of code (e.g. function calls) with their
+// start time and duration, for viewing them on a timeline. Each thread
+// records into its own buffer. While no capture is running, entering a zone
+// costs only one atomic load.
+namespace profiling {
+
+namespace detail {
+    extern std::atomic<bool> capturing;
+    struct ThreadBuffer;
+} // namespace detail
+
+inline bool isCapturing()
+{
+    return detail::capturing.load(std::memory_order_relaxed);
+}
+
+// Discards the zones recorded so far and starts recording new ones.
+void startCapture();
+void stopCapture();
+
+// Names the calling thread in exported traces.
+void setThreadName(std::string const& name);
+
+// Zones which were not recorded, because a thread's buffer was full.
+std::size_t droppedZones();
+
+// Writes the zones recorded in the last (or current) capture in the
+// Chrome trace event format (JSON), as understood by chrome://tracing.
+// Zones which have not ended yet are written as ending now.
+void writeChromeTrace(std::ostream& out);
+void saveChromeTrace(std::string const& vfilename);
+
+struct ZoneHandle {
+    detail::ThreadBuffer* buffer; // nullptr if the zone is not recorded.
+    std::size_t event;
+    unsigned capture;
+};
+
+// Prefer Zone or JD_PROFILE_ZONE over these. The char const* overload
+// stores only the pointer, so name must have static storage duration.
+ZoneHandle beginZone(char const* name);
+ZoneHandle beginZone(std::string const& name);
+void endZone(ZoneHandle const& zone);
+
+class Zone: private boost::noncopyable {
+public:
+    // See beginZone() for name.
+    explicit Zone(char const* name)
+    {
+        m_zone.buffer = nullptr;
+        if (isCapturing())
+            m_zone = beginZone(name);
+    }
+
+    explicit Zone(std::string const& name)
+    {
+        m_zone.buffer = nullptr;
+        if (isCapturing())
+            m_zone = beginZone(name);
+    }
+
+    ~Zone()
+    {
+        if (m_zone.buffer)
+            endZone(m_zone);
+    }
+
+private:
+    ZoneHandle m_zone;
+};
+
+} // namespace profiling
+
+// Records the rest of the enclosing block as a zone. name should be a
+// string literal.
+#define JD_PROFILE_ZONE(name) \
+    ::profiling::Zone const BOOST_PP_CAT(jdProfileZone, __LINE__)(name)
+
+#endif
@@ -10,12 +10,72 @@
 #include "exceptions.hpp"
 #include "Logfile.hpp"
 #include "resfwd.hpp"
+#include "svc/JobQueue.hpp"
 
+#include <boost/bind.hpp>
 #include <boost/function.hpp>
 #include <boost/noncopyable.hpp>
 
+#include <list>
 #include <string>
 #include <unordered_map>
+#include <vector>
+
+
+/// \brief Counters of a ResourceManager's cache, see ResourceManager::setCacheBudget().
+struct ResourceCacheStats {
+    ResourceCacheStats(): budget(0), bytes(0), entries(0),
+        hits(0), misses(0), evictions(0) { }
+
+    std::size_t budget;
+    std::size_t bytes; ///< Estimated size of all cached resources.
+    std::size_t entries;
+
+    /// Requests for resources which were only kept alive by the cache.
+    unsigned long hits;
+    /// Requests for resources which had to be loaded.
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+/// \brief A resource being loaded by ResourceManager::requestAsync().
+///
+/// Like the ResourceManager, this may only be used from the main thread.
+template<typename ResT>
+class ResourceRequest: private boost::noncopyable {
+public:
+    typedef typename ResourceTraits<ResT>::Ptr Ptr;
+    typedef boost::function<void(ResourceRequest&)> Callback;
+
+    std::string const& name() const { return m_name; }
+    bool isDone() const { return m_done; }
+    bool failed() const { return m_done && !m_resource; }
+    std::string const& error() const { return m_error; }
+
+    /// \returns The resource or nullptr if it is not (yet) loaded.
+    Ptr const& resource() const { return m_resource; }
+
+private:
+    friend class ResourceManager<ResT>;
+
+    explicit ResourceRequest(std::string const& name):
+        m_name(name), m_done(false)
+    { }
+
+    void notify()
+    {
+        std::vector<Callback> callbacks;
+        callbacks.swap(m_callbacks);
+        for (Callback const& callback : callbacks)
+            callback(*this);
+    }
+
+    std::string const m_name;
+    Ptr m_resource;
+    std::string m_error;
+    bool m_done;
+    std::vector<Callback> m_callbacks;
+};
 
 
 /// \brief Manages resources and ensures that they are loaded only once.
@@ -38,6 +98,20 @@ public:
     typedef boost::function<void(Resource&, std::string const&)>
         ResourceNotFoundCallback;
 
+    typedef ResourceRequest<ResT> Request;
+    typedef std::shared_ptr<Request> RequestPtr;
+
+    /// Called on the main thread to create the resource from what an
+    /// AsyncLoader has prepared.
+    typedef boost::function<Ptr()> AsyncLoadFinisher;
+
+    /// Called on a worker thread to do everything which can be done there.
+    typedef boost::function<AsyncLoadFinisher(std::string const&)>
+        AsyncLoader;
+
+    /// Estimates the memory used by a resource, in bytes.
+    typedef boost::function<std::size_t(Resource const&)> SizeFunction;
+
     ResourceManager();
 
     /// \brief Loads \a name if neccessary and returns it.
@@ -57,9 +131,34 @@ public:
     /// \brief As get(), but returns nullptr instead of throwing.
     Ptr tryGet(std::string const& name);
 
+    /// \brief Loads \a name in the background, using a worker thread of \a jobs.
+    ///
+    /// If \a name is already loaded, no loading is done; if it is currently
+    /// being loaded, the pending request is returned. In any case, \a onDone
+    /// is called on the main thread, from JobQueue::processCompletions(), when
+    /// the request is done. The returned request keeps the resource loaded as
+    /// long as it exists, so it can be used to prefetch resources.
+    ///
+    /// The resource is loaded by the AsyncLoader or, if none is set, by
+    /// calling a copy of the ResourceNotFoundCallback on the worker thread.
+    RequestPtr requestAsync(
+        JobQueue& jobs,
+        std::string const& name,
+        typename Request::Callback const& onDone =
+            typename Request::Callback());
+
     /// \brief Makes \a res available (by request() and get()) as \a name
     void insert(std::string const& name, Ptr res);
 
+    /// \brief Loads \a name into \a resource using the ResourceNotFoundCallback,
+    ///        without looking at or changing the managed resources.
+    ///
+    /// Unlike the other member functions, this may be called from any thread,
+    /// provided that the callback does not use a ResourceManager itself and
+    /// is not changed meanwhile.
+    /// \throws ResourceLoadError if no callback is set or loading failed.
+    void loadUncached(Resource& resource, std::string const& name) const;
+
     /// \brief \a name will not be deleted, if it's unused.
     ///
     /// If \name is not already loaded, this is done by this function.
@@ -88,9 +187,32 @@ public:
     /// You might want to call this function, after a lots of resources got released.
     void tidy();
 
-    /// \brief Calls releaseAll() and then tidy()
+    /// \brief Calls releaseAll(), clearCache() and then tidy()
     void purge();
 
+    /// \brief Keeps recently used resources loaded, up to \a bytes in total.
+    ///
+    /// Resources returned by request(), requestAsync() or passed to insert()
+    /// are put into a cache, which keeps them loaded even when they are not
+    /// used anymore. If the cache grows larger than \a bytes, the least
+    /// recently used resources which are not used outside the cache are
+    /// released. 0 (the default) disables the cache.
+    /// The size of resources is estimated by the SizeFunction.
+    void setCacheBudget(std::size_t bytes);
+
+    /// \brief Releases all resources kept by the cache.
+    void clearCache();
+
+    ResourceCacheStats cacheStats() const;
+
+    /// \brief Sets the hits, misses and evictions of cacheStats() to 0.
+    void resetCacheStats();
+
+    /// \brief Set the function used to estimate the size of resources.
+    ///
+    /// If none is set, sizeof(ResT) is used.
+    SizeFunction setSizeFunction(SizeFunction const&);
+
     /// \brief Set the function for loading resources.
     ResourceNotFoundCallback setResourceNotFoundCallback(
         ResourceNotFoundCallback const&);
@@ -98,16 +220,48 @@ public:
     /// \brief Sets the appropiate specialization of loadResource as callback.
     void useDefaultCallback();
 
+    /// \brief Set the function used by requestAsync() for loading resources.
+    ///
+    /// Needed for resources which cannot be created on a worker thread.
+    AsyncLoader setAsyncLoader(AsyncLoader const&);
+
     ~ResourceManager();
 
 private:
+    static AsyncLoadFinisher loadWithCallback(
+        ResourceNotFoundCallback const& callback, std::string const& name);
+    static void loadAsync(
+        ResourceManager* self, JobQueue& jobs,
+        RequestPtr const& request, AsyncLoader const& loader);
+    void finishAsync(
+        RequestPtr const& request,
+        AsyncLoadFinisher const& finish,
+        std::string error);
+
+    Ptr useLoaded(std::string const& name);
+    void cache(std::string const& name, Ptr const& res);
+    void trimCache();
+
     typedef std::unordered_map<std::string, WeakPtr> resMap_t;
     resMap_t m_resMap;
     typedef std::unordered_map<std::string, Ptr> keptMap_t;
     keptMap_t m_kept;
 
     ResourceNotFoundCallback m_callback;
+    AsyncLoader m_asyncLoader;
+    std::unordered_map<std::string, std::weak_ptr<Request>> m_pending;
     bool m_keepAll;
+
+    struct CacheEntry {
+        std::string name;
+        Ptr resource;
+        std::size_t size;
+    };
+    typedef std::list<CacheEntry> cache_t; // Most recently used first.
+    cache_t m_cache;
+    std::unordered_map<std::string, typename cache_t::iterator> m_cacheIndex;
+    ResourceCacheStats m_cacheStats;
+    SizeFunction m_sizeFunction;
 };
 
 /// \brief Loads \a resource using it's method <c>LoadFromFile(\a name)</c>.
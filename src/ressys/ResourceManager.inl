@@ -1,159 +1,385 @@
-// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
-// This file is subject to the terms of the BSD 2-Clause License.
-// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
-
-/// \file ResourceManager.inl Implementation file for ResourceManager.hpp
-
-template<typename ResT>
-ResourceManager<ResT>::ResourceManager():
-    m_keepAll(false)
-{
-}
-
-template<typename ResT>
-ResourceManager<ResT>::~ResourceManager()
-{
-    if (!m_keepAll) {
-        for (auto it = m_kept.cbegin(); it != m_kept.cend(); ++it)
-            LOG_W("Resource \"" + it->first + "\" has not been released!");
-    }
-}
-
-template<typename ResT>
-typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::request(
-    std::string const& name)
-{
-    if (!m_callback)
-        return get(name);
-
-    WeakPtr& oldRes = m_resMap[name];
-    if (oldRes.expired()) {
-        LOG_D("Loading resource[" +
-              std::string(typeid(ResT).name()) + "] \"" + name + "\"...");
-        Ptr newRes(std::make_shared<ResT>());
-        try {
-            m_callback(*newRes, name);
-            LOG_D("Finished loading resource \"" + name + "\".");
-        } catch (std::exception const& ex) {
-            LOG_EX(ex);
-            LOG_E("Failed loading resource \"" + name + "\".");
-            throw;
-        }
-        if (m_keepAll)
-            m_kept.insert(std::make_pair(name, newRes));
-        oldRes = newRes;
-        return newRes;
-    }
-    else
-        return oldRes.lock();
-}
-
-template<typename ResT>
-void ResourceManager<ResT>::tidy()
-{
-     for (auto it = m_resMap.begin(); it != m_resMap.end();) {
-         if (it->second.expired())
-             it = m_resMap.erase(it);
-         else ++it;
-     }
-}
-
-template<typename ResT>
-void ResourceManager<ResT>::purge()
-{
-    releaseAll();
-    tidy();
-}
-
-template<typename ResT>
-typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::keepLoaded(
-    std::string const& name)
-{
-    // insert and return inserted pointer
-    Ptr result = request(name);
-    m_kept.insert(std::make_pair(name, result));
-    return result;
-}
-
-template<typename ResT>
-void ResourceManager<ResT>::keepAllLoaded(bool const enable)
-{
-    m_keepAll = enable;
-    if (enable)
-        m_kept.insert(m_resMap.begin(), m_resMap.end());
-}
-
-
-
-template<typename ResT>
-void ResourceManager<ResT>::release(std::string const& name)
-{
-    m_kept.erase(name);
-}
-
-template<typename ResT>
-void ResourceManager<ResT>::releaseAll()
-{
-    m_kept.clear();
-}
-
-template<typename ResT>
-typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::tryGet(
-    std::string const& name)
-{
-    auto const& p = m_resMap[name];
-    if (p.expired())
-        return nullptr;
-    else
-        return p.lock();
-}
-
-
-template<typename ResT>
-typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::get(
-    std::string const& name)
-{
-    auto result = tryGet(name);
-    if (!result)
-        LOG_THROW(jd::ResourceError("resource \"" + name + "\" is not loaded"));
-    return result;
-}
-
-template<typename ResT>
-void ResourceManager<ResT>::insert(
-    std::string const& name, Ptr res)
-{
-    if (!res)
-        LOG_THROW(jd::ResourceError("attempt to insert null pointer in ResourceManager"));
-    m_resMap[name] = res;
-    if (m_keepAll)
-        m_kept[name] = res;
-}
-
-template<typename ResT>
-typename ResourceManager<ResT>::ResourceNotFoundCallback
-ResourceManager<ResT>::setResourceNotFoundCallback(
-        ResourceNotFoundCallback const& callback)
-{
-    ResourceNotFoundCallback old(std::move(m_callback));
-    m_callback = callback;
-    return old;
-}
-
-template<typename ResT>
-void ResourceManager<ResT>::useDefaultCallback()
-{
-    setResourceNotFoundCallback(&loadResource<ResT>);
-}
-
-
-//// FREE FUNCTIONS ////
-template<typename ResT>
-void loadResource(ResT& resource, std::string const& name)
-{
-    if (!resource.loadFromFile(name)) {
-        throw jd::ResourceLoadError(
-            "failed loading resource (type: " + std::string(typeid(ResT).name()) +
-            ") from file \"" + name + "\".");
-    }
-}
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+/// \file ResourceManager.inl Implementation file for ResourceManager.hpp
+
+template<typename ResT>
+ResourceManager<ResT>::ResourceManager():
+    m_keepAll(false)
+{
+}
+
+template<typename ResT>
+ResourceManager<ResT>::~ResourceManager()
+{
+    if (!m_keepAll) {
+        for (auto it = m_kept.cbegin(); it != m_kept.cend(); ++it)
+            LOG_W("Resource \"" + it->first + "\" has not been released!");
+    }
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::request(
+    std::string const& name)
+{
+    if (!m_callback)
+        return get(name);
+
+    if (Ptr const loaded = useLoaded(name))
+        return loaded;
+
+    ++m_cacheStats.misses;
+    LOG_D("Loading resource[" +
+          std::string(typeid(ResT).name()) + "] \"" + name + "\"...");
+    Ptr newRes(std::make_shared<ResT>());
+    try {
+        m_callback(*newRes, name);
+        LOG_D("Finished loading resource \"" + name + "\".");
+    } catch (std::exception const& ex) {
+        LOG_EX(ex);
+        LOG_E("Failed loading resource \"" + name + "\".");
+        throw;
+    }
+    if (m_keepAll)
+        m_kept.insert(std::make_pair(name, newRes));
+    m_resMap[name] = newRes;
+    cache(name, newRes);
+    return newRes;
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::useLoaded(
+    std::string const& name)
+{
+    auto const it = m_resMap.find(name);
+    if (it == m_resMap.end() || it->second.expired())
+        return nullptr;
+    if (it->second.use_count() == 1 && m_cacheIndex.count(name))
+        ++m_cacheStats.hits; // Would have been unloaded without the cache.
+    Ptr const result = it->second.lock();
+    cache(name, result);
+    return result;
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::cache(std::string const& name, Ptr const& res)
+{
+    if (m_cacheStats.budget == 0)
+        return;
+
+    auto const it = m_cacheIndex.find(name);
+    if (it != m_cacheIndex.end()) {
+        if (it->second->resource == res) {
+            m_cache.splice(m_cache.begin(), m_cache, it->second);
+            return;
+        }
+        // res replaced the cached resource (see insert()).
+        m_cacheStats.bytes -= it->second->size;
+        m_cache.erase(it->second);
+        m_cacheIndex.erase(it);
+    }
+
+    CacheEntry entry;
+    entry.name = name;
+    entry.resource = res;
+    entry.size = m_sizeFunction ? m_sizeFunction(*res) : sizeof(ResT);
+    m_cacheStats.bytes += entry.size;
+    m_cache.push_front(std::move(entry));
+    m_cacheIndex[name] = m_cache.begin();
+    trimCache();
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::trimCache()
+{
+    for (auto it = m_cache.end();
+         m_cacheStats.bytes > m_cacheStats.budget && it != m_cache.begin();
+    ) {
+        --it;
+        // Releasing a resource which is still used elsewhere frees nothing.
+        if (it->resource.use_count() > 1)
+            continue;
+        m_cacheStats.bytes -= it->size;
+        ++m_cacheStats.evictions;
+        m_cacheIndex.erase(it->name);
+        it = m_cache.erase(it);
+    }
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::setCacheBudget(std::size_t bytes)
+{
+    m_cacheStats.budget = bytes;
+    if (bytes == 0)
+        clearCache();
+    else
+        trimCache();
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::clearCache()
+{
+    cache_t cache;
+    cache.swap(m_cache);
+    m_cacheIndex.clear();
+    m_cacheStats.bytes = 0;
+}
+
+template<typename ResT>
+ResourceCacheStats ResourceManager<ResT>::cacheStats() const
+{
+    ResourceCacheStats result(m_cacheStats);
+    result.entries = m_cache.size();
+    return result;
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::resetCacheStats()
+{
+    m_cacheStats.hits = m_cacheStats.misses = m_cacheStats.evictions = 0;
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::SizeFunction
+ResourceManager<ResT>::setSizeFunction(SizeFunction const& sizeFunction)
+{
+    SizeFunction old(std::move(m_sizeFunction));
+    m_sizeFunction = sizeFunction;
+    return old;
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::RequestPtr ResourceManager<ResT>::requestAsync(
+    JobQueue& jobs,
+    std::string const& name,
+    typename Request::Callback const& onDone)
+{
+    std::weak_ptr<Request>& pending = m_pending[name];
+    RequestPtr request = pending.lock();
+    if (!request) {
+        request.reset(new Request(name));
+        request->m_resource = useLoaded(name);
+        if (request->m_resource) {
+            request->m_done = true;
+            m_pending.erase(name);
+        } else {
+            ++m_cacheStats.misses;
+            pending = request;
+            LOG_D("Loading resource[" +
+                  std::string(typeid(ResT).name()) + "] \"" + name +
+                  "\" in the background...");
+            // Copy the loader, so that it cannot be changed while it is used.
+            AsyncLoader const loader = m_asyncLoader ? m_asyncLoader :
+                AsyncLoader(boost::bind(
+                    &ResourceManager::loadWithCallback, m_callback, _1));
+            jobs.post(boost::bind(&ResourceManager::loadAsync,
+                this, boost::ref(jobs), request, loader));
+        }
+    }
+
+    if (onDone)
+        request->m_callbacks.push_back(onDone);
+    if (request->m_done)
+        jobs.postToMain(boost::bind(&Request::notify, request));
+    return request;
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::AsyncLoadFinisher
+ResourceManager<ResT>::loadWithCallback(
+    ResourceNotFoundCallback const& callback, std::string const& name)
+{
+    if (!callback)
+        throw jd::ResourceLoadError("no loader set");
+    Ptr const resource(std::make_shared<ResT>());
+    callback(*resource, name);
+    return [resource]() { return resource; };
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::loadAsync(
+    ResourceManager* self, JobQueue& jobs,
+    RequestPtr const& request, AsyncLoader const& loader)
+{
+    AsyncLoadFinisher finish;
+    std::string error;
+    try {
+        finish = loader(request->name());
+    } catch (std::exception const& ex) {
+        error = ex.what();
+    }
+    jobs.postToMain(boost::bind(
+        &ResourceManager::finishAsync, self, request, finish, error));
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::finishAsync(
+    RequestPtr const& request,
+    AsyncLoadFinisher const& finish,
+    std::string error)
+{
+    std::string const& name = request->name();
+    auto const it = m_pending.find(name);
+    if (it != m_pending.end() && it->second.lock() == request)
+        m_pending.erase(it);
+
+    Ptr resource;
+    if (error.empty()) {
+        try {
+            if (finish)
+                resource = finish();
+            if (!resource)
+                error = "loader returned no resource";
+        } catch (std::exception const& ex) {
+            error = ex.what();
+        }
+    }
+
+    if (resource) {
+        // request() may have loaded the resource in the meantime.
+        if (Ptr const loaded = useLoaded(name))
+            resource = loaded;
+        else
+            insert(name, resource);
+        LOG_D("Finished loading resource \"" + name + "\".");
+    } else {
+        LOG_E("Failed loading resource \"" + name + "\": " + error);
+    }
+
+    request->m_resource = resource;
+    request->m_error = error;
+    request->m_done = true;
+    request->notify();
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::tidy()
+{
+     for (auto it = m_resMap.begin(); it != m_resMap.end();) {
+         if (it->second.expired())
+             it = m_resMap.erase(it);
+         else ++it;
+     }
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::purge()
+{
+    releaseAll();
+    clearCache();
+    tidy();
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::keepLoaded(
+    std::string const& name)
+{
+    // insert and return inserted pointer
+    Ptr result = request(name);
+    m_kept.insert(std::make_pair(name, result));
+    return result;
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::keepAllLoaded(bool const enable)
+{
+    m_keepAll = enable;
+    if (enable)
+        m_kept.insert(m_resMap.begin(), m_resMap.end());
+}
+
+
+
+template<typename ResT>
+void ResourceManager<ResT>::release(std::string const& name)
+{
+    m_kept.erase(name);
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::releaseAll()
+{
+    m_kept.clear();
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::tryGet(
+    std::string const& name)
+{
+    auto const& p = m_resMap[name];
+    if (p.expired())
+        return nullptr;
+    else
+        return p.lock();
+}
+
+
+template<typename ResT>
+typename ResourceManager<ResT>::Ptr ResourceManager<ResT>::get(
+    std::string const& name)
+{
+    auto result = tryGet(name);
+    if (!result)
+        LOG_THROW(jd::ResourceError("resource \"" + name + "\" is not loaded"));
+    return result;
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::insert(
+    std::string const& name, Ptr res)
+{
+    if (!res)
+        LOG_THROW(jd::ResourceError("attempt to insert null pointer in ResourceManager"));
+    m_resMap[name] = res;
+    if (m_keepAll)
+        m_kept[name] = res;
+    cache(name, res);
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::loadUncached(
+    Resource& resource, std::string const& name) const
+{
+    if (!m_callback)
+        throw jd::ResourceLoadError(
+            "cannot load resource \"" + name + "\": no loader set");
+    m_callback(resource, name);
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::ResourceNotFoundCallback
+ResourceManager<ResT>::setResourceNotFoundCallback(
+        ResourceNotFoundCallback const& callback)
+{
+    ResourceNotFoundCallback old(std::move(m_callback));
+    m_callback = callback;
+    return old;
+}
+
+template<typename ResT>
+typename ResourceManager<ResT>::AsyncLoader
+ResourceManager<ResT>::setAsyncLoader(AsyncLoader const& loader)
+{
+    AsyncLoader old(std::move(m_asyncLoader));
+    m_asyncLoader = loader;
+    return old;
+}
+
+template<typename ResT>
+void ResourceManager<ResT>::useDefaultCallback()
+{
+    setResourceNotFoundCallback(&loadResource<ResT>);
+}
+
+
+//// FREE FUNCTIONS ////
+template<typename ResT>
+void loadResource(ResT& resource, std::string const& name)
+{
+    if (!resource.loadFromFile(name)) {
+        throw jd::ResourceLoadError(
+            "failed loading resource (type: " + std::string(typeid(ResT).name()) +
+            ") from file \"" + name + "\".");
+    }
+}
@@ -0,0 +1,146 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "TextureAtlas.hpp"
+
+#include <SFML/Graphics/Image.hpp>
+#include <SFML/Graphics/Texture.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+
+TextureAtlas::TextureAtlas(
+    unsigned pageSize, unsigned maxImageSize, unsigned padding
+):
+    m_pageSize(std::min(pageSize, sf::Texture::getMaximumSize())),
+    m_padding(padding)
+{
+    if (m_pageSize <= 2 * m_padding)
+        throw std::invalid_argument("texture atlas page size too small");
+    m_maxImageSize = std::min(maxImageSize, m_pageSize - 2 * m_padding);
+}
+
+bool TextureAtlas::accepts(sf::Vector2u imageSize) const
+{
+    return imageSize.x > 0 && imageSize.y > 0 &&
+        imageSize.x <= m_maxImageSize && imageSize.y <= m_maxImageSize;
+}
+
+bool TextureAtlas::place(
+    Page& page, sf::Vector2u size, sf::Vector2u& position) const
+{
+    Shelf* best = nullptr;
+    for (Shelf& shelf : page.shelves) {
+        if (shelf.height >= size.y && m_pageSize - shelf.usedWidth >= size.x &&
+            (!best || shelf.height < best->height)
+        ) {
+            best = &shelf;
+        }
+    }
+
+    // Rather start a new shelf than waste more than half of an existing one.
+    bool const canAddShelf = m_pageSize - page.usedHeight >= size.y;
+    if (!best || (best->height > 2 * size.y && canAddShelf)) {
+        if (!canAddShelf)
+            return false;
+        Shelf const shelf = { page.usedHeight, size.y, 0 };
+        page.shelves.push_back(shelf);
+        page.usedHeight += size.y;
+        best = &page.shelves.back();
+    }
+
+    position.x = best->usedWidth;
+    position.y = best->y;
+    best->usedWidth += size.x;
+    return true;
+}
+
+void TextureAtlas::newPage()
+{
+    Page page;
+    page.texture = std::make_shared<sf::Texture>();
+    if (!page.texture->create(m_pageSize, m_pageSize))
+        throw jd::ResourceLoadError("failed creating texture atlas page");
+    page.usedHeight = 0;
+    m_pages.push_back(std::move(page));
+}
+
+TextureRegion TextureAtlas::add(sf::Image const& image)
+{
+    sf::Vector2u const size = image.getSize();
+    if (!accepts(size))
+        throw std::invalid_argument("image does not fit into texture atlas");
+
+    sf::Vector2u const padded(size.x + 2 * m_padding, size.y + 2 * m_padding);
+    sf::Vector2u position;
+    auto page = std::find_if(m_pages.begin(), m_pages.end(),
+        [&](Page& p) { return place(p, padded, position); });
+    if (page == m_pages.end()) {
+        newPage();
+        page = m_pages.end() - 1;
+        bool const placed = place(*page, padded, position);
+        assert(placed);
+        (void)placed;
+    }
+
+    // Copy the image, surrounded by its repeated border, and upload it at once.
+    std::size_t const bpp = 4;
+    std::vector<sf::Uint8> pixels(padded.x * padded.y * bpp);
+    sf::Uint8 const* const src = image.getPixelsPtr();
+    for (unsigned y = 0; y < padded.y; ++y) {
+        unsigned const srcY = std::min(
+            std::max(y, m_padding) - m_padding, size.y - 1);
+        sf::Uint8 const* const srcRow = src + srcY * size.x * bpp;
+        sf::Uint8* dst = &pixels[y * padded.x * bpp];
+        for (unsigned i = 0; i < m_padding; ++i, dst += bpp)
+            std::memcpy(dst, srcRow, bpp);
+        std::memcpy(dst, srcRow, size.x * bpp);
+        dst += size.x * bpp;
+        for (unsigned i = 0; i < m_padding; ++i, dst += bpp)
+            std::memcpy(dst, srcRow + (size.x - 1) * bpp, bpp);
+    }
+    page->texture->update(
+        &pixels[0], padded.x, padded.y, position.x, position.y);
+
+    TextureRegion result;
+    result.texture = page->texture;
+    result.rect = sf::IntRect(
+        static_cast<int>(position.x + m_padding),
+        static_cast<int>(position.y + m_padding),
+        static_cast<int>(size.x),
+        static_cast<int>(size.y));
+    return result;
+}
+
+TextureRegion TextureAtlas::add(sf::Image const& image, std::string const& name)
+{
+    TextureRegion const result = add(image);
+    if (!name.empty())
+        m_named[name] = result;
+    return result;
+}
+
+bool TextureAtlas::find(std::string const& name, TextureRegion& result) const
+{
+    auto const it = m_named.find(name);
+    if (it == m_named.end())
+        return false;
+    result = it->second;
+    return true;
+}
+
+void TextureAtlas::clear()
+{
+    m_pages.clear();
+    m_named.clear();
+}
+
+TextureAtlas& textureAtlas()
+{
+    static TextureAtlas instance;
+    return instance;
+}
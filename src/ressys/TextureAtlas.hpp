@@ -0,0 +1,88 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef TEXTURE_ATLAS_HPP_INCLUDED
+#define TEXTURE_ATLAS_HPP_INCLUDED TEXTURE_ATLAS_HPP_INCLUDED
+
+#include "resfwd.hpp"
+
+#include <boost/noncopyable.hpp>
+#include <SFML/Graphics/Rect.hpp>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sf { class Image; class Texture; }
+
+
+// A part of a texture. Loading a TextureRegion by name with
+// resMng<TextureRegion>() packs small images into the pages of
+// textureAtlas(), so that sprites using them share a few textures.
+struct TextureRegion {
+    ResourceTraits<sf::Texture>::Ptr texture;
+    sf::IntRect rect;
+};
+
+// Packs images into square textures ("pages"), each of which is filled
+// shelf by shelf: an image is put on the shelf wasting the least height
+// which has room for it, or on a new shelf, or on a new page.
+class TextureAtlas: private boost::noncopyable {
+public:
+    // pageSize is reduced to sf::Texture::getMaximumSize() if necessary.
+    // padding is the number of pixels around each image which are filled by
+    // repeating its border, so that smooth textures do not bleed.
+    explicit TextureAtlas(
+        unsigned pageSize = 1024, unsigned maxImageSize = 256,
+        unsigned padding = 1);
+
+    // Whether add() will accept an image of the given size.
+    bool accepts(sf::Vector2u imageSize) const;
+
+    // Copies image into a page.
+    // Throws std::invalid_argument if !accepts(image.getSize()).
+    TextureRegion add(sf::Image const& image);
+
+    // Like add(image), but if name is not empty, the region is remembered
+    // so that find(name) returns it instead of packing the image again.
+    TextureRegion add(sf::Image const& image, std::string const& name);
+
+    // Returns whether an image was added with the given name and if so,
+    // stores its region in result.
+    bool find(std::string const& name, TextureRegion& result) const;
+
+    std::size_t pageCount() const { return m_pages.size(); }
+    unsigned pageSize() const { return m_pageSize; }
+
+    // Starts new pages for all following add()s and forgets the names of
+    // added images. Regions which are still used keep their page alive.
+    void clear();
+
+private:
+    struct Shelf {
+        unsigned y;
+        unsigned height;
+        unsigned usedWidth;
+    };
+
+    struct Page {
+        ResourceTraits<sf::Texture>::Ptr texture;
+        std::vector<Shelf> shelves;
+        unsigned usedHeight;
+    };
+
+    bool place(Page& page, sf::Vector2u size, sf::Vector2u& position) const;
+    void newPage();
+
+    std::vector<Page> m_pages;
+    std::unordered_map<std::string, TextureRegion> m_named;
+    unsigned m_pageSize;
+    unsigned m_maxImageSize;
+    unsigned m_padding;
+};
+
+// The atlas used for loading TextureRegions by name.
+TextureAtlas& textureAtlas();
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "exceptions.hpp"
 #include "ResourceManager.hpp"
+#include "TextureAtlas.hpp"
 #include "VFileFont.hpp"
 
 #include <physfs.h>
@@ -70,6 +71,76 @@ static void loadTextureResource(sf::Texture& tx, std::string const& name)
     }
 }
 
+// Textures can only be created on the main thread, so only the image is
+// loaded in the background.
+static ResourceManager<sf::Texture>::AsyncLoadFinisher loadTextureAsync(
+    std::string const& name)
+{
+    auto const image = std::make_shared<sf::Image>();
+    resMng<sf::Image>().loadUncached(*image, name);
+    return [image, name]() -> ResourceTraits<sf::Texture>::Ptr {
+        auto const tx = std::make_shared<sf::Texture>();
+        if (!tx->loadFromImage(*image)) {
+            throw jd::ResourceLoadError(
+                "failed loading texture resource \"" +
+                name + "\" from image.");
+        }
+        return tx;
+    };
+}
+
+// Small images go into textureAtlas(), others get a texture of their own.
+// The atlas remembers the regions by name, so that requesting a region again
+// after its resource expired does not pack the same image into it again.
+static TextureRegion textureRegionFromImage(
+    std::string const& name, sf::Image const& image)
+{
+    TextureRegion result;
+    if (textureAtlas().find(name, result))
+        return result;
+    if (textureAtlas().accepts(image.getSize()))
+        return textureAtlas().add(image, name);
+
+    result.texture = resMng<sf::Texture>().tryGet(name);
+    if (!result.texture) {
+        result.texture = std::make_shared<sf::Texture>();
+        if (!result.texture->loadFromImage(image)) {
+            throw jd::ResourceLoadError(
+                "failed loading texture resource \"" +
+                name + "\" from image.");
+        }
+        resMng<sf::Texture>().insert(name, result.texture);
+    }
+    sf::Vector2u const size = result.texture->getSize();
+    result.rect = sf::IntRect(
+        0, 0, static_cast<int>(size.x), static_cast<int>(size.y));
+    return result;
+}
+
+static void loadTextureRegion(TextureRegion& region, std::string const& name)
+{
+    if (textureAtlas().find(name, region))
+        return;
+    if (auto const image = resMng<sf::Image>().tryGet(name)) {
+        region = textureRegionFromImage(name, *image);
+    } else {
+        sf::Image loaded;
+        resMng<sf::Image>().loadUncached(loaded, name);
+        region = textureRegionFromImage(name, loaded);
+    }
+}
+
+static ResourceManager<TextureRegion>::AsyncLoadFinisher
+loadTextureRegionAsync(std::string const& name)
+{
+    auto const image = std::make_shared<sf::Image>();
+    resMng<sf::Image>().loadUncached(*image, name);
+    return [image, name]() {
+        return std::make_shared<TextureRegion>(
+            textureRegionFromImage(name, *image));
+    };
+}
+
 inline void loadFontResource(VFileFont& fnt, std::string const& name)
 {
     std::string const filename = findResource(
@@ -85,6 +156,25 @@ inline void loadFontResource(VFileFont& fnt, std::string const& name)
     }
 }
 
+// Estimates for ResourceManager::setCacheBudget(), ignoring fixed overhead.
+template <typename T>
+static std::size_t pixelByteSize(T const& imageOrTexture)
+{
+    sf::Vector2u const size = imageOrTexture.getSize();
+    return static_cast<std::size_t>(size.x) * size.y * 4; // RGBA
+}
+
+static std::size_t textureRegionByteSize(TextureRegion const& region)
+{
+    return static_cast<std::size_t>(region.rect.width) *
+        static_cast<std::size_t>(region.rect.height) * 4;
+}
+
+static std::size_t soundBufferByteSize(sf::SoundBuffer const& buf)
+{
+    return buf.getSampleCount() * sizeof(sf::Int16);
+}
+
 void initDefaultResourceLoaders()
 {
     log(); // init logfile
@@ -92,7 +182,15 @@ void initDefaultResourceLoaders()
     resMng<sf::Image>().setResourceNotFoundCallback(
         &loadSfmlResource<sf::Image>);
     resMng<sf::Texture>().setResourceNotFoundCallback(&loadTextureResource);
+    resMng<sf::Texture>().setAsyncLoader(&loadTextureAsync);
+    resMng<TextureRegion>().setResourceNotFoundCallback(&loadTextureRegion);
+    resMng<TextureRegion>().setAsyncLoader(&loadTextureRegionAsync);
 
     resMng<VFileFont>().setResourceNotFoundCallback(&loadFontResource);
     resMng<sf::SoundBuffer>().setResourceNotFoundCallback(&loadSfmlResource<sf::SoundBuffer>);
+
+    resMng<sf::Image>().setSizeFunction(&pixelByteSize<sf::Image>);
+    resMng<sf::Texture>().setSizeFunction(&pixelByteSize<sf::Texture>);
+    resMng<TextureRegion>().setSizeFunction(&textureRegionByteSize);
+    resMng<sf::SoundBuffer>().setSizeFunction(&soundBufferByteSize);
 }
@@ -9,7 +9,9 @@
 #include <SFML/System/Vector2.hpp>
 #include <SFML/System/Vector3.hpp>
 
+#include <cmath>
 #include <functional> // std::hash
+#include <limits>
 #include <string>
 #include <cassert>
 
@@ -342,6 +344,62 @@ bool intersection(
     return clipLine(p1, p2, r);
 }
 
+// Grid traversal //
+
+// Calls f(cell, t, normal) for each cell of a grid with cells of size
+// cellSize (cell (0, 0) starting at (0, 0)) which the line from p1 to p2
+// passes through, in order from p1 to p2. t is the line parameter (0 at p1,
+// 1 at p2) where the line enters the cell and normal the outward normal of
+// the cell side it enters through ((0, 0) for the cell containing p1).
+// Stops early if f returns false.
+// See Amanatides, Woo: "A Fast Voxel Traversal Algorithm for Ray Tracing".
+template <typename F>
+void traverseGrid(
+    sf::Vector2f p1, sf::Vector2f p2, sf::Vector2f cellSize, F f)
+{
+    sf::Vector2i cell(
+        static_cast<int>(std::floor(p1.x / cellSize.x)),
+        static_cast<int>(std::floor(p1.y / cellSize.y)));
+    sf::Vector2i const lastCell(
+        static_cast<int>(std::floor(p2.x / cellSize.x)),
+        static_cast<int>(std::floor(p2.y / cellSize.y)));
+    sf::Vector2f const d = p2 - p1;
+    sf::Vector2i const step(d.x < 0 ? -1 : 1, d.y < 0 ? -1 : 1);
+
+    // tMax: line parameter at which the next vertical/horizontal cell border
+    // is crossed; tDelta: line parameter needed to cross a whole cell.
+    float const inf = std::numeric_limits<float>::infinity();
+    sf::Vector2f tMax(inf, inf), tDelta(inf, inf);
+    if (d.x != 0) {
+        tDelta.x = cellSize.x / std::abs(d.x);
+        tMax.x = ((cell.x + (step.x > 0)) * cellSize.x - p1.x) / d.x;
+    }
+    if (d.y != 0) {
+        tDelta.y = cellSize.y / std::abs(d.y);
+        tMax.y = ((cell.y + (step.y > 0)) * cellSize.y - p1.y) / d.y;
+    }
+
+    float t = 0;
+    sf::Vector2i normal;
+    while (f(cell, t, normal) && cell != lastCell) {
+        if (tMax.x < tMax.y) {
+            if (tMax.x > 1) // guard against rounding errors
+                return;
+            t = tMax.x;
+            cell.x += step.x;
+            tMax.x += tDelta.x;
+            normal = sf::Vector2i(-step.x, 0);
+        } else {
+            if (tMax.y > 1)
+                return;
+            t = tMax.y;
+            cell.y += step.y;
+            tMax.y += tDelta.y;
+            normal = sf::Vector2i(0, -step.y);
+        }
+    }
+}
+
 // sf::View utility //
 
 sf::FloatRect viewRect(sf::View const& view);
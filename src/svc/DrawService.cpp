@@ -21,7 +21,7 @@ DrawService::Layer& DrawService::Layer::operator= (Layer&& rhs)
 
 
 DrawService::DrawService(sf::RenderWindow& window, std::size_t layerCount):
-    m_layers(layerCount), m_window(window)
+    m_layers(layerCount), m_overlay(nullptr), m_window(window)
 {
     resetLayerViews();
 }
@@ -37,6 +37,10 @@ void DrawService::draw()
         m_window.setView(layer.view);
         m_window.draw(layer.group);
     }
+    if (m_overlay) {
+        m_window.setView(m_window.getDefaultView());
+        m_window.draw(*m_overlay);
+    }
 }
 
 void DrawService::display()
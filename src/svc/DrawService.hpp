@@ -14,7 +14,7 @@
 #include <vector>
 
 
-namespace sf { class RenderWindow; class RenderTarget; }
+namespace sf { class RenderWindow; class RenderTarget; class Drawable; }
 
 class DrawService {
 public:
@@ -24,7 +24,7 @@ public:
         Layer& operator= (Layer&& rhs);
 
         sf::View view;
-        TransformGroup group;
+        TransformGroup group; // Use group.setCulling() to cull against view.
 
     private:
         Layer& operator= (Layer const&);
@@ -45,9 +45,15 @@ public:
     sf::Color backgroundColor() const { return m_backgroundColor; }
     void setBackgroundColor(sf::Color color) { m_backgroundColor = color; }
 
+    // Drawn after all layers, with the window's default view (e.g. for
+    // debugging displays). May be nullptr (the default).
+    sf::Drawable const* overlay() const { return m_overlay; }
+    void setOverlay(sf::Drawable const* overlay) { m_overlay = overlay; }
+
 private:
     std::vector<Layer> m_layers;
     sf::Color m_backgroundColor;
+    sf::Drawable const* m_overlay;
     sf::RenderWindow& m_window;
 };
 
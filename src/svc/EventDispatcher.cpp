@@ -6,7 +6,6 @@
 
 #include "Logfile.hpp"
 
-#include <boost/lexical_cast.hpp>
 #include <SFML/Window/Event.hpp>
 #include <SFML/Window/Window.hpp>
 
@@ -67,7 +66,7 @@ void EventDispatcher::dispatchEvent(sf::Event& ev)
 
         case sf::Event::Count:
         default:
-            LOG_W("unknown sf::Event::type: " + boost::lexical_cast<std::string>(ev.type));
+            LOG_WF("unknown sf::Event::type: %1%", static_cast<int>(ev.type));
         break;
     }
 }
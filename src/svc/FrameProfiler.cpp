@@ -0,0 +1,225 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "FrameProfiler.hpp"
+
+#include "profiling.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+
+namespace {
+
+// Removes the timer when destroyed, i.e. when the last copy of the
+// function returned by FrameProfiler::profiled() is.
+class TimerOwner: private boost::noncopyable {
+public:
+    TimerOwner(
+        FrameProfiler& profiler, FrameProfiler::TimerId timer,
+        std::string const& name):
+        profiler(profiler), timer(timer), name(name)
+    { }
+
+    ~TimerOwner() { profiler.removeTimer(timer); }
+
+    FrameProfiler& profiler;
+    FrameProfiler::TimerId const timer;
+    std::string const name; // Also used as profiling zone name.
+};
+
+class ProfiledFunction {
+public:
+    ProfiledFunction(
+        std::shared_ptr<TimerOwner> const& owner,
+        boost::function<void()> const& f):
+        m_owner(owner), m_f(f)
+    { }
+
+    void operator() () const
+    {
+        FrameProfiler::Scope scope(m_owner->profiler, m_owner->timer);
+        profiling::Zone const zone(m_owner->name);
+        m_f();
+    }
+
+private:
+    std::shared_ptr<TimerOwner> m_owner;
+    boost::function<void()> m_f;
+};
+
+} // anonymous namespace
+
+
+FrameProfiler::Scope::Scope(FrameProfiler& profiler, TimerId timer):
+    m_profiler(profiler),
+    m_timer(timer),
+    m_started(profiler.m_enabled),
+    m_start(m_started ? profiler.now() : sf::Time::Zero)
+{ }
+
+FrameProfiler::Scope::~Scope()
+{
+    // If the profiler was enabled in between, m_start is not meaningful.
+    if (m_started && m_profiler.m_enabled)
+        m_profiler.add(m_timer, m_profiler.now() - m_start);
+}
+
+
+FrameProfiler::FrameProfiler(std::size_t frameCount):
+    m_frameCount(frameCount),
+    m_currentFrame(0),
+    m_recordedFrames(0),
+    m_enabled(false)
+{
+    setFrameCount(frameCount);
+}
+
+FrameProfiler::TimerId FrameProfiler::addTimer(
+    std::string const& name, unsigned depth)
+{
+    TimerId timer;
+    if (m_freeTimers.empty()) {
+        timer = m_timers.size();
+        m_timers.push_back(Series());
+    } else {
+        timer = m_freeTimers.back();
+        m_freeTimers.pop_back();
+    }
+
+    Series& s = m_timers[timer];
+    s.name = name;
+    s.depth = depth;
+    s.used = true;
+    s.samples.assign(m_frameCount, 0);
+    return timer;
+}
+
+void FrameProfiler::removeTimer(TimerId timer)
+{
+    Series& s = m_timers.at(timer);
+    if (!s.used)
+        return;
+    s.used = false;
+    s.name.clear();
+    std::vector<sf::Int64>().swap(s.samples);
+    m_freeTimers.push_back(timer);
+}
+
+boost::function<void()> FrameProfiler::profiled(
+    std::string const& name, unsigned depth,
+    boost::function<void()> const& f)
+{
+    auto const owner = std::make_shared<TimerOwner>(
+        *this, addTimer(name, depth), name);
+    return ProfiledFunction(owner, f);
+}
+
+std::vector<FrameProfiler::TimerId> FrameProfiler::timers() const
+{
+    std::vector<TimerId> result;
+    for (TimerId timer = 0; timer < m_timers.size(); ++timer) {
+        if (m_timers[timer].used)
+            result.push_back(timer);
+    }
+    return result;
+}
+
+FrameProfiler::Series const& FrameProfiler::series(TimerId timer) const
+{
+    Series const& s = m_timers.at(timer);
+    if (!s.used)
+        throw std::out_of_range("FrameProfiler: timer was removed");
+    return s;
+}
+
+std::string const& FrameProfiler::timerName(TimerId timer) const
+{
+    return series(timer).name;
+}
+
+unsigned FrameProfiler::timerDepth(TimerId timer) const
+{
+    return series(timer).depth;
+}
+
+void FrameProfiler::beginFrame()
+{
+    if (!m_enabled)
+        return;
+    m_currentFrame = (m_currentFrame + 1) % m_frameCount;
+    if (m_recordedFrames < m_frameCount)
+        ++m_recordedFrames;
+    for (Series& s : m_timers) {
+        if (s.used)
+            s.samples[m_currentFrame] = 0;
+    }
+}
+
+void FrameProfiler::add(TimerId timer, sf::Time duration)
+{
+    if (!m_enabled)
+        return;
+    Series& s = m_timers[timer];
+    if (s.used)
+        s.samples[m_currentFrame] += duration.asMicroseconds();
+}
+
+std::size_t FrameProfiler::recordedFrames() const
+{
+    return m_recordedFrames > 0 ? m_recordedFrames - 1 : 0;
+}
+
+ProfileStats FrameProfiler::stats(TimerId timer) const
+{
+    Series const& s = series(timer);
+    std::size_t const n = recordedFrames();
+    ProfileStats result;
+    if (n == 0)
+        return result;
+
+    std::vector<sf::Int64> samples;
+    samples.reserve(n);
+    for (std::size_t i = 1; i <= n; ++i)
+        samples.push_back(
+            s.samples[(m_currentFrame + m_frameCount - i) % m_frameCount]);
+    std::sort(samples.begin(), samples.end());
+
+    sf::Int64 sum = 0;
+    for (sf::Int64 sample : samples)
+        sum += sample;
+
+    // Nearest-rank percentile.
+    std::size_t const p99Index = (n * 99 + 99) / 100 - 1;
+
+    result.min = sf::microseconds(samples.front());
+    result.average = sf::microseconds(sum / static_cast<sf::Int64>(n));
+    result.p99 = sf::microseconds(samples[p99Index]);
+    result.max = sf::microseconds(samples.back());
+    return result;
+}
+
+void FrameProfiler::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    m_recordedFrames = 0;
+    for (Series& s : m_timers) {
+        if (s.used)
+            std::fill(s.samples.begin(), s.samples.end(), 0);
+    }
+}
+
+void FrameProfiler::setFrameCount(std::size_t frameCount)
+{
+    if (frameCount < 2)
+        throw std::invalid_argument("FrameProfiler needs at least two frames");
+    m_frameCount = frameCount;
+    m_currentFrame = 0;
+    m_recordedFrames = 0;
+    for (Series& s : m_timers) {
+        if (s.used)
+            s.samples.assign(m_frameCount, 0);
+    }
+}
@@ -0,0 +1,107 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef FRAME_PROFILER_HPP_INCLUDED
+#define FRAME_PROFILER_HPP_INCLUDED FRAME_PROFILER_HPP_INCLUDED
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <SFML/System/Clock.hpp>
+#include <SFML/System/Time.hpp>
+
+#include <string>
+#include <vector>
+
+
+struct ProfileStats {
+    sf::Time min;
+    sf::Time average;
+    sf::Time p99; // 99 percent of the frames took at most this long.
+    sf::Time max;
+};
+
+// Measures how long named parts of each frame (timers) take and keeps the
+// results of the last frameCount() frames, for statistics over them.
+// A timer's sample for a frame is the sum of all durations added to it
+// during the frame. The profiler is disabled by default; while it is, no
+// time is measured.
+class FrameProfiler: private boost::noncopyable {
+public:
+    typedef std::size_t TimerId;
+
+    // Adds the time from its construction to its destruction to a timer,
+    // if the profiler was enabled at both times.
+    class Scope: private boost::noncopyable {
+    public:
+        Scope(FrameProfiler& profiler, TimerId timer);
+        ~Scope();
+
+    private:
+        FrameProfiler& m_profiler;
+        TimerId m_timer;
+        bool m_started;
+        sf::Time m_start;
+    };
+
+    explicit FrameProfiler(std::size_t frameCount = 300);
+
+    // depth is used only for displaying the timers as a hierarchy.
+    TimerId addTimer(std::string const& name, unsigned depth = 0);
+
+    // The ID may be reused by a later addTimer().
+    void removeTimer(TimerId timer);
+
+    // Returns a function which calls f and adds the time this takes to a new
+    // timer. The timer is removed when the last copy of the returned function
+    // is destroyed, which thus must happen before the FrameProfiler is.
+    boost::function<void()> profiled(
+        std::string const& name, unsigned depth,
+        boost::function<void()> const& f);
+
+    // Timers with IDs below timerCount() that are not removed.
+    std::vector<TimerId> timers() const;
+    std::size_t timerCount() const { return m_timers.size(); }
+    std::string const& timerName(TimerId timer) const;
+    unsigned timerDepth(TimerId timer) const;
+
+    // Finishes the current frame and starts a new one, replacing the
+    // oldest if frameCount() frames are already recorded.
+    void beginFrame();
+
+    void add(TimerId timer, sf::Time duration);
+
+    // The time since the profiler was created.
+    sf::Time now() const { return m_clock.getElapsedTime(); }
+
+    // Over the recorded frames, not including the current one. All zero if
+    // there are none.
+    ProfileStats stats(TimerId timer) const;
+
+    std::size_t frameCount() const { return m_frameCount; }
+    void setFrameCount(std::size_t frameCount); // Discards recorded frames.
+    std::size_t recordedFrames() const; // Finished frames only.
+
+    bool enabled() const { return m_enabled; }
+    void setEnabled(bool enabled); // Also discards all recorded frames.
+
+private:
+    struct Series {
+        std::string name;
+        unsigned depth;
+        bool used;
+        std::vector<sf::Int64> samples; // Microseconds, one for each frame.
+    };
+
+    Series const& series(TimerId timer) const;
+
+    std::vector<Series> m_timers;
+    std::vector<TimerId> m_freeTimers;
+    std::size_t m_frameCount;
+    std::size_t m_currentFrame;
+    std::size_t m_recordedFrames; // Including the current one.
+    bool m_enabled;
+    sf::Clock m_clock;
+};
+
+#endif
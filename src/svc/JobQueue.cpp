@@ -0,0 +1,108 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#include "JobQueue.hpp"
+
+#include "Logfile.hpp"
+#include "profiling.hpp"
+
+#include <boost/bind.hpp>
+
+#include <stdexcept>
+
+
+JobQueue::JobQueue(unsigned threadCount):
+    m_stopping(false)
+{
+    if (threadCount == 0)
+        throw std::invalid_argument("JobQueue needs at least one thread");
+    m_threads.reserve(threadCount);
+    for (unsigned i = 0; i < threadCount; ++i)
+        m_threads.push_back(std::thread(boost::bind(&JobQueue::work, this)));
+}
+
+JobQueue::~JobQueue()
+{
+    stop();
+}
+
+void JobQueue::post(Job const& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        if (m_stopping)
+            return;
+        m_jobs.push_back(job);
+    }
+    m_jobAvailable.notify_one();
+}
+
+void JobQueue::postToMain(Job const& completion)
+{
+    std::lock_guard<std::mutex> lock(m_completionMutex);
+    if (!m_threads.empty())
+        m_completions.push_back(completion);
+}
+
+void JobQueue::processCompletions()
+{
+    std::vector<Job> completions;
+    {
+        std::lock_guard<std::mutex> lock(m_completionMutex);
+        completions.swap(m_completions);
+    }
+
+    std::size_t i = 0;
+    try {
+        for (; i < completions.size(); ++i)
+            completions[i]();
+    } catch (...) {
+        // Keep the completions which did not run yet for the next call.
+        std::lock_guard<std::mutex> lock(m_completionMutex);
+        m_completions.insert(
+            m_completions.begin(), completions.begin() + i + 1, completions.end());
+        throw;
+    }
+}
+
+void JobQueue::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        if (m_stopping)
+            return;
+        m_stopping = true;
+        m_jobs.clear();
+    }
+    m_jobAvailable.notify_all();
+    for (std::thread& t : m_threads)
+        t.join();
+
+    std::lock_guard<std::mutex> lock(m_completionMutex);
+    m_threads.clear();
+    m_completions.clear();
+}
+
+void JobQueue::work()
+{
+    profiling::setThreadName("JobQueue worker");
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_jobMutex);
+            while (m_jobs.empty() && !m_stopping)
+                m_jobAvailable.wait(lock);
+            if (m_stopping)
+                return;
+            job.swap(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        try {
+            job();
+        } catch (std::exception const& e) {
+            LOG_EX(e);
+        }
+    }
+}
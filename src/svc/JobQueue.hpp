@@ -0,0 +1,61 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+#ifndef JOB_QUEUE_HPP_INCLUDED
+#define JOB_QUEUE_HPP_INCLUDED JOB_QUEUE_HPP_INCLUDED
+
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Runs jobs on worker threads and hands their results back to the main
+// thread: a job calls postToMain() with a function which is then run by
+// processCompletions(), which the main loop calls once per frame.
+// Jobs must not touch anything which is used by the main thread without
+// synchronization (this includes Lua, the ResourceManagers and SFML's
+// graphics resources). Functions posted to the main thread may.
+class JobQueue: private boost::noncopyable {
+public:
+    typedef boost::function<void()> Job;
+
+    explicit JobQueue(unsigned threadCount = 1);
+    ~JobQueue();
+
+    // Both may be called from any thread.
+    void post(Job const& job);
+    void postToMain(Job const& completion);
+
+    // Runs the functions passed to postToMain() so far. Main thread only.
+    void processCompletions();
+
+    // Waits for the running jobs and discards all queued jobs and
+    // completions. Afterwards, nothing is posted anymore. Main thread only.
+    void stop();
+
+    unsigned threadCount() const
+    {
+        return static_cast<unsigned>(m_threads.size());
+    }
+
+private:
+    void work();
+
+    std::mutex m_jobMutex;
+    std::condition_variable m_jobAvailable;
+    std::deque<Job> m_jobs;
+    bool m_stopping;
+
+    std::mutex m_completionMutex;
+    std::vector<Job> m_completions;
+
+    std::vector<std::thread> m_threads;
+};
+
+#endif
@@ -5,17 +5,54 @@
 #define MAINLOOP_KEEP_CALLBACKS
 #include "Mainloop.hpp"
 
+#include "profiling.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+
+namespace {
+
+char const* const phaseNames[] = {
+#   define PHASE_NAME(n) #n,
+    CALLBACKS(PHASE_NAME)
+#   undef PHASE_NAME
+};
+
+} // anonymous namespace
+
 Mainloop::Mainloop():
+    m_frameTimer(m_profiler.addTimer("frame", 0)),
     m_exitRequested(false),
     m_exitcode(EXIT_FAILURE)
 {
+    for (unsigned i = 0; i < phaseCount; ++i) {
+        m_phaseTimers[i] = m_profiler.addTimer(phaseNames[i], 1);
+        m_slotCounts[i] = 0;
+    }
+}
+
+boost::function<void()> Mainloop::profiledSlot(
+    Phase phase, boost::function<void()> const& f)
+{
+    return m_profiler.profiled(
+        phaseNames[phase] + std::string(" #") +
+            boost::lexical_cast<std::string>(++m_slotCounts[phase]),
+        2, f);
 }
 
 int Mainloop::exec()
 {
     m_sig_started();
     while (!m_exitRequested) {
-#define EMIT(s) m_sig_##s();
+        m_profiler.beginFrame();
+        FrameProfiler::Scope const frameScope(m_profiler, m_frameTimer);
+        JD_PROFILE_ZONE("frame");
+#define EMIT(s) {                                                        \
+            FrameProfiler::Scope const phaseScope(                       \
+                m_profiler, m_phaseTimers[phase_##s]);                   \
+            JD_PROFILE_ZONE(phaseNames[phase_##s]);                      \
+            m_sig_##s();                                                 \
+        }
         CALLBACKS(EMIT)
 #undef EMIT
     }
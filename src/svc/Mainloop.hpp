@@ -5,6 +5,8 @@
 #ifndef MAINLOOP_HPP_INCLUDED
 #define MAINLOOP_HPP_INCLUDED MAINLOOP_HPP_INCLUDED
 
+#include "FrameProfiler.hpp"
+
 #include <ssig.hpp>
 
 #include <cstdlib>
@@ -13,6 +15,9 @@
 class MetaComponent;
 
 class Mainloop {
+    // Declared before the signals, because their slots hold timers of it.
+    FrameProfiler m_profiler;
+
 #define CALLBACKS(m) \
         m(started)      \
         m(preFrame)     \
@@ -24,7 +29,25 @@ class Mainloop {
         m(postDraw)     \
         m(postFrame)
 
-#   define CALLBACK(n) SSIG_DEFINE_MEMBERSIGNAL(n, void())
+public:
+    enum Phase {
+#       define PHASE(n) phase_##n,
+        CALLBACKS(PHASE)
+#       undef PHASE
+        phaseCount
+    };
+
+    // Like SSIG_DEFINE_MEMBERSIGNAL, but each connected slot gets its own
+    // profiler timer.
+#   define CALLBACK(n)                                                   \
+    public:                                                              \
+        ssig::Connection<void()> connect_##n(                            \
+            boost::function<void()> const& f)                            \
+        {                                                                \
+            return m_sig_##n.connect(profiledSlot(phase_##n, f));        \
+        }                                                                \
+    private:                                                             \
+        ssig::Signal<void()> m_sig_##n;
     CALLBACKS(CALLBACK)
 #   undef CALLBACK
 #   ifndef MAINLOOP_KEEP_CALLBACKS
@@ -38,7 +61,18 @@ public:
     int exec();
     void quit(int exitcode = EXIT_SUCCESS);
 
+    // Has a timer for each frame, one for each phase (signal) and one for
+    // each slot connected to a phase.
+    FrameProfiler& profiler() { return m_profiler; }
+    FrameProfiler const& profiler() const { return m_profiler; }
+
 private:
+    boost::function<void()> profiledSlot(
+        Phase phase, boost::function<void()> const& f);
+
+    FrameProfiler::TimerId m_frameTimer;
+    FrameProfiler::TimerId m_phaseTimers[phaseCount];
+    unsigned m_slotCounts[phaseCount];
     bool m_exitRequested;
     int m_exitcode;
 };
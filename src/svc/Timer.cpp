@@ -5,6 +5,7 @@
 #include "Timer.hpp"
 
 #include "Logfile.hpp"
+#include "profiling.hpp"
 
 
 Timer::Timer():
@@ -53,6 +54,7 @@ void Timer::beginFrame()
 
 void Timer::processCallbacks()
 {
+    JD_PROFILE_ZONE("Timer::processCallbacks");
     auto const time =  m_timer.getElapsedTime() * m_factor;
     for (auto it = m_entries.begin(); it != m_entries.end(); ) {
         if (it->at <= time) {
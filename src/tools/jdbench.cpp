@@ -0,0 +1,297 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+// Micro-benchmarks for engine internals whose speed matters for loading or
+// drawing. Prints one line per measurement.
+
+#include "base64.hpp"
+#include "TransformGroup.hpp"
+
+#include <boost/format.hpp>
+#include <SFML/Graphics/RenderTexture.hpp>
+#include <SFML/Graphics/Sprite.hpp>
+#include <SFML/Graphics/Texture.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// Repeats f until at least minSeconds have passed and returns the average
+// duration of one call, in seconds.
+template <typename F>
+double timePerCall(F f, double minSeconds = 0.5)
+{
+    f(); // Warm up caches.
+    std::size_t calls = 0;
+    Clock::time_point const start = Clock::now();
+    double elapsed;
+    do {
+        f();
+        ++calls;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    return elapsed / static_cast<double>(calls);
+}
+
+
+// The decoder before the lookup table and SIMD blocks were introduced,
+// kept as the baseline.
+namespace oldBase64 {
+
+base64::byte charToByte(base64::byte c)
+{
+    switch(c) {
+        case '+': return 62;
+        case '/': return 63;
+        case '=': return -1;
+        default:
+            if (c >= '0' && c <= '9')
+                return c - '0' + 52;
+            if (c >= 'A' && c <= 'Z')
+                return c - 'A';
+            if (c >= 'a' && c <= 'z')
+                return c - 'a' + 26;
+            throw base64::InvalidCharacter();
+        }
+}
+
+std::size_t decode(
+    base64::byte const* encoded, std::size_t byteCount, base64::byte* out)
+{
+    base64::byte quad[4];
+    unsigned quadSize = 0;
+    unsigned padding = 0;
+    base64::byte* const outBegin = out;
+    for (std::size_t i = 0; i < byteCount; ++i) {
+        base64::byte const c = encoded[i];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            continue;
+
+        base64::byte const value = charToByte(c);
+        if (value == -1) {
+            if (quadSize < 2)
+                throw base64::InvalidCharacter();
+            ++padding;
+        } else if (padding > 0) {
+            throw base64::InvalidCharacter();
+        }
+        quad[quadSize++] = value == -1 ? 0 : value;
+
+        if (quadSize == 4) {
+            base64::byte const decoded[3] = {
+                static_cast<base64::byte>(quad[0] << 2 | quad[1] >> 4),
+                static_cast<base64::byte>(quad[1] << 4 | quad[2] >> 2),
+                static_cast<base64::byte>(quad[2] << 6 | quad[3])
+            };
+            std::size_t const count = 3 - padding;
+            std::memcpy(out, decoded, count);
+            out += count;
+            quadSize = 0;
+        }
+    }
+    if (quadSize != 0)
+        throw base64::InvalidLength();
+    return static_cast<std::size_t>(out - outBegin);
+}
+
+} // namespace oldBase64
+
+std::string encodeBase64(std::vector<unsigned char> const& data)
+{
+    char const alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string result;
+    result.reserve((data.size() + 2) / 3 * 4);
+    std::size_t i = 0;
+    for (; i + 3 <= data.size(); i += 3) {
+        unsigned const v = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+        result += alphabet[v >> 18];
+        result += alphabet[v >> 12 & 63];
+        result += alphabet[v >> 6 & 63];
+        result += alphabet[v & 63];
+    }
+    if (i < data.size()) {
+        unsigned v = data[i] << 16;
+        if (i + 1 < data.size())
+            v |= data[i + 1] << 8;
+        result += alphabet[v >> 18];
+        result += alphabet[v >> 12 & 63];
+        result += i + 1 < data.size() ? alphabet[v >> 6 & 63] : '=';
+        result += '=';
+    }
+    return result;
+}
+
+// The text of an uncompressed, base64 encoded Tiled layer of
+// width * height tiles, as passed to base64::Decoder by MapInfo: little
+// endian 32 bit tile IDs, framed by the indentation of the <data> element.
+std::string mapLayerText(unsigned width, unsigned height)
+{
+    std::vector<unsigned char> data;
+    data.reserve(width * height * 4);
+    unsigned seed = 12345;
+    for (unsigned y = 0; y < height; ++y) {
+        for (unsigned x = 0; x < width; ++x) {
+            seed = seed * 1103515245 + 12345;
+            unsigned const r = seed >> 16;
+
+            // Mostly ground tiles from a small tileset, some empty cells and
+            // a few flipped tiles.
+            unsigned tile = r % 8 == 0 ? 0 : 1 + r % 48;
+            if (tile != 0 && r % 97 == 0)
+                tile |= 0x80000000u; // Flipped horizontally.
+            for (unsigned i = 0; i < 4; ++i)
+                data.push_back(static_cast<unsigned char>(tile >> (8 * i)));
+        }
+    }
+    return "\n   " + encodeBase64(data) + "\n  ";
+}
+
+char const* blockDecoderName(base64::BlockDecoder decoder)
+{
+    switch (decoder) {
+        case base64::BlockDecoder::table: return "table";
+        case base64::BlockDecoder::sse2: return "SSE2";
+        case base64::BlockDecoder::avx2: return "AVX2";
+        default: return "?";
+    }
+}
+
+void benchmarkBase64()
+{
+    unsigned const layerSize = 256;
+    std::string const text = mapLayerText(layerSize, layerSize);
+    std::vector<base64::byte> expected(base64::maxDecodedSize(text.size()));
+    expected.resize(oldBase64::decode(text.data(), text.size(), &expected[0]));
+    std::vector<base64::byte> out(base64::maxDecodedSize(text.size()));
+
+    std::cout << boost::format(
+        "base64: %1%x%2% tile layer, %3% characters\n")
+        % layerSize % layerSize % text.size();
+
+    double const megabytes = static_cast<double>(text.size()) / 1e6;
+    double const oldSeconds = timePerCall([&] {
+        oldBase64::decode(text.data(), text.size(), &out[0]);
+    });
+    std::cout << boost::format("  %-8s %8.1f MB/s\n")
+        % "old" % (megabytes / oldSeconds);
+
+    base64::BlockDecoder const defaultDecoder = base64::blockDecoder();
+    base64::BlockDecoder const decoders[] = {
+        base64::BlockDecoder::table,
+        base64::BlockDecoder::sse2,
+        base64::BlockDecoder::avx2
+    };
+    for (base64::BlockDecoder decoder : decoders) {
+        char const* const name = blockDecoderName(decoder);
+        if (!base64::isAvailable(decoder)) {
+            std::cout << boost::format("  %-8s not available\n") % name;
+            continue;
+        }
+        base64::setBlockDecoder(decoder);
+        std::size_t const n = base64::decode(text.data(), text.size(), &out[0]);
+        if (n != expected.size() ||
+            std::memcmp(&out[0], &expected[0], n) != 0
+        ) {
+            throw std::runtime_error(
+                std::string("base64: wrong result with ") + name);
+        }
+        double const seconds = timePerCall([&] {
+            base64::decode(text.data(), text.size(), &out[0]);
+        });
+        std::cout << boost::format("  %-8s %8.1f MB/s (%.1fx)\n")
+            % name % (megabytes / seconds) % (oldSeconds / seconds);
+    }
+    base64::setBlockDecoder(defaultDecoder);
+}
+
+
+// Draws spriteCount sprites at random positions, each with one of the first
+// textureCount textures (chosen randomly, so that consecutive sprites mostly
+// differ if textureCount > 1), once for each of TransformGroup's modes.
+void benchmarkSpriteScene(
+    sf::RenderTexture& target,
+    std::vector<sf::Texture> const& textures, std::size_t textureCount)
+{
+    std::size_t const spriteCount = 5000;
+    sf::Vector2u const targetSize = target.getSize();
+    std::vector<sf::Sprite> sprites(spriteCount);
+    TransformGroup group;
+    unsigned seed = 54321;
+    for (sf::Sprite& sprite : sprites) {
+        seed = seed * 1103515245 + 12345;
+        unsigned const r = seed >> 8;
+        sprite.setTexture(textures[r % textureCount]);
+        sprite.setPosition(
+            static_cast<float>(r % targetSize.x),
+            static_cast<float>(r / targetSize.x % targetSize.y));
+        group.add(&sprite);
+    }
+
+    std::cout << boost::format("  %1% sprites, %2% texture(s):\n")
+        % spriteCount % textureCount;
+
+    struct Mode {
+        char const* name;
+        bool batching;
+        bool sortByTexture;
+    };
+    Mode const modes[] = {
+        { "unbatched", false, false },
+        { "batched", true, false },
+        { "sorted", true, true }
+    };
+    for (Mode const& mode : modes) {
+        group.setBatching(mode.batching);
+        group.setSortByTexture(mode.sortByTexture);
+        double const seconds = timePerCall([&] {
+            target.clear();
+            target.draw(group);
+            target.display();
+        });
+        std::cout << boost::format("    %-10s %5u draw calls %8.3f ms/frame\n")
+            % mode.name % group.drawCalls() % (seconds * 1e3);
+    }
+}
+
+void benchmarkSprites()
+{
+    sf::RenderTexture target;
+    if (!target.create(800, 600))
+        throw std::runtime_error("sprites: cannot create render texture");
+    std::vector<sf::Texture> textures(4);
+    for (sf::Texture& texture : textures) {
+        if (!texture.create(32, 32))
+            throw std::runtime_error("sprites: cannot create texture");
+    }
+
+    std::cout << "sprites: TransformGroup, 800x600 render texture\n";
+    benchmarkSpriteScene(target, textures, 1);
+    benchmarkSpriteScene(target, textures, textures.size());
+}
+
+} // anonymous namespace
+
+
+int main()
+{
+    try {
+        benchmarkBase64();
+        benchmarkSprites();
+    } catch (std::exception const& e) {
+        std::cerr << "jdbench: " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
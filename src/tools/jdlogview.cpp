@@ -0,0 +1,166 @@
+// Part of the Jade Engine -- Copyright (c) Christian Neumüller 2012--2013
+// This file is subject to the terms of the BSD 2-Clause License.
+// See LICENSE.txt or http://opensource.org/licenses/BSD-2-Clause
+
+// Converts binary (.jdlog) log files to the plain text or HTML log styles,
+// optionally keeping only some of the messages.
+
+#include "logFormat.hpp"
+
+#include <boost/lexical_cast.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+
+namespace {
+
+char const usage[] =
+    "Usage: jdlogview [options] <input.jdlog> [<output>]\n"
+    "Converts a binary jd log to plain text (default) or HTML and writes it\n"
+    "to <output> or, if it is not given, to the standard output.\n\n"
+    "Options:\n"
+    "  --html               Write HTML (default if <output> ends with .html).\n"
+    "  --plain              Write plain text.\n"
+    "  --level <level>      Only messages of at least the given level\n"
+    "                       (debug, info, warning, error or fatal).\n"
+    "  --location <text>    Only messages whose location contains <text>.\n"
+    "  --from <seconds>     Only messages logged at or after <seconds>.\n"
+    "  --to <seconds>       Only messages logged at or before <seconds>.\n";
+
+struct Filter {
+    Filter():
+        minLevel(loglevel::debug),
+        from(std::numeric_limits<boost::int64_t>::min()),
+        to(std::numeric_limits<boost::int64_t>::max())
+    { }
+
+    bool accepts(logformat::BinaryRecord const& record) const
+    {
+        if (record.level < minLevel ||
+            record.microseconds < from || record.microseconds > to
+        ) {
+            return false;
+        }
+        if (location.empty())
+            return true;
+        return record.location &&
+            record.location->find(location) != std::string::npos;
+    }
+
+    loglevel minLevel;
+    std::string location;
+    boost::int64_t from, to;
+};
+
+loglevel parseLevel(std::string const& name)
+{
+    char const* const names[] = { "debug", "info", "warning", "error", "fatal" };
+    for (unsigned i = 0; i < static_cast<unsigned>(loglevel::max); ++i) {
+        if (name == names[i])
+            return static_cast<loglevel>(i);
+    }
+    throw std::invalid_argument("unknown log level \"" + name + "\"");
+}
+
+boost::int64_t parseSeconds(std::string const& s)
+{
+    return static_cast<boost::int64_t>(
+        boost::lexical_cast<double>(s) * 1e6);
+}
+
+} // anonymous namespace
+
+
+int main(int argc, char* argv[])
+{
+    logstyle style = logstyle::like_extension;
+    Filter filter;
+    std::string inputFilename, outputFilename;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string const arg = argv[i];
+            bool const hasValue = i + 1 < argc;
+            if (arg == "--html") {
+                style = logstyle::html;
+            } else if (arg == "--plain") {
+                style = logstyle::plain;
+            } else if (arg == "--level" && hasValue) {
+                filter.minLevel = parseLevel(argv[++i]);
+            } else if (arg == "--location" && hasValue) {
+                filter.location = argv[++i];
+            } else if (arg == "--from" && hasValue) {
+                filter.from = parseSeconds(argv[++i]);
+            } else if (arg == "--to" && hasValue) {
+                filter.to = parseSeconds(argv[++i]);
+            } else if (arg == "--help" || arg == "-h") {
+                std::cout << usage;
+                return EXIT_SUCCESS;
+            } else if (arg.compare(0, 2, "--") != 0 && inputFilename.empty()) {
+                inputFilename = arg;
+            } else if (arg.compare(0, 2, "--") != 0 && outputFilename.empty()) {
+                outputFilename = arg;
+            } else {
+                throw std::invalid_argument(
+                    "invalid or incomplete argument \"" + arg + "\"");
+            }
+        }
+    } catch (std::exception const& e) {
+        std::cerr << "jdlogview: " << e.what() << "\n\n" << usage;
+        return EXIT_FAILURE;
+    }
+
+    if (inputFilename.empty()) {
+        std::cerr << usage;
+        return EXIT_FAILURE;
+    }
+    if (style == logstyle::like_extension) {
+        style = outputFilename.empty() ?
+            logstyle::plain : logformat::styleFromFilename(outputFilename);
+        if (style == logstyle::binary)
+            style = logstyle::plain;
+    }
+
+    std::ifstream in(inputFilename.c_str(), std::ios::in | std::ios::binary);
+    if (!in) {
+        std::cerr << "jdlogview: cannot open \"" << inputFilename << "\"\n";
+        return EXIT_FAILURE;
+    }
+    std::ofstream outFile;
+    if (!outputFilename.empty()) {
+        outFile.open(outputFilename.c_str());
+        if (!outFile) {
+            std::cerr << "jdlogview: cannot open \"" << outputFilename << "\"\n";
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream& out = outputFilename.empty() ? std::cout : outFile;
+
+    out << logformat::header(style);
+    try {
+        logformat::BinaryReader reader(in);
+        logformat::BinaryRecord record;
+        while (reader.read(record)) {
+            if (filter.accepts(record)) {
+                out << logformat::formatText(
+                    style, record.level,
+                    record.location ? record.location->c_str() : nullptr,
+                    record.microseconds, record.message);
+            }
+        }
+    } catch (logformat::FormatError const& e) {
+        // Still finish the output: the log may just have been cut off by a
+        // crash of the program writing it.
+        out << logformat::footer(style);
+        std::cerr << "jdlogview: " << inputFilename << ": " << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    out << logformat::footer(style);
+    return out ? EXIT_SUCCESS : EXIT_FAILURE;
+}